@@ -1,9 +1,15 @@
 #include <iostream>
-#include <windows.h>
 #include <memory>
 #include <limits>
+#include <chrono>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
 
 #include <ImageBuffer.hpp>
+#include <ImageFile.hpp>
+#include <CommandLine.hpp>
 
 #include "Types.h"
 #include "Sphere.hpp"
@@ -19,8 +25,10 @@ enum ErrorCode
     eNoErrors,
     eClassRegistrationError,
     eWindowCreationError,
+    eRuntimeError,
 };
 
+#ifdef _WIN32
 /// Дескриптор исполняемого модуля программы
 HINSTANCE g_hInstance = nullptr;
 /// Дескриптор осноного окна отрисовки
@@ -31,9 +39,11 @@ HDC g_hdc = nullptr;
 const char* g_strClassName = "MainWindowClass";
 /// Заголовок окна
 const char* g_strWindowCaption = "01 - Basic example";
+#endif
 /// Код последней ошибки
 ErrorCode g_lastError = ErrorCode::eNoErrors;
 
+#ifdef _WIN32
 /** W I N A P I  S T U F F **/
 
 /**
@@ -54,6 +64,7 @@ LRESULT CALLBACK WindowProcedure(HWND hWnd, UINT message, WPARAM wParam, LPARAM
  * \param hWnd Дескриптор окна
  */
 void PresentFrame(void *pixels, int width, int height, HWND hWnd);
+#endif
 
 /** R A Y T R A C I N G  **/
 
@@ -76,15 +87,17 @@ struct NearestHit
  * \param fov Угол обзора
  * \param sceneElements Элементы сцены
  * \param lightSources Источники освещения
+ * \param packets Трассировать первичные и теневые лучи пакетами (лучи блока соседних пикселей вместе)
  *
  * \details В данном методе происходит генерация лучей для каждого пикселя кадрового буфера и последующая
  * трассировка лучами сцены, а также запись полученных значений в пиксели кадрового буфера
  */
 void Render(
-        ImageBuffer<RGBQUAD> *imageBuffer,
+        ImageBuffer<Pixel> *imageBuffer,
         const float& fov,
         const std::vector<std::shared_ptr<SceneElement>> &sceneElements,
-        const std::vector<LightSource>& lightSources);
+        const std::vector<LightSource>& lightSources,
+        bool packets = true);
 
 /**
  * \brief Метод трассировки сцены лучом
@@ -106,6 +119,47 @@ bool TraceTay(
         math::Vec3<float>* outColor,
         uint32_t recursionDepth = 0);
 
+/**
+ * \brief Метод вычисления цвета точки ближайшего пересечения (аналог шейдера ray-hit)
+ * \param ray Луч
+ * \param nearestHit Атрибуты точки ближайшего пересечения
+ * \param sceneElements Элементы сцены
+ * \param lightSources Источники освещения
+ * \param maxDistance Максимальное расстояние (для отраженных и преломленных лучей)
+ * \param outColor Результирующий цвет для точки пересечения
+ * \param recursionDepth Глубина рекурсии луча
+ * \param lightVisibility Видимость источников из точки (если уже известна - теневые лучи не трассируются)
+ */
+void ShadeHit(
+        const math::Ray& ray,
+        NearestHit nearestHit,
+        const std::vector<std::shared_ptr<SceneElement>> &sceneElements,
+        const std::vector<LightSource>& lightSources,
+        float maxDistance,
+        math::Vec3<float>* outColor,
+        uint32_t recursionDepth,
+        const bool* lightVisibility = nullptr);
+
+/**
+ * \brief Метод трассировки сцены пакетом лучей
+ * \param rays Лучи пакета (для активных дорожек)
+ * \param packet Пакет лучей
+ * \param sceneElements Элементы сцены
+ * \param lightSources Источники освещения
+ * \param outColors Результирующие цвета (для активных дорожек)
+ * \param lightVisibility Буфер для видимости источников (RAY_PACKET_SIZE * кол-во источников значений)
+ *
+ * \details Ближайшие пересечения ищутся для всех лучей пакета разом, дальше (освещение, тени, отражения и
+ * преломления) каждый луч обрабатывается отдельно - вторичные лучи уже не когерентны
+ */
+void TracePacket(
+        const math::Ray rays[RAY_PACKET_SIZE],
+        const RayPacket& packet,
+        const std::vector<std::shared_ptr<SceneElement>> &sceneElements,
+        const std::vector<LightSource>& lightSources,
+        math::Vec3<float> outColors[RAY_PACKET_SIZE],
+        bool* lightVisibility);
+
 /** M A I N **/
 
 /**
@@ -116,66 +170,88 @@ bool TraceTay(
  */
 int main(int argc, char* argv[])
 {
-    (void)argc;
-    (void)argv;
-
     try {
-        // Получение дескриптора исполняемого модуля программы
-        g_hInstance = GetModuleHandle(nullptr);
-
-        // Информация о классе
-        WNDCLASSEX classInfo;
-        classInfo.cbSize = sizeof(WNDCLASSEX);
-        classInfo.style = CS_HREDRAW | CS_VREDRAW | CS_OWNDC;
-        classInfo.cbClsExtra = 0;
-        classInfo.cbWndExtra = 0;
-        classInfo.hInstance = g_hInstance;
-        classInfo.hIcon = LoadIcon(g_hInstance, IDI_APPLICATION);
-        classInfo.hIconSm = LoadIcon(g_hInstance, IDI_APPLICATION);
-        classInfo.hCursor = LoadCursor(nullptr, IDC_ARROW);
-        classInfo.hbrBackground = CreateSolidBrush(RGB(240, 240, 240));
-        classInfo.lpszMenuName = nullptr;
-        classInfo.lpszClassName = g_strClassName;
-        classInfo.lpfnWndProc = WindowProcedure;
-
-        // Пытаемся зарегистрировать оконный класс
-        if (!RegisterClassEx(&classInfo)) {
-            g_lastError = ErrorCode::eClassRegistrationError;
-            throw std::runtime_error("ERROR: Can't register window class.");
-        }
+        // Аргументы командной строки
+        CommandLine commandLine(argc, argv);
+
+        // Файл для сохранения кадра
+        const std::string outputPath = commandLine.getString("output", "01_Basic.png");
+        // Размеры кадра (в оконном режиме - размеры окна)
+        unsigned width = commandLine.getUnsigned("width", 800);
+        unsigned height = commandLine.getUnsigned("height", 600);
+
+#ifdef _WIN32
+        // Без явно заданного файла кадр показывается в окне
+        const bool headless = commandLine.has("output");
+#else
+        // Оконного режима нет - кадр всегда сохраняется в файл
+        const bool headless = true;
+#endif
+
+#ifdef _WIN32
+        if(!headless)
+        {
+            // Получение дескриптора исполняемого модуля программы
+            g_hInstance = GetModuleHandle(nullptr);
+
+            // Информация о классе
+            WNDCLASSEX classInfo;
+            classInfo.cbSize = sizeof(WNDCLASSEX);
+            classInfo.style = CS_HREDRAW | CS_VREDRAW | CS_OWNDC;
+            classInfo.cbClsExtra = 0;
+            classInfo.cbWndExtra = 0;
+            classInfo.hInstance = g_hInstance;
+            classInfo.hIcon = LoadIcon(g_hInstance, IDI_APPLICATION);
+            classInfo.hIconSm = LoadIcon(g_hInstance, IDI_APPLICATION);
+            classInfo.hCursor = LoadCursor(nullptr, IDC_ARROW);
+            classInfo.hbrBackground = CreateSolidBrush(RGB(240, 240, 240));
+            classInfo.lpszMenuName = nullptr;
+            classInfo.lpszClassName = g_strClassName;
+            classInfo.lpfnWndProc = WindowProcedure;
+
+            // Пытаемся зарегистрировать оконный класс
+            if (!RegisterClassEx(&classInfo)) {
+                g_lastError = ErrorCode::eClassRegistrationError;
+                throw std::runtime_error("ERROR: Can't register window class.");
+            }
 
-        // Создание окна
-        g_hwnd = CreateWindow(
-                g_strClassName,
-                g_strWindowCaption,
-                WS_OVERLAPPEDWINDOW,
-                0, 0,
-                800, 600,
-                nullptr,
-                nullptr,
-                g_hInstance,
-                nullptr);
-
-        // Если не удалось создать окно
-        if (!g_hwnd) {
-            g_lastError = ErrorCode::eWindowCreationError;
-            throw std::runtime_error("ERROR: Can't create main application window.");
-        }
+            // Создание окна
+            g_hwnd = CreateWindow(
+                    g_strClassName,
+                    g_strWindowCaption,
+                    WS_OVERLAPPEDWINDOW,
+                    0, 0,
+                    static_cast<int>(width), static_cast<int>(height),
+                    nullptr,
+                    nullptr,
+                    g_hInstance,
+                    nullptr);
+
+            // Если не удалось создать окно
+            if (!g_hwnd) {
+                g_lastError = ErrorCode::eWindowCreationError;
+                throw std::runtime_error("ERROR: Can't create main application window.");
+            }
 
-        // Показать окно
-        ShowWindow(g_hwnd, SW_SHOWNORMAL);
+            // Показать окно
+            ShowWindow(g_hwnd, SW_SHOWNORMAL);
 
-        // Получение контекста отрисовки
-        g_hdc = GetDC(g_hwnd);
+            // Получение контекста отрисовки
+            g_hdc = GetDC(g_hwnd);
 
-        // Размеры клиентской области окна
-        RECT clientRect;
-        GetClientRect(g_hwnd, &clientRect);
+            // Размеры клиентской области окна
+            RECT clientRect;
+            GetClientRect(g_hwnd, &clientRect);
+            // Кадр занимает всю клиентскую область
+            width = static_cast<unsigned>(clientRect.right);
+            height = static_cast<unsigned>(clientRect.bottom);
+        }
+#endif
 
         /** RAYTRACING **/
 
         // Создать буффер кадра
-        auto frameBuffer = ImageBuffer<RGBQUAD>(clientRect.right, clientRect.bottom, {0, 0, 0, 0});
+        auto frameBuffer = ImageBuffer<Pixel>(width, height, {0, 0, 0, 0});
         std::cout << "INFO: Frame-buffer initialized  (resolution : " << frameBuffer.getWidth() << "x" << frameBuffer.getHeight() << ", size : " << frameBuffer.getSize() << " bytes)" << std::endl;
 
         // Материалы
@@ -202,40 +278,56 @@ int main(int argc, char* argv[])
         std::vector<LightSource> lightSources{};
         lightSources.push_back({math::Vec3<float>(0.0f,8.5f,-10.0f),math::Vec3<float>(0.9f,0.9f,0.9f)});
 
-        // Трассировка сцены лучами, запись результата в буфер изображения
-        Render(&frameBuffer,90.0f, scene, lightSources);
+        // Трассировка сцены лучами, запись результата в буфер изображения (первичные и теневые лучи - пакетами, если не отключено)
+        auto renderBeginTime = std::chrono::system_clock::now();
+        Render(&frameBuffer,90.0f, scene, lightSources, !commandLine.has("no-packets"));
+        std::cout << "INFO: Scene rendered in " << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - renderBeginTime).count() << " ms." << std::endl;
 
-        // Показ кадра
-        PresentFrame(frameBuffer.getData(), static_cast<int>(frameBuffer.getWidth()), static_cast<int>(frameBuffer.getHeight()), g_hwnd);
+        // Сохранение кадра в файл
+        if(headless)
+        {
+            imagefile::SaveImage(outputPath, frameBuffer);
+            std::cout << "INFO: Frame saved to \"" << outputPath << "\"" << std::endl;
+        }
+#ifdef _WIN32
+        else
+        {
+            // Показ кадра
+            PresentFrame(frameBuffer.getData(), static_cast<int>(frameBuffer.getWidth()), static_cast<int>(frameBuffer.getHeight()), g_hwnd);
 
-        /** MAIN LOOP **/
+            /** MAIN LOOP **/
 
-        // Оконное сообщение
-        MSG msg = {};
+            // Оконное сообщение
+            MSG msg = {};
 
-        // Запуск цикла
-        while (true)
-        {
-            // Обработка оконных сообщений
-            if (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+            // Запуск цикла
+            while (true)
             {
-                DispatchMessage(&msg);
-
-                if (msg.message == WM_QUIT) {
-                    break;
+                // Обработка оконных сообщений
+                if (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+                {
+                    DispatchMessage(&msg);
+
+                    if (msg.message == WM_QUIT) {
+                        break;
+                    }
                 }
             }
         }
+#endif
     }
     catch(std::exception& ex)
     {
         std::cout << ex.what() << std::endl;
+        if(g_lastError == ErrorCode::eNoErrors) g_lastError = ErrorCode::eRuntimeError;
     }
 
+#ifdef _WIN32
     // Уничтожение окна
-    DestroyWindow(g_hwnd);
+    if(g_hwnd) DestroyWindow(g_hwnd);
     // Вырегистрировать класс окна
-    UnregisterClass(g_strClassName, g_hInstance);
+    if(g_hInstance) UnregisterClass(g_strClassName, g_hInstance);
+#endif
 
     // Код выполнения/ошибки
     return static_cast<int>(g_lastError);
@@ -243,6 +335,7 @@ int main(int argc, char* argv[])
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+#ifdef _WIN32
 /** W I N A P I  S T U F F **/
 
 /**
@@ -308,6 +401,7 @@ void PresentFrame(void *pixels, int width, int height, HWND hWnd)
     // Уничтожить DC
     ReleaseDC(hWnd,hdc);
 }
+#endif
 
 /** R A Y T R A C I N G  M E T H O D S **/
 
@@ -317,43 +411,92 @@ void PresentFrame(void *pixels, int width, int height, HWND hWnd)
  * \param fov Угол обзора
  * \param sceneElements Элементы сцены
  * \param lightSources Источники освещения
+ * \param packets Трассировать первичные и теневые лучи пакетами (лучи блока соседних пикселей вместе)
  *
  * \details В данном методе происходит генерация лучей для каждого пикселя кадрового буфера и последующая
  * трассировка лучами сцены, а также запись полученных значений в пиксели кадрового буфера
  */
-void Render(ImageBuffer<RGBQUAD> *imageBuffer, const float &fov,
+void Render(ImageBuffer<Pixel> *imageBuffer, const float &fov,
             const std::vector<std::shared_ptr<SceneElement>> &sceneElements,
-            const std::vector<LightSource> &lightSources)
+            const std::vector<LightSource> &lightSources,
+            bool packets)
 {
     // Размеры кадрового буфера
     auto w = static_cast<float>(imageBuffer->getWidth());
     auto h = static_cast<float>(imageBuffer->getHeight());
 
-    // Угол обзора в радианах
+    // Угол обзора в радианах (и тангенс половины угла - общий для всех пикселей)
     auto fovRadians = static_cast<float>(fov / (180.0f / M_PI));
+    const float tanHalfFov = tanf(fovRadians/2.0f);
+
+    // Лямбда - первичный луч пикселя
+    auto primaryRay = [&](uint32_t i, uint32_t j){
+        // Вычислить отклонение луча для текущего пикселя по углу обзора и текущим координатам пикселя
+        float x = (2.0f*(static_cast<float>(i) + 0.5f)/w  - 1.0f) * tanHalfFov * w/h;
+        float y = -(2.0f*(static_cast<float>(j) + 0.5f)/h - 1.0f) * tanHalfFov;
+
+        // Создать луч
+        return math::Ray({0.0f,0.0f,0.0f},{x,y,-1.0f});
+    };
+
+    // Лямбда - запись цвета в пиксель
+    auto setColor = [&](uint32_t i, uint32_t j, const math::Vec3<float>& resultColor){
+        imageBuffer->setPoint(i,j,{
+                static_cast<uint8_t>(math::Clamp(resultColor.b,0.0f,1.0f) * 255.0f),
+                static_cast<uint8_t>(math::Clamp(resultColor.g,0.0f,1.0f) * 255.0f),
+                static_cast<uint8_t>(math::Clamp(resultColor.r,0.0f,1.0f) * 255.0f),
+                255
+        });
+    };
+
+    // Трассировка по одному лучу
+    if(!packets)
+    {
+        // Проход по пикселям кадрового буфера
+        for(uint32_t j = 0; j < imageBuffer->getHeight(); j++) {
+            for (uint32_t i = 0; i < imageBuffer->getWidth(); i++)
+            {
+                // Трассировка сцены и получение цвета
+                math::Vec3<float> resultColor = {0.0f,0.0f,0.0f};
+                TraceTay(primaryRay(i,j), sceneElements, lightSources,0.0f,1000.0f, &resultColor);
 
-    // Проход по пикселям кадрового буфера
-    for(uint32_t j = 0; j < imageBuffer->getHeight(); j++) {
-        for (uint32_t i = 0; i < imageBuffer->getWidth(); i++)
+                // Установка цвета
+                setColor(i,j,resultColor);
+            }
+        }
+        return;
+    }
+
+    // Размеры блока пикселей, лучи которого составляют пакет (4 - 2x2, 8 - 4x2, 16 - 4x4)
+    const uint32_t blockWidth = RAY_PACKET_SIZE == 4 ? 2 : 4;
+    const uint32_t blockHeight = RAY_PACKET_SIZE / blockWidth;
+
+    // Видимость источников из точек пересечения лучей пакета (буфер общий для всех пакетов)
+    std::unique_ptr<bool[]> lightVisibility(new bool[RAY_PACKET_SIZE * std::max<size_t>(lightSources.size(), 1)]());
+
+    // Проход по блокам пикселей кадрового буфера
+    for(uint32_t by = 0; by < imageBuffer->getHeight(); by += blockHeight) {
+        for(uint32_t bx = 0; bx < imageBuffer->getWidth(); bx += blockWidth)
         {
-            // Вычислить отклонение луча для текущего пикселя по углу обзора и текущим координатам пикселя
-            float x = (2.0f*(static_cast<float>(i) + 0.5f)/w  - 1.0f) * tanf(fovRadians/2.0f) * w/h;
-            float y = -(2.0f*(static_cast<float>(j) + 0.5f)/h - 1.0f) * tanf(fovRadians/2.0f);
-
-            // Создать луч
-            math::Ray ray({0.0f,0.0f,0.0f},{x,y,-1.0f});
-
-            // Трассировка сцены и получение цвета
-            math::Vec3<float> resultColor = {0.0f,0.0f,0.0f};
-            TraceTay(ray, sceneElements, lightSources,0.0f,1000.0f, &resultColor);
-
-            // Установка цвета
-            imageBuffer->setPoint(i,j,{
-                    static_cast<BYTE>(math::Clamp(resultColor.b,0.0f,1.0f) * 255.0f),
-                    static_cast<BYTE>(math::Clamp(resultColor.g,0.0f,1.0f) * 255.0f),
-                    static_cast<BYTE>(math::Clamp(resultColor.r,0.0f,1.0f) * 255.0f),
-                    255
-            });
+            // Лучи пикселей блока (пиксели за пределами кадра - неактивные дорожки)
+            math::Ray rays[RAY_PACKET_SIZE];
+            RayPacket packet;
+            for(uint32_t lane = 0; lane < RAY_PACKET_SIZE; lane++)
+            {
+                uint32_t i = bx + lane % blockWidth, j = by + lane / blockWidth;
+                if(i >= imageBuffer->getWidth() || j >= imageBuffer->getHeight()) continue;
+                rays[lane] = primaryRay(i,j);
+                packet.setRay(lane, rays[lane], 0.0f, 1000.0f);
+            }
+
+            // Трассировка сцены пакетом и получение цветов
+            math::Vec3<float> resultColors[RAY_PACKET_SIZE];
+            TracePacket(rays, packet, sceneElements, lightSources, resultColors, lightVisibility.get());
+
+            // Установка цветов
+            for(uint32_t lane = 0; lane < RAY_PACKET_SIZE; lane++){
+                if(packet.getActiveMask() & (1u << lane)) setColor(bx + lane % blockWidth, by + lane / blockWidth, resultColors[lane]);
+            }
         }
     }
 }
@@ -407,90 +550,207 @@ bool TraceTay(const math::Ray &ray, const std::vector<std::shared_ptr<SceneEleme
     // Следующую часть кода можно считать аналогом шейдера ray-hit (closest-hit)
     if(hit && outColor != nullptr)
     {
-        // Объект с которым было ближайшее пересечения
-        const auto& sceneElement = sceneElements[nearestHit.instanceIndex];
+        ShadeHit(ray, nearestHit, sceneElements, lightSources, maxDistance, outColor, recursionDepth);
+    }
+
+    // Если пересечения не было
+    // Следующую часть кода можно считать аналогом шейдера ray-miss
+    else if(outColor != nullptr)
+    {
+        // Отдать цвет для промаха (цвет неба)
+        *outColor = {0.2f, 0.7f, 0.8f};
+    }
+
+    return hit;
+}
 
-        // Точка пересечения
-        math::Vec3<float> intersectionPoint = ray.getOrigin() + (ray.getDirection() * nearestHit.distance);
+/**
+ * \brief Метод вычисления цвета точки ближайшего пересечения (аналог шейдера ray-hit)
+ * \param ray Луч
+ * \param nearestHit Атрибуты точки ближайшего пересечения
+ * \param sceneElements Элементы сцены
+ * \param lightSources Источники освещения
+ * \param maxDistance Максимальное расстояние (для отраженных и преломленных лучей)
+ * \param outColor Результирующий цвет для точки пересечения
+ * \param recursionDepth Глубина рекурсии луча
+ * \param lightVisibility Видимость источников из точки (если уже известна - теневые лучи не трассируются)
+ */
+void ShadeHit(const math::Ray &ray, NearestHit nearestHit, const std::vector<std::shared_ptr<SceneElement>> &sceneElements,
+              const std::vector<LightSource> &lightSources, float maxDistance,
+              math::Vec3<float> *outColor, uint32_t recursionDepth, const bool* lightVisibility)
+{
+    // Объект с которым было ближайшее пересечения
+    const auto& sceneElement = sceneElements[nearestHit.instanceIndex];
 
-        // Компоненты итогового цвета (основные - диффузный и бликовый, второстепенные - отражение и преломление)
-        math::Vec3<float> primary = {0.0f,0.0f,0.0f};
-        math::Vec3<float> secondary = {0.0f,0.0f,0.0f};
+    // Точка пересечения
+    math::Vec3<float> intersectionPoint = ray.getOrigin() + (ray.getDirection() * nearestHit.distance);
 
-        // Если нужно считать основные компонентв освещенности
-        if(sceneElement->getMaterial().primaryToSecondary > 0.0f)
+    // Компоненты итогового цвета (основные - диффузный и бликовый, второстепенные - отражение и преломление)
+    math::Vec3<float> primary = {0.0f,0.0f,0.0f};
+    math::Vec3<float> secondary = {0.0f,0.0f,0.0f};
+
+    // Если нужно считать основные компонентв освещенности
+    if(sceneElement->getMaterial().primaryToSecondary > 0.0f)
+    {
+        // Дифузная и бликовая компоненты
+        math::Vec3<float> diffuse = {0.0f,0.0f,0.0f};
+        math::Vec3<float> specular = {0.0f,0.0f,0.0f};
+
+        // Проход по всем источникам света
+        for(size_t l = 0; l < lightSources.size(); l++)
         {
-            // Дифузная и бликовая компоненты
-            math::Vec3<float> diffuse = {0.0f,0.0f,0.0f};
-            math::Vec3<float> specular = {0.0f,0.0f,0.0f};
+            const auto& lightSource = lightSources[l];
 
-            // Проход по всем источникам света
-            for(const auto& lightSource : lightSources)
-            {
-                // Векторы от точки пересечения до источника (обычный и нормированный)
-                math::Vec3<float> toLight = lightSource.position - intersectionPoint;
-                math::Vec3<float> toLightDir = math::Normalize(toLight);
+            // Векторы от точки пересечения до источника (обычный и нормированный)
+            math::Vec3<float> toLight = lightSource.position - intersectionPoint;
+            math::Vec3<float> toLightDir = math::Normalize(toLight);
 
-                // Если луч запущенный в сторону источника пересекся с геометрией сцены - пропуск источника
+            // Если луч запущенный в сторону источника пересекся с геометрией сцены - пропуск источника
+            if(lightVisibility != nullptr){
+                if(!lightVisibility[l]) continue;
+            }
+            else{
                 math::Ray shadowRay(intersectionPoint, toLight);
                 if(TraceTay(shadowRay,sceneElements,{},0.01f,math::Length(toLight),nullptr,recursionDepth + 1)) continue;
-
-                // Подсчет диффузной и бликовой компоненты (модель Фонга)
-                diffuse = diffuse + (lightSource.color * std::max(0.0f, math::Dot(toLightDir,nearestHit.normal)));
-                specular = specular + (lightSource.color * std::pow(
-                        std::max(0.0f,math::Dot(math::Reflect(-toLightDir,nearestHit.normal),-ray.getDirection())),
-                        sceneElement->getMaterial().shininess));
             }
 
-            // Основная компонента (дифузный и бликовый свет)
-            primary = (diffuse * sceneElement->getMaterial().albedo) + (specular * sceneElement->getMaterial().specularIntensity);
+            // Подсчет диффузной и бликовой компоненты (модель Фонга)
+            diffuse = diffuse + (lightSource.color * std::max(0.0f, math::Dot(toLightDir,nearestHit.normal)));
+            specular = specular + (lightSource.color * std::pow(
+                    std::max(0.0f,math::Dot(math::Reflect(-toLightDir,nearestHit.normal),-ray.getDirection())),
+                    sceneElement->getMaterial().shininess));
+        }
+
+        // Основная компонента (дифузный и бликовый свет)
+        primary = (diffuse * sceneElement->getMaterial().albedo) + (specular * sceneElement->getMaterial().specularIntensity);
+    }
+
+    // Если нужно считать второстепенные компоненты (отражение и преломление)
+    if(sceneElement->getMaterial().primaryToSecondary < 1.0f)
+    {
+        // Компоненты отражения и преломления
+        math::Vec3<float> reflection = {0.0f,0.0f,0.0f};
+        math::Vec3<float> refraction = {0.0f,0.0f,0.0f};
+
+        // Если нужно считать отражение
+        if(sceneElement->getMaterial().reflectToRefract > 0.0f)
+        {
+            math::Ray reflectedRay(intersectionPoint,math::Reflect(ray.getDirection(),nearestHit.normal));
+            TraceTay(reflectedRay,sceneElements,lightSources,0.001f,maxDistance,&reflection,recursionDepth + 1);
         }
 
-        // Если нужно считать второстепенные компоненты (отражение и преломление)
-        if(sceneElement->getMaterial().primaryToSecondary < 1.0f)
+        // Если нужно считать преломление
+        if(sceneElement->getMaterial().reflectToRefract < 1.0f)
         {
-            // Компоненты отражения и преломления
-            math::Vec3<float> reflection = {0.0f,0.0f,0.0f};
-            math::Vec3<float> refraction = {0.0f,0.0f,0.0f};
+            // Коэффициент преломления
+            float eta = sceneElement->getMaterial().refractionEta;
 
-            // Если нужно считать отражение
-            if(sceneElement->getMaterial().reflectToRefract > 0.0f)
-            {
-                math::Ray reflectedRay(intersectionPoint,math::Reflect(ray.getDirection(),nearestHit.normal));
-                TraceTay(reflectedRay,sceneElements,lightSources,0.001f,maxDistance,&reflection,recursionDepth + 1);
+            // Если луч выходит из вещества - инвертировать нормаль и коэффициент преломления
+            if(math::Dot(nearestHit.normal,-ray.getDirection()) < 0.0f){
+                nearestHit.normal = -nearestHit.normal;
+                eta = 1.0f / eta;
             }
 
-            // Если нужно считать преломление
-            if(sceneElement->getMaterial().reflectToRefract < 1.0f)
-            {
-                // Коэффициент преломления
-                float eta = sceneElement->getMaterial().refractionEta;
+            math::Ray refractedRay(intersectionPoint,math::Refract(ray.getDirection(),nearestHit.normal,eta));
+            TraceTay(refractedRay,sceneElements,lightSources,0.001f,maxDistance,&refraction,recursionDepth + 1);
+        }
 
-                // Если луч выходит из вещества - инвертировать нормаль и коэффициент преломления
-                if(math::Dot(nearestHit.normal,-ray.getDirection()) < 0.0f){
-                    nearestHit.normal = -nearestHit.normal;
-                    eta = 1.0f / eta;
-                }
+        // Второстепенная компонента освещения
+        secondary = math::Mix(reflection,refraction,std::max(1.0f - sceneElement->getMaterial().reflectToRefract, 0.0f));
+    }
 
-                math::Ray refractedRay(intersectionPoint,math::Refract(ray.getDirection(),nearestHit.normal,eta));
-                TraceTay(refractedRay,sceneElements,lightSources,0.001f,maxDistance,&refraction,recursionDepth + 1);
-            }
+    // Итоговый цвет
+    *outColor = math::Mix(primary,secondary,std::max(1.0f - sceneElement->getMaterial().primaryToSecondary, 0.0f));
+}
+
+/**
+ * \brief Метод трассировки сцены пакетом лучей
+ * \param rays Лучи пакета (для активных дорожек)
+ * \param packet Пакет лучей
+ * \param sceneElements Элементы сцены
+ * \param lightSources Источники освещения
+ * \param outColors Результирующие цвета (для активных дорожек)
+ * \param lightVisibility Буфер для видимости источников (RAY_PACKET_SIZE * кол-во источников значений)
+ *
+ * \details Ближайшие пересечения ищутся для всех лучей пакета разом, дальше (освещение, тени, отражения и
+ * преломления) каждый луч обрабатывается отдельно - вторичные лучи уже не когерентны
+ */
+void TracePacket(const math::Ray rays[RAY_PACKET_SIZE], const RayPacket &packet,
+                 const std::vector<std::shared_ptr<SceneElement>> &sceneElements,
+                 const std::vector<LightSource> &lightSources, math::Vec3<float> outColors[RAY_PACKET_SIZE],
+                 bool* lightVisibility)
+{
+    // Маска лучей с пересечением и атрибуты точек ближайшего пересечения для каждого луча пакета
+    uint32_t hitMask = 0;
+    NearestHit nearestHits[RAY_PACKET_SIZE];
+    for(auto& nearestHit : nearestHits) nearestHit.distance = std::numeric_limits<float>::max();
+
+    // Пройтись по объектам сцены (один вызов на весь пакет)
+    for(uint32_t i = 0; i < sceneElements.size(); i++)
+    {
+        float t[RAY_PACKET_SIZE];
+        uint32_t elementMask = sceneElements[i]->intersectsPacket(packet, t);
+        hitMask |= elementMask;
 
-            // Второстепенная компонента освещения
-            secondary = math::Mix(reflection,refraction,std::max(1.0f - sceneElement->getMaterial().reflectToRefract, 0.0f));
+        // Перезаписать атрибуты ближайшего пересечения для лучей, пересекших объект
+        for(uint32_t lane = 0; elementMask != 0; lane++, elementMask >>= 1u)
+        {
+            if((elementMask & 1u) && t[lane] < nearestHits[lane].distance){
+                nearestHits[lane].distance = t[lane];
+                nearestHits[lane].instanceIndex = i;
+            }
         }
+    }
 
-        // Итоговый цвет
-        *outColor = math::Mix(primary,secondary,std::max(1.0f - sceneElement->getMaterial().primaryToSecondary, 0.0f));
+    // Лучи, для точек пересечения которых нужно освещение источниками (для остальных теневые лучи не нужны)
+    uint32_t litMask = 0;
+    for(uint32_t lane = 0; lane < RAY_PACKET_SIZE; lane++){
+        if((hitMask & (1u << lane)) && sceneElements[nearestHits[lane].instanceIndex]->getMaterial().primaryToSecondary > 0.0f){
+            litMask |= 1u << lane;
+        }
     }
 
-    // Если пересечения не было
-    // Следующую часть кода можно считать аналогом шейдера ray-miss
-    else if(outColor != nullptr)
+    // Видимость источников из точек пересечения (теневые лучи к одному источнику из соседних точек - тоже пакет)
+    for(size_t l = 0; l < lightSources.size() && litMask != 0; l++)
     {
-        // Отдать цвет для промаха (цвет неба)
-        *outColor = {0.2f, 0.7f, 0.8f};
+        RayPacket shadowPacket;
+        for(uint32_t lane = 0; lane < RAY_PACKET_SIZE; lane++)
+        {
+            if(!(litMask & (1u << lane))) continue;
+            math::Vec3<float> intersectionPoint = rays[lane].getOrigin() + (rays[lane].getDirection() * nearestHits[lane].distance);
+            math::Vec3<float> toLight = lightSources[l].position - intersectionPoint;
+            shadowPacket.setRay(lane, math::Ray(intersectionPoint, toLight), 0.01f, math::Length(toLight));
+        }
+
+        // Достаточно любого пересечения (аналог шейдера any-hit), перекрытые лучи дальше не проверяются
+        uint32_t occludedMask = 0;
+        for(uint32_t i = 0; i < sceneElements.size() && occludedMask != litMask; i++){
+            float t[RAY_PACKET_SIZE];
+            occludedMask |= sceneElements[i]->intersectsPacket(shadowPacket, t);
+        }
+
+        for(uint32_t lane = 0; lane < RAY_PACKET_SIZE; lane++){
+            lightVisibility[lane * lightSources.size() + l] = !(occludedMask & (1u << lane));
+        }
     }
 
-    return hit;
+    // Цвет для каждого луча пакета
+    for(uint32_t lane = 0; lane < RAY_PACKET_SIZE; lane++)
+    {
+        if(!(packet.getActiveMask() & (1u << lane))) continue;
+
+        if(hitMask & (1u << lane))
+        {
+            // Нормаль вычисляется только для ближайшего пересечения
+            const math::Ray& ray = rays[lane];
+            NearestHit& nearestHit = nearestHits[lane];
+            nearestHit.normal = sceneElements[nearestHit.instanceIndex]->normalAt(ray.getOrigin() + (ray.getDirection() * nearestHit.distance));
+            ShadeHit(ray, nearestHit, sceneElements, lightSources, 1000.0f, &outColors[lane], 0, lightVisibility + lane * lightSources.size());
+        }
+        else
+        {
+            // Цвет для промаха (цвет неба)
+            outColors[lane] = {0.2f, 0.7f, 0.8f};
+        }
+    }
 }
@@ -45,9 +45,30 @@ public:
         float t = 0;
         if(ray.intersectsSphere(position_,radius_,tMin,tMax,&t)){
             if(tOut != nullptr) *tOut = t;
-            if(normalOut != nullptr) *normalOut = math::Normalize((ray.getOrigin() + (ray.getDirection() * t)) - position_);
+            if(normalOut != nullptr) *normalOut = this->normalAt(ray.getOrigin() + (ray.getDirection() * t));
             return true;
         }
         return false;
     }
+
+    /**
+     * \brief Пересечение объекта сцены и пакета лучей
+     * \param packet Пакет лучей
+     * \param tOut Расстояния до точек пересечения
+     * \return Маска лучей пакета, пересекших объект (бит на луч)
+     */
+    uint32_t intersectsPacket(const RayPacket& packet, float tOut[RAY_PACKET_SIZE]) const override
+    {
+        return packet.intersectsSphere(position_,radius_,tOut);
+    }
+
+    /**
+     * \brief Нормаль поверхности в точке
+     * \param point Точка на поверхности
+     * \return Нормаль
+     */
+    math::Vec3<float> normalAt(const math::Vec3<float>& point) const override
+    {
+        return math::Normalize(point - position_);
+    }
 };
\ No newline at end of file
@@ -1,11 +1,16 @@
 #include <iostream>
-#include <windows.h>
 #include <memory>
 #include <limits>
 #include <random>
 #include <chrono>
 
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
 #include <ImageBuffer.hpp>
+#include <ImageFile.hpp>
+#include <CommandLine.hpp>
 
 #include "Types.h"
 #include "Sphere.hpp"
@@ -22,8 +27,10 @@ enum ErrorCode
     eNoErrors,
     eClassRegistrationError,
     eWindowCreationError,
+    eRuntimeError,
 };
 
+#ifdef _WIN32
 /// Дескриптор исполняемого модуля программы
 HINSTANCE g_hInstance = nullptr;
 /// Дескриптор осноного окна отрисовки
@@ -34,11 +41,13 @@ HDC g_hdc = nullptr;
 const char* g_strClassName = "MainWindowClass";
 /// Заголовок окна
 const char* g_strWindowCaption = "02 - Soft shadows";
+#endif
 /// Код последней ошибки
 ErrorCode g_lastError = ErrorCode::eNoErrors;
 /// Генератор случайных чисел
 std::default_random_engine* g_rndEngine = nullptr;
 
+#ifdef _WIN32
 /** W I N A P I  S T U F F **/
 
 /**
@@ -59,6 +68,7 @@ LRESULT CALLBACK WindowProcedure(HWND hWnd, UINT message, WPARAM wParam, LPARAM
  * \param hWnd Дескриптор окна
  */
 void PresentFrame(void *pixels, int width, int height, HWND hWnd);
+#endif
 
 /** R A Y T R A C I N G  **/
 
@@ -81,15 +91,17 @@ struct NearestHit
  * \param fov Угол обзора
  * \param sceneElements Элементы сцены
  * \param lightSources Источники освещения
+ * \param packets Трассировать теневые лучи пакетами (лучи из одной точки к одному источнику вместе)
  *
  * \details В данном методе происходит генерация лучей для каждого пикселя кадрового буфера и последующая
  * трассировка лучами сцены, а также запись полученных значений в пиксели кадрового буфера
  */
 void Render(
-        ImageBuffer<RGBQUAD> *imageBuffer,
+        ImageBuffer<Pixel> *imageBuffer,
         const float& fov,
         const std::vector<std::shared_ptr<SceneElement>> &sceneElements,
-        const std::vector<LightSource>& lightSources);
+        const std::vector<LightSource>& lightSources,
+        bool packets = true);
 
 /**
  * \brief Метод трассировки сцены лучом
@@ -100,6 +112,7 @@ void Render(
  * \param maxDistance Максимальное расстояние
  * \param outColor Результирующий цвет для точки пересечения
  * \param recursionDepth Глубина рекурсии (значение должно увеличиваться на единицу при каждом рекурсивном вызове)
+ * \param packets Трассировать теневые лучи пакетами
  * \return Было ли пересечение с каким-либо объектом сцены
  */
 bool TraceTay(
@@ -109,7 +122,37 @@ bool TraceTay(
         float minDistance,
         float maxDistance,
         math::Vec3<float>* outColor,
-        uint32_t recursionDepth = 0);
+        uint32_t recursionDepth = 0,
+        bool packets = true);
+
+/**
+ * \brief Проверка перекрытия луча геометрией сцены (для теневых лучей)
+ * \param ray Луч
+ * \param sceneElements Элементы сцены
+ * \param minDistance Минимальное расстояние
+ * \param maxDistance Максимальное расстояние
+ * \return Было ли пересечение с каким-либо объектом сцены
+ *
+ * \details В отличии от TraceTay не ищет ближайшее пересечение - поиск завершается на первом найденном
+ */
+bool Occluded(
+        const math::Ray& ray,
+        const std::vector<std::shared_ptr<SceneElement>> &sceneElements,
+        float minDistance,
+        float maxDistance);
+
+/**
+ * \brief Проверка перекрытия лучей пакета геометрией сцены (для теневых лучей)
+ * \param packet Пакет лучей (расстояния задаются для каждого луча при заполнении пакета)
+ * \param sceneElements Элементы сцены
+ * \return Маска перекрытых лучей (бит на луч)
+ *
+ * \details Лучи, для которых уже найдено перекрытие, дальше не проверяются - поиск завершается, когда
+ * перекрыты все активные лучи пакета
+ */
+uint32_t OccludedPacket(
+        const RayPacket& packet,
+        const std::vector<std::shared_ptr<SceneElement>> &sceneElements);
 
 /**
  * \brief Получить случайный вектор в направлении сферы источника сфера (в пределах конуса)
@@ -131,61 +174,83 @@ math::Vec3<float> RandomVectorToLightSphere(
  */
 int main(int argc, char* argv[])
 {
-    (void)argc;
-    (void)argv;
-
     try {
-        // Получение дескриптора исполняемого модуля программы
-        g_hInstance = GetModuleHandle(nullptr);
-
-        // Информация о классе
-        WNDCLASSEX classInfo;
-        classInfo.cbSize = sizeof(WNDCLASSEX);
-        classInfo.style = CS_HREDRAW | CS_VREDRAW | CS_OWNDC;
-        classInfo.cbClsExtra = 0;
-        classInfo.cbWndExtra = 0;
-        classInfo.hInstance = g_hInstance;
-        classInfo.hIcon = LoadIcon(g_hInstance, IDI_APPLICATION);
-        classInfo.hIconSm = LoadIcon(g_hInstance, IDI_APPLICATION);
-        classInfo.hCursor = LoadCursor(nullptr, IDC_ARROW);
-        classInfo.hbrBackground = CreateSolidBrush(RGB(240, 240, 240));
-        classInfo.lpszMenuName = nullptr;
-        classInfo.lpszClassName = g_strClassName;
-        classInfo.lpfnWndProc = WindowProcedure;
-
-        // Пытаемся зарегистрировать оконный класс
-        if (!RegisterClassEx(&classInfo)) {
-            g_lastError = ErrorCode::eClassRegistrationError;
-            throw std::runtime_error("ERROR: Can't register window class.");
-        }
+        // Аргументы командной строки
+        CommandLine commandLine(argc, argv);
+
+        // Файл для сохранения кадра
+        const std::string outputPath = commandLine.getString("output", "02_SoftShadows.png");
+        // Размеры кадра (в оконном режиме - размеры окна)
+        unsigned width = commandLine.getUnsigned("width", 800);
+        unsigned height = commandLine.getUnsigned("height", 600);
+
+#ifdef _WIN32
+        // Без явно заданного файла кадр показывается в окне
+        const bool headless = commandLine.has("output");
+#else
+        // Оконного режима нет - кадр всегда сохраняется в файл
+        const bool headless = true;
+#endif
+
+#ifdef _WIN32
+        if(!headless)
+        {
+            // Получение дескриптора исполняемого модуля программы
+            g_hInstance = GetModuleHandle(nullptr);
+
+            // Информация о классе
+            WNDCLASSEX classInfo;
+            classInfo.cbSize = sizeof(WNDCLASSEX);
+            classInfo.style = CS_HREDRAW | CS_VREDRAW | CS_OWNDC;
+            classInfo.cbClsExtra = 0;
+            classInfo.cbWndExtra = 0;
+            classInfo.hInstance = g_hInstance;
+            classInfo.hIcon = LoadIcon(g_hInstance, IDI_APPLICATION);
+            classInfo.hIconSm = LoadIcon(g_hInstance, IDI_APPLICATION);
+            classInfo.hCursor = LoadCursor(nullptr, IDC_ARROW);
+            classInfo.hbrBackground = CreateSolidBrush(RGB(240, 240, 240));
+            classInfo.lpszMenuName = nullptr;
+            classInfo.lpszClassName = g_strClassName;
+            classInfo.lpfnWndProc = WindowProcedure;
+
+            // Пытаемся зарегистрировать оконный класс
+            if (!RegisterClassEx(&classInfo)) {
+                g_lastError = ErrorCode::eClassRegistrationError;
+                throw std::runtime_error("ERROR: Can't register window class.");
+            }
 
-        // Создание окна
-        g_hwnd = CreateWindow(
-                g_strClassName,
-                g_strWindowCaption,
-                WS_OVERLAPPEDWINDOW,
-                0, 0,
-                800, 600,
-                nullptr,
-                nullptr,
-                g_hInstance,
-                nullptr);
-
-        // Если не удалось создать окно
-        if (!g_hwnd) {
-            g_lastError = ErrorCode::eWindowCreationError;
-            throw std::runtime_error("ERROR: Can't create main application window.");
-        }
+            // Создание окна
+            g_hwnd = CreateWindow(
+                    g_strClassName,
+                    g_strWindowCaption,
+                    WS_OVERLAPPEDWINDOW,
+                    0, 0,
+                    static_cast<int>(width), static_cast<int>(height),
+                    nullptr,
+                    nullptr,
+                    g_hInstance,
+                    nullptr);
+
+            // Если не удалось создать окно
+            if (!g_hwnd) {
+                g_lastError = ErrorCode::eWindowCreationError;
+                throw std::runtime_error("ERROR: Can't create main application window.");
+            }
 
-        // Показать окно
-        ShowWindow(g_hwnd, SW_SHOWNORMAL);
+            // Показать окно
+            ShowWindow(g_hwnd, SW_SHOWNORMAL);
 
-        // Получение контекста отрисовки
-        g_hdc = GetDC(g_hwnd);
+            // Получение контекста отрисовки
+            g_hdc = GetDC(g_hwnd);
 
-        // Размеры клиентской области окна
-        RECT clientRect;
-        GetClientRect(g_hwnd, &clientRect);
+            // Размеры клиентской области окна
+            RECT clientRect;
+            GetClientRect(g_hwnd, &clientRect);
+            // Кадр занимает всю клиентскую область
+            width = static_cast<unsigned>(clientRect.right);
+            height = static_cast<unsigned>(clientRect.bottom);
+        }
+#endif
 
         // Генератор случайных чисел
         std::chrono::milliseconds ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch());
@@ -194,7 +259,7 @@ int main(int argc, char* argv[])
         /** RAYTRACING **/
 
         // Создать буффер кадра
-        auto frameBuffer = ImageBuffer<RGBQUAD>(clientRect.right, clientRect.bottom, {0, 0, 0, 0});
+        auto frameBuffer = ImageBuffer<Pixel>(width, height, {0, 0, 0, 0});
         std::cout << "INFO: Frame-buffer initialized  (resolution : " << frameBuffer.getWidth() << "x" << frameBuffer.getHeight() << ", size : " << frameBuffer.getSize() << " bytes)" << std::endl;
 
         // Материалы
@@ -218,41 +283,57 @@ int main(int argc, char* argv[])
         lightSources.push_back({math::Vec3<float>(0.0f,6.5f,-10.0f),math::Vec3<float>(0.9f,0.9f,0.9f),3.0f});
 
         // Трассировка сцены лучами, запись результата в буфер изображения
-        Render(&frameBuffer,90.0f, scene, lightSources);
+        auto renderBeginTime = std::chrono::system_clock::now();
+        Render(&frameBuffer,90.0f, scene, lightSources, !commandLine.has("no-packets"));
+        std::cout << "INFO: Scene rendered in " << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - renderBeginTime).count() << " ms." << std::endl;
 
-        // Показ кадра
-        PresentFrame(frameBuffer.getData(), static_cast<int>(frameBuffer.getWidth()), static_cast<int>(frameBuffer.getHeight()), g_hwnd);
+        // Сохранение кадра в файл
+        if(headless)
+        {
+            imagefile::SaveImage(outputPath, frameBuffer);
+            std::cout << "INFO: Frame saved to \"" << outputPath << "\"" << std::endl;
+        }
+#ifdef _WIN32
+        else
+        {
+            // Показ кадра
+            PresentFrame(frameBuffer.getData(), static_cast<int>(frameBuffer.getWidth()), static_cast<int>(frameBuffer.getHeight()), g_hwnd);
 
-        /** MAIN LOOP **/
+            /** MAIN LOOP **/
 
-        // Оконное сообщение
-        MSG msg = {};
+            // Оконное сообщение
+            MSG msg = {};
 
-        // Запуск цикла
-        while (true)
-        {
-            // Обработка оконных сообщений
-            if (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+            // Запуск цикла
+            while (true)
             {
-                DispatchMessage(&msg);
+                // Обработка оконных сообщений
+                if (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+                {
+                    DispatchMessage(&msg);
 
-                if (msg.message == WM_QUIT) {
-                    break;
+                    if (msg.message == WM_QUIT) {
+                        break;
+                    }
                 }
             }
         }
+#endif
     }
     catch(std::exception& ex)
     {
         std::cout << ex.what() << std::endl;
+        if(g_lastError == ErrorCode::eNoErrors) g_lastError = ErrorCode::eRuntimeError;
     }
 
     // Уничтожение генератора случайных чисел
     delete g_rndEngine;
+#ifdef _WIN32
     // Уничтожение окна
-    DestroyWindow(g_hwnd);
+    if(g_hwnd) DestroyWindow(g_hwnd);
     // Вырегистрировать класс окна
-    UnregisterClass(g_strClassName, g_hInstance);
+    if(g_hInstance) UnregisterClass(g_strClassName, g_hInstance);
+#endif
 
     // Код выполнения/ошибки
     return static_cast<int>(g_lastError);
@@ -260,6 +341,7 @@ int main(int argc, char* argv[])
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+#ifdef _WIN32
 /** W I N A P I  S T U F F **/
 
 /**
@@ -325,6 +407,7 @@ void PresentFrame(void *pixels, int width, int height, HWND hWnd)
     // Уничтожить DC
     ReleaseDC(hWnd,hdc);
 }
+#endif
 
 /** R A Y T R A C I N G  M E T H O D S **/
 
@@ -334,13 +417,15 @@ void PresentFrame(void *pixels, int width, int height, HWND hWnd)
  * \param fov Угол обзора
  * \param sceneElements Элементы сцены
  * \param lightSources Источники освещения
+ * \param packets Трассировать теневые лучи пакетами (лучи из одной точки к одному источнику вместе)
  *
  * \details В данном методе происходит генерация лучей для каждого пикселя кадрового буфера и последующая
  * трассировка лучами сцены, а также запись полученных значений в пиксели кадрового буфера
  */
-void Render(ImageBuffer<RGBQUAD> *imageBuffer, const float &fov,
+void Render(ImageBuffer<Pixel> *imageBuffer, const float &fov,
             const std::vector<std::shared_ptr<SceneElement>> &sceneElements,
-            const std::vector<LightSource> &lightSources)
+            const std::vector<LightSource> &lightSources,
+            bool packets)
 {
     // Размеры кадрового буфера
     auto w = static_cast<float>(imageBuffer->getWidth());
@@ -362,13 +447,13 @@ void Render(ImageBuffer<RGBQUAD> *imageBuffer, const float &fov,
 
             // Трассировка сцены и получение цвета
             math::Vec3<float> resultColor = {0.0f,0.0f,0.0f};
-            TraceTay(ray, sceneElements, lightSources,0.0f,1000.0f, &resultColor);
+            TraceTay(ray, sceneElements, lightSources,0.0f,1000.0f, &resultColor, 0, packets);
 
             // Установка цвета
             imageBuffer->setPoint(i,j,{
-                    static_cast<BYTE>(math::Clamp(resultColor.b,0.0f,1.0f) * 255.0f),
-                    static_cast<BYTE>(math::Clamp(resultColor.g,0.0f,1.0f) * 255.0f),
-                    static_cast<BYTE>(math::Clamp(resultColor.r,0.0f,1.0f) * 255.0f),
+                    static_cast<uint8_t>(math::Clamp(resultColor.b,0.0f,1.0f) * 255.0f),
+                    static_cast<uint8_t>(math::Clamp(resultColor.g,0.0f,1.0f) * 255.0f),
+                    static_cast<uint8_t>(math::Clamp(resultColor.r,0.0f,1.0f) * 255.0f),
                     255
             });
         }
@@ -384,11 +469,12 @@ void Render(ImageBuffer<RGBQUAD> *imageBuffer, const float &fov,
  * \param maxDistance Максимальное расстояние
  * \param outColor Результирующий цвет для точки пересечения
  * \param recursionDepth Глубина рекурсии (значение должно увеличиваться на единицу при каждом рекурсивном вызове)
+ * \param packets Трассировать теневые лучи пакетами
  * \return Было ли пересечение с каким-либо объектом сцены
  */
 bool TraceTay(const math::Ray &ray, const std::vector<std::shared_ptr<SceneElement>> &sceneElements,
               const std::vector<LightSource> &lightSources, float minDistance, float maxDistance,
-              math::Vec3<float> *outColor, uint32_t recursionDepth)
+              math::Vec3<float> *outColor, uint32_t recursionDepth, bool packets)
 {
     // Было ли пересечение
     bool hit = false;
@@ -453,22 +539,43 @@ bool TraceTay(const math::Ray &ray, const std::vector<std::shared_ptr<SceneEleme
                 // Доля интенсивности которая приходится на один теневой луч (сэмпл)
                 float intensityPerSample = 1.0f / static_cast<float>(MAX_SHADOW_SAMPLES);
 
-                // Запустить лучи в сторону источника света
-                for(unsigned i = 0; i < MAX_SHADOW_SAMPLES; i++)
+                // Запустить лучи в сторону источника света (лучи из одной точки к одному источнику когерентны - пакетами)
+                if(packets)
                 {
-                    // Случайное направление в сторону сферического источника (в пределах конуса образованного диском сферы)
-                    math::Vec3<float> rndToLight = RandomVectorToLightSphere(intersectionPoint,lightSource);
-
-                    // Если луч пересекся с преградой - убавить интенсивность на соответствующую часть
-                    math::Ray shadowRay(intersectionPoint, rndToLight);
-                    if(TraceTay(shadowRay,sceneElements,{},0.01f,math::Length(toLight) - lightSource.radius, nullptr, recursionDepth + 1)){
-                        intensity -= intensityPerSample;
+                    for(unsigned i = 0; i < MAX_SHADOW_SAMPLES; i += RAY_PACKET_SIZE)
+                    {
+                        // Случайные направления в сторону сферического источника (в пределах конуса образованного диском сферы)
+                        RayPacket shadowPacket;
+                        for(unsigned lane = 0; lane < RAY_PACKET_SIZE && i + lane < MAX_SHADOW_SAMPLES; lane++)
+                        {
+                            math::Vec3<float> rndToLight = RandomVectorToLightSphere(intersectionPoint,lightSource);
+                            shadowPacket.setRay(lane, math::Ray(intersectionPoint, rndToLight), 0.01f, math::Length(toLight) - lightSource.radius);
+                        }
+
+                        // Убавить интенсивность на соответствующую часть за каждый перекрытый луч
+                        for(uint32_t occludedMask = OccludedPacket(shadowPacket,sceneElements); occludedMask != 0; occludedMask &= occludedMask - 1){
+                            intensity -= intensityPerSample;
+                        }
+                    }
+                }
+                else
+                {
+                    for(unsigned i = 0; i < MAX_SHADOW_SAMPLES; i++)
+                    {
+                        // Случайное направление в сторону сферического источника (в пределах конуса образованного диском сферы)
+                        math::Vec3<float> rndToLight = RandomVectorToLightSphere(intersectionPoint,lightSource);
+
+                        // Если луч пересекся с преградой - убавить интенсивность на соответствующую часть
+                        math::Ray shadowRay(intersectionPoint, rndToLight);
+                        if(Occluded(shadowRay,sceneElements,0.01f,math::Length(toLight) - lightSource.radius)){
+                            intensity -= intensityPerSample;
+                        }
                     }
                 }
 
                 // Если луч запущенный в сторону источника пересекся с геометрией сцены - пропуск источника
                 //math::Ray shadowRay(intersectionPoint, toLight);
-                //if(TraceTay(shadowRay,sceneElements,{},0.01f,math::Length(toLight),nullptr,recursionDepth + 1)) continue;
+                //if(Occluded(shadowRay,sceneElements,0.01f,math::Length(toLight))) continue;
 
                 // Подсчет диффузной и бликовой компоненты (модель Фонга)
                 diffuse = diffuse + (lightSource.color * std::max(0.0f, math::Dot(toLightDir,nearestHit.normal)) * intensity);
@@ -492,7 +599,7 @@ bool TraceTay(const math::Ray &ray, const std::vector<std::shared_ptr<SceneEleme
             if(sceneElement->getMaterial().reflectToRefract > 0.0f)
             {
                 math::Ray reflectedRay(intersectionPoint,math::Reflect(ray.getDirection(),nearestHit.normal));
-                TraceTay(reflectedRay,sceneElements,lightSources,0.001f,maxDistance,&reflection,recursionDepth + 1);
+                TraceTay(reflectedRay,sceneElements,lightSources,0.001f,maxDistance,&reflection,recursionDepth + 1,packets);
             }
 
             // Если нужно считать преломление
@@ -508,7 +615,7 @@ bool TraceTay(const math::Ray &ray, const std::vector<std::shared_ptr<SceneEleme
                 }
 
                 math::Ray refractedRay(intersectionPoint,math::Refract(ray.getDirection(),nearestHit.normal,eta));
-                TraceTay(refractedRay,sceneElements,lightSources,0.001f,maxDistance,&refraction,recursionDepth + 1);
+                TraceTay(refractedRay,sceneElements,lightSources,0.001f,maxDistance,&refraction,recursionDepth + 1,packets);
             }
 
             // Второстепенная компонента освещения
@@ -530,6 +637,56 @@ bool TraceTay(const math::Ray &ray, const std::vector<std::shared_ptr<SceneEleme
     return hit;
 }
 
+/**
+ * \brief Проверка перекрытия луча геометрией сцены (для теневых лучей)
+ * \param ray Луч
+ * \param sceneElements Элементы сцены
+ * \param minDistance Минимальное расстояние
+ * \param maxDistance Максимальное расстояние
+ * \return Было ли пересечение с каким-либо объектом сцены
+ *
+ * \details В отличии от TraceTay не ищет ближайшее пересечение - поиск завершается на первом найденном
+ */
+bool Occluded(
+        const math::Ray& ray,
+        const std::vector<std::shared_ptr<SceneElement>> &sceneElements,
+        float minDistance,
+        float maxDistance)
+{
+    // Аналог шейдера any-hit - достаточно любого пересечения
+    for(const auto& sceneElement : sceneElements)
+    {
+        if(sceneElement->occluded(ray, minDistance, maxDistance)) return true;
+    }
+
+    return false;
+}
+
+/**
+ * \brief Проверка перекрытия лучей пакета геометрией сцены (для теневых лучей)
+ * \param packet Пакет лучей (расстояния задаются для каждого луча при заполнении пакета)
+ * \param sceneElements Элементы сцены
+ * \return Маска перекрытых лучей (бит на луч)
+ *
+ * \details Лучи, для которых уже найдено перекрытие, дальше не проверяются - поиск завершается, когда
+ * перекрыты все активные лучи пакета
+ */
+uint32_t OccludedPacket(
+        const RayPacket& packet,
+        const std::vector<std::shared_ptr<SceneElement>> &sceneElements)
+{
+    // Аналог шейдера any-hit для всех лучей пакета
+    uint32_t occludedMask = 0;
+    for(const auto& sceneElement : sceneElements)
+    {
+        float t[RAY_PACKET_SIZE];
+        occludedMask |= sceneElement->intersectsPacket(packet, t);
+        if(occludedMask == packet.getActiveMask()) break;
+    }
+
+    return occludedMask;
+}
+
 /**
  * \brief Получить случайный вектор в направлении сферы источника сфера (в пределах конуса)
  * \param shadedPoint Положение затеняемой точки
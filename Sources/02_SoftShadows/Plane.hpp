@@ -50,4 +50,26 @@ public:
         }
         return false;
     }
+
+    /**
+     * \brief Пересечение объекта сцены и пакета лучей
+     * \param packet Пакет лучей
+     * \param tOut Расстояния до точек пересечения
+     * \return Маска лучей пакета, пересекших объект (бит на луч)
+     */
+    uint32_t intersectsPacket(const RayPacket& packet, float tOut[RAY_PACKET_SIZE]) const override
+    {
+        return packet.intersectsPlane(normal_,position_,tOut);
+    }
+
+    /**
+     * \brief Нормаль поверхности в точке
+     * \param point Точка на поверхности (у плоскости нормаль всюду одинакова)
+     * \return Нормаль
+     */
+    math::Vec3<float> normalAt(const math::Vec3<float>& point) const override
+    {
+        (void) point;
+        return normal_;
+    }
 };
\ No newline at end of file
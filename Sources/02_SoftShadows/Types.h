@@ -2,6 +2,15 @@
 
 #include <Math.hpp>
 #include <Ray.hpp>
+#include <RayPacket.hpp>
+
+/// Кол-во лучей в пакете (4, 8 или 16)
+#ifndef RAY_PACKET_SIZE
+#define RAY_PACKET_SIZE 8
+#endif
+
+/// Пакет лучей
+using RayPacket = math::RayPacket<RAY_PACKET_SIZE>;
 
 /**
  * \brief Материал объекта сцены (освещение по Фонгу)
@@ -96,4 +105,31 @@ public:
      * \return Было ли пересечение с объектом
      */
     virtual bool intersectsRay(const math::Ray& ray, float tMin, float tMax, float* tOut, math::Vec3<float>* normalOut) const = 0;
+
+    /**
+     * \brief Пересечение объекта сцены и пакета лучей (полностью виртуальный метод)
+     * \param packet Пакет лучей (расстояния задаются для каждого луча при заполнении пакета)
+     * \param tOut Расстояния до точек пересечения
+     * \return Маска лучей пакета, пересекших объект (бит на луч)
+     */
+    virtual uint32_t intersectsPacket(const RayPacket& packet, float tOut[RAY_PACKET_SIZE]) const = 0;
+
+    /**
+     * \brief Нормаль поверхности в точке (полностью виртуальный метод)
+     * \param point Точка на поверхности
+     * \return Нормаль
+     */
+    virtual math::Vec3<float> normalAt(const math::Vec3<float>& point) const = 0;
+
+    /**
+     * \brief Перекрывает ли объект луч на заданном отрезке (без вычисления расстояния и нормали)
+     * \param ray Луч
+     * \param tMin Минимальное расстояние
+     * \param tMax Максимальное расстояние
+     * \return Было ли пересечение с объектом
+     */
+    virtual bool occluded(const math::Ray& ray, float tMin, float tMax) const
+    {
+        return this->intersectsRay(ray, tMin, tMax, nullptr, nullptr);
+    }
 };
\ No newline at end of file
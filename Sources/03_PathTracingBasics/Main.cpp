@@ -1,9 +1,14 @@
 #include <iostream>
+
+#ifdef _WIN32
 #include <windows.h>
+#endif
 
 #include <Math.hpp>
 #include <Ray.hpp>
 #include <ImageBuffer.hpp>
+#include <ImageFile.hpp>
+#include <CommandLine.hpp>
 
 #include "Utils.h"
 #include "Materials.hpp"
@@ -24,8 +29,10 @@ enum ErrorCode
     eNoErrors,
     eClassRegistrationError,
     eWindowCreationError,
+    eRuntimeError,
 };
 
+#ifdef _WIN32
 /// Дескриптор исполняемого модуля программы
 HINSTANCE g_hInstance = nullptr;
 /// Дескриптор осноного окна отрисовки
@@ -36,9 +43,11 @@ HDC g_hdc = nullptr;
 const char* g_strClassName = "MainWindowClass";
 /// Заголовок окна
 const char* g_strWindowCaption = "03 - Path tracing basic example";
+#endif
 /// Код последней ошибки
 ErrorCode g_lastError = ErrorCode::eNoErrors;
 
+#ifdef _WIN32
 /** W I N A P I  S T U F F **/
 
 /**
@@ -59,6 +68,7 @@ LRESULT CALLBACK WindowProcedure(HWND hWnd, UINT message, WPARAM wParam, LPARAM
  * \param hWnd Дескриптор окна
  */
 void PresentFrame(void *pixels, int width, int height, HWND hWnd);
+#endif
 
 /** R A Y T R A C I N G  **/
 
@@ -70,17 +80,19 @@ void PresentFrame(void *pixels, int width, int height, HWND hWnd);
  * \param samplesPerPixel Кол-во семплов (лучей) на один пиксель кадрового буфера
  * \param camPosition Положение камеры
  * \param camOrientation Ориентация камеры
+ * \param recursive Использовать рекурсивную трассировку (TraceTay) вместо итеративной (TracePath)
  *
  * \details В данном методе происходит генерация лучей для каждого пикселя кадрового буфера и последующая
  * трассировка лучами сцены, а также запись полученных значений в пиксели кадрового буфера
  */
 void Render(
-        ImageBuffer<RGBQUAD> *imageBuffer,
+        ImageBuffer<Pixel> *imageBuffer,
         const Scene& scene,
         const float& fov,
         unsigned samplesPerPixel = 1,
         math::Vec3<float> camPosition = {0.0f,0.0f,0.0f},
-        math::Vec3<float> camOrientation = {0.0f,0.0f,0.0f});
+        math::Vec3<float> camOrientation = {0.0f,0.0f,0.0f},
+        bool recursive = false);
 
 /**
  * \brief Метод трассировки сцены лучом
@@ -96,6 +108,21 @@ bool TraceTay(
         math::Vec3<float>* outColor,
         unsigned recursionDepth = 0);
 
+/**
+ * \brief Итеративный метод трассировки сцены лучом (без рекурсии)
+ * \param ray Луч
+ * \param hittableElement Трассируемый элемент
+ * \param outColor Результирующий цвет для точки пересечения
+ * \return Было ли пересечение с каким-либо объектом сцены
+ *
+ * \details Результат совпадает с TraceTay при SAMPLES_PER_RAY равном 1, но путь проходится одним циклом - вместо
+ * возврата цвета с каждого уровня рекурсии накапливается затухание пути, глубина не ограничена размером стека
+ */
+bool TracePath(
+        const math::Ray& ray,
+        const HittableElement& hittableElement,
+        math::Vec3<float>* outColor);
+
 /** M A I N **/
 
 /**
@@ -106,66 +133,88 @@ bool TraceTay(
  */
 int main(int argc, char* argv[])
 {
-    (void)argc;
-    (void)argv;
-
     try {
-        // Получение дескриптора исполняемого модуля программы
-        g_hInstance = GetModuleHandle(nullptr);
-
-        // Информация о классе
-        WNDCLASSEX classInfo;
-        classInfo.cbSize = sizeof(WNDCLASSEX);
-        classInfo.style = CS_HREDRAW | CS_VREDRAW | CS_OWNDC;
-        classInfo.cbClsExtra = 0;
-        classInfo.cbWndExtra = 0;
-        classInfo.hInstance = g_hInstance;
-        classInfo.hIcon = LoadIcon(g_hInstance, IDI_APPLICATION);
-        classInfo.hIconSm = LoadIcon(g_hInstance, IDI_APPLICATION);
-        classInfo.hCursor = LoadCursor(nullptr, IDC_ARROW);
-        classInfo.hbrBackground = CreateSolidBrush(RGB(240, 240, 240));
-        classInfo.lpszMenuName = nullptr;
-        classInfo.lpszClassName = g_strClassName;
-        classInfo.lpfnWndProc = WindowProcedure;
-
-        // Пытаемся зарегистрировать оконный класс
-        if (!RegisterClassEx(&classInfo)) {
-            g_lastError = ErrorCode::eClassRegistrationError;
-            throw std::runtime_error("ERROR: Can't register window class.");
-        }
+        // Аргументы командной строки
+        CommandLine commandLine(argc, argv);
+
+        // Файл для сохранения кадра
+        const std::string outputPath = commandLine.getString("output", "03_PathTracingBasics.png");
+        // Размеры кадра (в оконном режиме - размеры окна)
+        unsigned width = commandLine.getUnsigned("width", 800);
+        unsigned height = commandLine.getUnsigned("height", 600);
+
+#ifdef _WIN32
+        // Без явно заданного файла кадр показывается в окне
+        const bool headless = commandLine.has("output");
+#else
+        // Оконного режима нет - кадр всегда сохраняется в файл
+        const bool headless = true;
+#endif
+
+#ifdef _WIN32
+        if(!headless)
+        {
+            // Получение дескриптора исполняемого модуля программы
+            g_hInstance = GetModuleHandle(nullptr);
+
+            // Информация о классе
+            WNDCLASSEX classInfo;
+            classInfo.cbSize = sizeof(WNDCLASSEX);
+            classInfo.style = CS_HREDRAW | CS_VREDRAW | CS_OWNDC;
+            classInfo.cbClsExtra = 0;
+            classInfo.cbWndExtra = 0;
+            classInfo.hInstance = g_hInstance;
+            classInfo.hIcon = LoadIcon(g_hInstance, IDI_APPLICATION);
+            classInfo.hIconSm = LoadIcon(g_hInstance, IDI_APPLICATION);
+            classInfo.hCursor = LoadCursor(nullptr, IDC_ARROW);
+            classInfo.hbrBackground = CreateSolidBrush(RGB(240, 240, 240));
+            classInfo.lpszMenuName = nullptr;
+            classInfo.lpszClassName = g_strClassName;
+            classInfo.lpfnWndProc = WindowProcedure;
+
+            // Пытаемся зарегистрировать оконный класс
+            if (!RegisterClassEx(&classInfo)) {
+                g_lastError = ErrorCode::eClassRegistrationError;
+                throw std::runtime_error("ERROR: Can't register window class.");
+            }
 
-        // Создание окна
-        g_hwnd = CreateWindow(
-                g_strClassName,
-                g_strWindowCaption,
-                WS_OVERLAPPEDWINDOW,
-                0, 0,
-                800, 600,
-                nullptr,
-                nullptr,
-                g_hInstance,
-                nullptr);
-
-        // Если не удалось создать окно
-        if (!g_hwnd) {
-            g_lastError = ErrorCode::eWindowCreationError;
-            throw std::runtime_error("ERROR: Can't create main application window.");
-        }
+            // Создание окна
+            g_hwnd = CreateWindow(
+                    g_strClassName,
+                    g_strWindowCaption,
+                    WS_OVERLAPPEDWINDOW,
+                    0, 0,
+                    static_cast<int>(width), static_cast<int>(height),
+                    nullptr,
+                    nullptr,
+                    g_hInstance,
+                    nullptr);
+
+            // Если не удалось создать окно
+            if (!g_hwnd) {
+                g_lastError = ErrorCode::eWindowCreationError;
+                throw std::runtime_error("ERROR: Can't create main application window.");
+            }
 
-        // Показать окно
-        ShowWindow(g_hwnd, SW_SHOWNORMAL);
+            // Показать окно
+            ShowWindow(g_hwnd, SW_SHOWNORMAL);
 
-        // Получение контекста отрисовки
-        g_hdc = GetDC(g_hwnd);
+            // Получение контекста отрисовки
+            g_hdc = GetDC(g_hwnd);
 
-        // Размеры клиентской области окна
-        RECT clientRect;
-        GetClientRect(g_hwnd, &clientRect);
+            // Размеры клиентской области окна
+            RECT clientRect;
+            GetClientRect(g_hwnd, &clientRect);
+            // Кадр занимает всю клиентскую область
+            width = static_cast<unsigned>(clientRect.right);
+            height = static_cast<unsigned>(clientRect.bottom);
+        }
+#endif
 
         /** RAYTRACING **/
 
         // Создать буффер кадра
-        auto frameBuffer = ImageBuffer<RGBQUAD>(clientRect.right, clientRect.bottom, {0, 0, 0, 0});
+        auto frameBuffer = ImageBuffer<Pixel>(width, height, {0, 0, 0, 0});
         std::cout << "INFO: Frame-buffer initialized  (resolution : " << frameBuffer.getWidth() << "x" << frameBuffer.getHeight() << ", size : " << frameBuffer.getSize() << " bytes)" << std::endl;
 
         // Материалы
@@ -186,40 +235,56 @@ int main(int argc, char* argv[])
 
         // Трассировка сцены лучами, запись результата в буфер изображения
         auto renderBeginTime = std::chrono::system_clock::now();
-        Render(&frameBuffer, scene, 50.0f, MULTISAMPLING_LEVEL,{-2.0f,1.5f,1.0f},{-30.0f,-42.0f,0.0f});
+        // Итеративная трассировка не ветвится, поэтому при нескольких разбрасываемых лучах используется рекурсивная
+        const bool recursive = commandLine.has("recursive") || SAMPLES_PER_RAY > 1;
+        Render(&frameBuffer, scene, 50.0f, MULTISAMPLING_LEVEL,{-2.0f,1.5f,1.0f},{-30.0f,-42.0f,0.0f},recursive);
         std::cout << "INFO: Scene rendered in " << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - renderBeginTime).count() << " ms." << std::endl;
 
-        // Показ кадра
-        PresentFrame(frameBuffer.getData(), static_cast<int>(frameBuffer.getWidth()), static_cast<int>(frameBuffer.getHeight()), g_hwnd);
+        // Сохранение кадра в файл
+        if(headless)
+        {
+            imagefile::SaveImage(outputPath, frameBuffer);
+            std::cout << "INFO: Frame saved to \"" << outputPath << "\"" << std::endl;
+        }
+#ifdef _WIN32
+        else
+        {
+            // Показ кадра
+            PresentFrame(frameBuffer.getData(), static_cast<int>(frameBuffer.getWidth()), static_cast<int>(frameBuffer.getHeight()), g_hwnd);
 
-        /** MAIN LOOP **/
+            /** MAIN LOOP **/
 
-        // Оконное сообщение
-        MSG msg = {};
+            // Оконное сообщение
+            MSG msg = {};
 
-        // Запуск цикла
-        while (true)
-        {
-            // Обработка оконных сообщений
-            if (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+            // Запуск цикла
+            while (true)
             {
-                DispatchMessage(&msg);
+                // Обработка оконных сообщений
+                if (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+                {
+                    DispatchMessage(&msg);
 
-                if (msg.message == WM_QUIT) {
-                    break;
+                    if (msg.message == WM_QUIT) {
+                        break;
+                    }
                 }
             }
         }
+#endif
     }
     catch(std::exception& ex)
     {
         std::cout << ex.what() << std::endl;
+        if(g_lastError == ErrorCode::eNoErrors) g_lastError = ErrorCode::eRuntimeError;
     }
 
+#ifdef _WIN32
     // Уничтожение окна
-    DestroyWindow(g_hwnd);
+    if(g_hwnd) DestroyWindow(g_hwnd);
     // Вырегистрировать класс окна
-    UnregisterClass(g_strClassName, g_hInstance);
+    if(g_hInstance) UnregisterClass(g_strClassName, g_hInstance);
+#endif
 
     // Код выполнения/ошибки
     return static_cast<int>(g_lastError);
@@ -227,6 +292,7 @@ int main(int argc, char* argv[])
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+#ifdef _WIN32
 /** W I N A P I  S T U F F **/
 
 /**
@@ -292,6 +358,7 @@ void PresentFrame(void *pixels, int width, int height, HWND hWnd)
     // Уничтожить DC
     ReleaseDC(hWnd,hdc);
 }
+#endif
 
 /** R A Y T R A C I N G  M E T H O D S **/
 
@@ -303,11 +370,12 @@ void PresentFrame(void *pixels, int width, int height, HWND hWnd)
  * \param samplesPerPixel Кол-во семплов (лучей) на один пиксель кадрового буфера
  * \param camPosition Положение камеры
  * \param camOrientation Ориентация камеры
+ * \param recursive Использовать рекурсивную трассировку (TraceTay) вместо итеративной (TracePath)
  *
  * \details В данном методе происходит генерация лучей для каждого пикселя кадрового буфера и последующая
  * трассировка лучами сцены, а также запись полученных значений в пиксели кадрового буфера
  */
-void Render(ImageBuffer<RGBQUAD> *imageBuffer, const Scene& scene, const float &fov, unsigned samplesPerPixel, math::Vec3<float> camPosition, math::Vec3<float> camOrientation)
+void Render(ImageBuffer<Pixel> *imageBuffer, const Scene& scene, const float &fov, unsigned samplesPerPixel, math::Vec3<float> camPosition, math::Vec3<float> camOrientation, bool recursive)
 {
     // Размеры кадрового буфера
     auto w = static_cast<float>(imageBuffer->getWidth());
@@ -342,7 +410,8 @@ void Render(ImageBuffer<RGBQUAD> *imageBuffer, const Scene& scene, const float &
 
                 // Трассировка сцены и получение цвета
                 math::Vec3<float> sampleColor = {0.0f,0.0f,0.0f};
-                TraceTay(ray, scene, &sampleColor);
+                if(recursive) TraceTay(ray, scene, &sampleColor);
+                else TracePath(ray, scene, &sampleColor);
 
                 // Прибавить к итоговому цвету цвет семпла
                 pixelColor = pixelColor + sampleColor;
@@ -360,9 +429,9 @@ void Render(ImageBuffer<RGBQUAD> *imageBuffer, const Scene& scene, const float &
 
             // Установка цвета
             imageBuffer->setPoint(i,j,{
-                    static_cast<BYTE>(math::Clamp(pixelColor.b, 0.0f, 1.0f) * 255.0f),
-                    static_cast<BYTE>(math::Clamp(pixelColor.g, 0.0f, 1.0f) * 255.0f),
-                    static_cast<BYTE>(math::Clamp(pixelColor.r, 0.0f, 1.0f) * 255.0f),
+                    static_cast<uint8_t>(math::Clamp(pixelColor.b, 0.0f, 1.0f) * 255.0f),
+                    static_cast<uint8_t>(math::Clamp(pixelColor.g, 0.0f, 1.0f) * 255.0f),
+                    static_cast<uint8_t>(math::Clamp(pixelColor.r, 0.0f, 1.0f) * 255.0f),
                     255
             });
         }
@@ -432,4 +501,48 @@ bool TraceTay(const math::Ray &ray, const HittableElement& hittableElement, math
     *outColor = math::Mix(math::Vec3<float>(1.0f,1.0f,1.0f),math::Vec3<float>(0.5f, 0.7f, 1.0f),h);
     // Пересечение не засчитано
     return false;
-}
\ No newline at end of file
+}
+
+/**
+ * \brief Итеративный метод трассировки сцены лучом (без рекурсии)
+ * \param ray Луч
+ * \param hittableElement Трассируемый элемент
+ * \param outColor Результирующий цвет для точки пересечения
+ * \return Было ли пересечение с каким-либо объектом сцены
+ */
+bool TracePath(const math::Ray &ray, const HittableElement& hittableElement, math::Vec3<float> *outColor)
+{
+    // Лучи пути (текущий и разбросанный меняются местами, чтобы не копировать только что записанный луч)
+    math::Ray rays[2] = {ray, {}};
+    unsigned current = 0;
+
+    // Накопленное затухание (доля света, доходящая по пути до камеры)
+    math::Vec3<float> throughput = {1.0f,1.0f,1.0f};
+
+    // Информация о пересечении с объектом
+    HitInfo hitInfo{};
+
+    // Проход по точкам пути (лучи глубже MAX_RECURSION_DEPTH не трассируются)
+    for(unsigned depth = 0; depth <= MAX_RECURSION_DEPTH; depth++)
+    {
+        // Луч ушел в фон - путь завершается цветом неба
+        if(!hittableElement.intersectsRay(rays[current],0.001f,1000.0f,&hitInfo))
+        {
+            auto h = 0.5*(rays[current].getDirection().y + 1.0);
+            *outColor = throughput * math::Mix(math::Vec3<float>(1.0f,1.0f,1.0f),math::Vec3<float>(0.5f, 0.7f, 1.0f),h);
+            return depth > 0;
+        }
+
+        // Материал поглотил луч (либо его нет) - путь не приносит света
+        math::Vec3<float> attenuation = {};
+        if(hitInfo.materialPtr == nullptr || !hitInfo.materialPtr->scatter(rays[current],hitInfo,&attenuation,&rays[current ^ 1u])){
+            break;
+        }
+
+        throughput = throughput * attenuation;
+        current ^= 1u;
+    }
+
+    *outColor = {0.0f,0.0f,0.0f};
+    return true;
+}
@@ -59,7 +59,7 @@ public:
                 hitInfo->point = ray.getOrigin() + (ray.getDirection() * t);
                 hitInfo->normal = math::Normalize(hitInfo->point - position_);
                 hitInfo->frontFaceSurface = true;
-                hitInfo->materialPtr = this->materialPtr_;
+                hitInfo->materialPtr = this->materialPtr_.get();
 
                 // Если сфера вывернута наизнанку
                 if(inverted_){
@@ -105,8 +105,8 @@ struct HitInfo
     float t = 0.0f;
     /// Является ли сторона "лицевой"
     bool frontFaceSurface = true;
-    /// Указатель на материал в точке пересечения
-    std::shared_ptr<Material> materialPtr = nullptr;
+    /// Указатель на материал в точке пересечения (материалом владеет объект сцены)
+    const Material* materialPtr = nullptr;
 };
 
 /**
@@ -1,29 +1,81 @@
 #include <iostream>
 #include <functional>
 #include <thread>
+#include <array>
+
+#ifdef _WIN32
 #include <windows.h>
+#endif
 
 #include <Math.hpp>
 #include <Ray.hpp>
 #include <ImageBuffer.hpp>
+#include <ImageFile.hpp>
+#include <CommandLine.hpp>
 
 #include "Scene/Sphere.hpp"
 #include "Scene/Plane.hpp"
 #include "Scene/Rectangle.hpp"
 #include "Scene/Box.hpp"
+#include "Scene/Instance.hpp"
+#include "Scene/Mesh.hpp"
+#include "Scene/MeshCache.hpp"
+#include "Scene/BVH.hpp"
+#include "Scene/WideBVH.hpp"
+#include "Scene/Lights.hpp"
 #include "Materials/Diffuse.hpp"
 #include "Materials/Light.hpp"
 #include "Materials/Metal.hpp"
 #include "Materials/Refractive.hpp"
-
-// Максимальная грубина рекурсии
-#define MAX_RECURSION_DEPTH 6
+#include "Samplers/Independent.hpp"
+#include "Samplers/Stratified.hpp"
+#include "Samplers/Halton.hpp"
+#include "Samplers/Sobol.hpp"
+#include "Render/Renderer.hpp"
+#include "Render/Accumulator.hpp"
+#include "Render/Wavefront.hpp"
+#include "Render/PerfCounters.hpp"
+
+// Максимальная грубина рекурсии (жесткое ограничение, обычно пути раньше прерывает "русская рулетка")
+#define MAX_RECURSION_DEPTH 16
+// Глубина, начиная с которой пути прерываются "русской рулеткой" по их вкладу (больше MAX_RECURSION_DEPTH - без рулетки)
+#define RUSSIAN_ROULETTE_DEPTH 3
 // Мультисемплинг (сколько лучей генерировать на 1 пиксель картинки)
 #define SAMPLES_PER_PIXEL 32
+// Кол-во семплов на пиксель за один проход прогрессивного рендеринга (0 - все за один проход, при ограничении времени - по одному)
+#define SAMPLES_PER_PASS 0
+// Ограничение времени рендеринга в секундах (0 - без ограничения, иначе проходы прекращаются до его истечения)
+#define TIME_LIMIT 0
+// Порог погрешности пикселя для адаптивного семплирования (0 - все пиксели получают SAMPLES_PER_PIXEL семплов)
+#define ADAPTIVE_THRESHOLD 0.0f
+// Минимальное кол-во семплов пикселя при адаптивном семплировании (до него погрешность не оценивается)
+#define ADAPTIVE_MIN_SAMPLES 8
+// Максимальное кол-во семплов пикселя при адаптивном семплировании
+#define ADAPTIVE_MAX_SAMPLES 256
 // Сколько разбросанных (вторичных) лучей генерировать при пересечении луча и объекта
 #define SAMPLES_PER_RAY 1
-// Кол-во потоков
-#define THREADS 8
+// Явная выборка источников света в диффузных точках (next event estimation, теневой луч к точке на источнике)
+#define LIGHT_SAMPLING true
+// Сочетание явной выборки и разбросанных лучей (scene::eMisNone, scene::eMisBalance, scene::eMisPower)
+#define MIS_HEURISTIC scene::eMisPower
+// Кол-во потоков (0 - по кол-ву аппаратных потоков процессора)
+#define THREADS 0
+// Размер стороны участка кадра, обрабатываемого потоком за один раз
+#define TILE_SIZE 16
+// Привязка потоков рендеринга к ядрам (render::eAffinityNone, render::eAffinityPinned)
+#define THREAD_AFFINITY render::eAffinityNone
+// Генератор семплов (samplers::Independent, samplers::Stratified, samplers::Halton, samplers::Sobol)
+#define SAMPLER samplers::Sobol
+// Способ построения иерархии ограничивающих объемов (scene::eBinnedSAH - качество, scene::eLinearMorton - скорость)
+#define BVH_BUILD_METHOD scene::eBinnedSAH
+// Кол-во потомков в узле иерархии при обходе (2 - бинарная, 4 - QBVH, 8 - OBVH - только при сборке с WIDE_BVH_AVX2=ON)
+#define BVH_WIDTH 4
+// Кол-во дополнительных случайных сфер в сцене (для нагрузочного тестирования)
+#define EXTRA_SPHERES 0
+// Кол-во экземпляров общей геометрии в сцене (для нагрузочного тестирования двухуровневой иерархии)
+#define EXTRA_INSTANCES 0
+// Файл сетки (OBJ или PLY), помещаемой на пол комнаты (пустая строка - без сетки)
+#define MESH_FILE ""
 
 /**
  * Коды ошибок
@@ -33,8 +85,10 @@ enum ErrorCode
     eNoErrors,
     eClassRegistrationError,
     eWindowCreationError,
+    eRuntimeError,
 };
 
+#ifdef _WIN32
 /// Дескриптор исполняемого модуля программы
 HINSTANCE g_hInstance = nullptr;
 /// Дескриптор осноного окна отрисовки
@@ -45,9 +99,28 @@ HDC g_hdc = nullptr;
 const char* g_strClassName = "MainWindowClass";
 /// Заголовок окна
 const char* g_strWindowCaption = "04 - Path tracing light sources";
+#endif
 /// Код последней ошибки
 ErrorCode g_lastError = ErrorCode::eNoErrors;
 
+/**
+ * Параметры трассировки путей
+ */
+struct PathSettings
+{
+    /// Максимальная глубина пути (более глубокие лучи не трассируются)
+    unsigned maxDepth = MAX_RECURSION_DEPTH;
+    /// Глубина, начиная с которой путь продолжается с вероятностью, зависящей от его вклада ("русская рулетка")
+    unsigned rouletteDepth = RUSSIAN_ROULETTE_DEPTH;
+    /// Рекурсивная трассировка (TraceTay) вместо итеративной (TracePath)
+    bool recursive = false;
+    /// Волновая трассировка (все пути участка продвигаются стадиями, см. render::Wavefront)
+    bool wavefront = false;
+    /// Упорядочивание вторичных лучей перед поиском пересечений (только при волновой трассировке)
+    bool sortRays = false;
+};
+
+#ifdef _WIN32
 /** W I N A P I  S T U F F **/
 
 /**
@@ -68,42 +141,99 @@ LRESULT CALLBACK WindowProcedure(HWND hWnd, UINT message, WPARAM wParam, LPARAM
  * \param hWnd Дескриптор окна
  */
 void PresentFrame(void *pixels, int width, int height, HWND hWnd);
+#endif
 
 /** R A Y T R A C I N G  **/
 
 /**
- * \brief Метод рендеринга сцены
- * \param imageBuffer Целевой буфер изображения
+ * \brief Кол-во рабочих потоков
+ * \return Значение THREADS, либо кол-во аппаратных потоков процессора (если THREADS равно 0)
+ */
+unsigned ThreadCount();
+
+/**
+ * \brief Метод рендеринга сцены (один проход прогрессивного рендеринга)
+ * \param renderer Исполнитель кадров (постоянный пул потоков)
+ * \param accumulator Накопитель семплов кадра
  * \param scene Сцена
+ * \param lights Источники света для явной выборки (пустой список - только разбросанные лучи)
+ * \param path Параметры трассировки путей
+ * \param sampler Генератор семплов (каждый поток использует собственную копию)
  * \param fov Угол обзора
- * \param samples Кол-во семплов (лучей) на пиксель буфера
+ * \param samples Кол-во семплов (лучей), добавляемых к каждому пикселю
+ * \param adaptive Правила распределения семплов (пиксели, не отмеченные накопителем как активные, пропускаются)
  * \param viewPosition Положение камеры
  * \param viewOrient Ориентация наблюдателя
+ * \param frame Номер кадра (участвует в зерне генератора случайных чисел)
+ * \param counters Показания аппаратных счетчиков производительности, прибавляемые за проход (nullptr - не считаются)
+ * \return Статистика обработки участков кадра
  *
  * \details В данном методе происходит генерация лучей для каждого пикселя кадрового буфера и последующая
- * трассировка лучами сцены, а также запись полученных значений в пиксели кадрового буфера
+ * трассировка лучами сцены, а также добавление полученных значений в накопитель. Кадр обрабатывается
+ * участками, распределяемыми между потоками исполнителя с перехватом работы. Значения генератора
+ * семплов определяются только пикселем, номером семпла и кадром, поэтому результат не зависит от кол-ва потоков
+ * и порядка обработки пикселей. Номера семплов продолжают уже накопленные, поэтому несколько проходов дают
+ * тот же набор семплов, что и один проход с их суммарным кол-вом
  */
-void Render(
-        ImageBuffer<RGBQUAD> *imageBuffer,
-        const scene::List& scene,
+render::TileStats Render(
+        render::Renderer *renderer,
+        render::Accumulator *accumulator,
+        const scene::Hittable& scene,
+        const scene::LightList& lights,
+        const PathSettings& path,
+        const samplers::Sampler& sampler,
         const float& fov,
         unsigned samples,
+        const render::AdaptiveSampling& adaptive,
         math::Vec3<float> viewPosition = {0.0f,0.0f,0.0f},
-        math::Vec3<float> viewOrient = {0.0f,0.0f,0.0f});
+        math::Vec3<float> viewOrient = {0.0f,0.0f,0.0f},
+        unsigned frame = 0,
+        render::CounterValues* counters = nullptr);
 
 /**
  * \brief Метод трассировки сцены лучом
  * \param ray Луч
  * \param hittableElement Трассируемый элемент
+ * \param lights Источники света для явной выборки
+ * \param path Параметры трассировки путей
  * \param outColor Результирующий цвет для точки пересечения
- * \param recursionDepth Глубина рекурсии
+ * \param sampler Генератор семплов
+ * \param recursionDepth Глубина рекурсии (вклад пути до луча передается в его весе)
+ * \param scatterPdf Плотность вероятности направления луча в предыдущей точке (0 - первичный луч, зеркальное отражение
+ * или точка без явной выборки источников, излучение учитывается полностью)
  * \return Было ли пересечение с каким-либо объектом сцены
  */
 bool TraceTay(
         const math::Ray& ray,
         const scene::Hittable& sceneElement,
+        const scene::LightList& lights,
+        const PathSettings& path,
+        math::Vec3<float>* outColor,
+        samplers::Sampler& sampler,
+        unsigned recursionDepth = 0,
+        float scatterPdf = 0.0f);
+
+/**
+ * \brief Итеративный метод трассировки сцены лучом (без рекурсии)
+ * \param ray Луч
+ * \param sceneElement Трассируемый элемент
+ * \param lights Источники света для явной выборки
+ * \param path Параметры трассировки путей
+ * \param outColor Результирующий цвет для точки пересечения
+ * \param sampler Генератор семплов
+ * \return Было ли пересечение с каким-либо объектом сцены
+ *
+ * \details Оценка совпадает с TraceTay при SAMPLES_PER_RAY равном 1 (значения генератора семплов запрашиваются
+ * в том же порядке), но путь проходится одним циклом: затухание пути и собранный свет хранятся в локальных
+ * переменных, цвет не возвращается и не усредняется на каждом уровне, глубина не ограничена размером стека
+ */
+bool TracePath(
+        const math::Ray& ray,
+        const scene::Hittable& sceneElement,
+        const scene::LightList& lights,
+        const PathSettings& path,
         math::Vec3<float>* outColor,
-        unsigned recursionDepth = 0);
+        samplers::Sampler& sampler);
 
 /** M A I N **/
 
@@ -115,66 +245,88 @@ bool TraceTay(
  */
 int main(int argc, char* argv[])
 {
-    (void)argc;
-    (void)argv;
-
     try {
-        // Получение дескриптора исполняемого модуля программы
-        g_hInstance = GetModuleHandle(nullptr);
-
-        // Информация о классе
-        WNDCLASSEX classInfo;
-        classInfo.cbSize = sizeof(WNDCLASSEX);
-        classInfo.style = CS_HREDRAW | CS_VREDRAW | CS_OWNDC;
-        classInfo.cbClsExtra = 0;
-        classInfo.cbWndExtra = 0;
-        classInfo.hInstance = g_hInstance;
-        classInfo.hIcon = LoadIcon(g_hInstance, IDI_APPLICATION);
-        classInfo.hIconSm = LoadIcon(g_hInstance, IDI_APPLICATION);
-        classInfo.hCursor = LoadCursor(nullptr, IDC_ARROW);
-        classInfo.hbrBackground = CreateSolidBrush(RGB(240, 240, 240));
-        classInfo.lpszMenuName = nullptr;
-        classInfo.lpszClassName = g_strClassName;
-        classInfo.lpfnWndProc = WindowProcedure;
-
-        // Пытаемся зарегистрировать оконный класс
-        if (!RegisterClassEx(&classInfo)) {
-            g_lastError = ErrorCode::eClassRegistrationError;
-            throw std::runtime_error("ERROR: Can't register window class.");
-        }
+        // Аргументы командной строки
+        CommandLine commandLine(argc, argv);
+
+        // Файл для сохранения кадра
+        const std::string outputPath = commandLine.getString("output", "04_PathTracingLights.png");
+        // Размеры кадра (в оконном режиме - размеры окна)
+        unsigned width = commandLine.getUnsigned("width", 800);
+        unsigned height = commandLine.getUnsigned("height", 600);
+
+#ifdef _WIN32
+        // Без явно заданного файла кадр показывается в окне
+        const bool headless = commandLine.has("output");
+#else
+        // Оконного режима нет - кадр всегда сохраняется в файл
+        const bool headless = true;
+#endif
+
+#ifdef _WIN32
+        if(!headless)
+        {
+            // Получение дескриптора исполняемого модуля программы
+            g_hInstance = GetModuleHandle(nullptr);
+
+            // Информация о классе
+            WNDCLASSEX classInfo;
+            classInfo.cbSize = sizeof(WNDCLASSEX);
+            classInfo.style = CS_HREDRAW | CS_VREDRAW | CS_OWNDC;
+            classInfo.cbClsExtra = 0;
+            classInfo.cbWndExtra = 0;
+            classInfo.hInstance = g_hInstance;
+            classInfo.hIcon = LoadIcon(g_hInstance, IDI_APPLICATION);
+            classInfo.hIconSm = LoadIcon(g_hInstance, IDI_APPLICATION);
+            classInfo.hCursor = LoadCursor(nullptr, IDC_ARROW);
+            classInfo.hbrBackground = CreateSolidBrush(RGB(240, 240, 240));
+            classInfo.lpszMenuName = nullptr;
+            classInfo.lpszClassName = g_strClassName;
+            classInfo.lpfnWndProc = WindowProcedure;
+
+            // Пытаемся зарегистрировать оконный класс
+            if (!RegisterClassEx(&classInfo)) {
+                g_lastError = ErrorCode::eClassRegistrationError;
+                throw std::runtime_error("ERROR: Can't register window class.");
+            }
 
-        // Создание окна
-        g_hwnd = CreateWindow(
-                g_strClassName,
-                g_strWindowCaption,
-                WS_OVERLAPPEDWINDOW,
-                0, 0,
-                800, 600,
-                nullptr,
-                nullptr,
-                g_hInstance,
-                nullptr);
-
-        // Если не удалось создать окно
-        if (!g_hwnd) {
-            g_lastError = ErrorCode::eWindowCreationError;
-            throw std::runtime_error("ERROR: Can't create main application window.");
-        }
+            // Создание окна
+            g_hwnd = CreateWindow(
+                    g_strClassName,
+                    g_strWindowCaption,
+                    WS_OVERLAPPEDWINDOW,
+                    0, 0,
+                    static_cast<int>(width), static_cast<int>(height),
+                    nullptr,
+                    nullptr,
+                    g_hInstance,
+                    nullptr);
+
+            // Если не удалось создать окно
+            if (!g_hwnd) {
+                g_lastError = ErrorCode::eWindowCreationError;
+                throw std::runtime_error("ERROR: Can't create main application window.");
+            }
 
-        // Показать окно
-        ShowWindow(g_hwnd, SW_SHOWNORMAL);
+            // Показать окно
+            ShowWindow(g_hwnd, SW_SHOWNORMAL);
 
-        // Получение контекста отрисовки
-        g_hdc = GetDC(g_hwnd);
+            // Получение контекста отрисовки
+            g_hdc = GetDC(g_hwnd);
 
-        // Размеры клиентской области окна
-        RECT clientRect;
-        GetClientRect(g_hwnd, &clientRect);
+            // Размеры клиентской области окна
+            RECT clientRect;
+            GetClientRect(g_hwnd, &clientRect);
+            // Кадр занимает всю клиентскую область
+            width = static_cast<unsigned>(clientRect.right);
+            height = static_cast<unsigned>(clientRect.bottom);
+        }
+#endif
 
         /** RAYTRACING **/
 
         // Создать буффер кадра
-        auto frameBuffer = ImageBuffer<RGBQUAD>(clientRect.right, clientRect.bottom, {0, 0, 0, 0});
+        auto frameBuffer = ImageBuffer<Pixel>(width, height, {0, 0, 0, 0});
         std::cout << "INFO: Frame-buffer initialized  (resolution : " << frameBuffer.getWidth() << "x" << frameBuffer.getHeight() << ", size : " << frameBuffer.getSize() << " bytes)" << std::endl;
 
         // Материалы
@@ -198,42 +350,197 @@ int main(int argc, char* argv[])
         scene.addElement(std::make_shared<scene::Sphere>(glass,math::Vec3<float>(2.5f,-3.5f,3.0f),1.5f));
         scene.addElement(std::make_shared<scene::Rectangle>(light,math::Vec3<float>(0.0f,4.95f,0.0f),math::Vec2<float>(3.0f,3.0f), math::Vec3<float>(90.0f,0.0f,0.0f)));
 
-        // Трассировка сцены лучами, запись результата в буфер изображения
-        auto renderBeginTime = std::chrono::system_clock::now();
-        Render(&frameBuffer, scene, 90.0f, SAMPLES_PER_PIXEL,{0.0f,0.0f,10.0f},{0.0f,0.0f,0.0f});
-        std::cout << "INFO: Scene rendered in " << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - renderBeginTime).count() << " ms." << std::endl;
+        // Генератор случайных чисел для расстановки дополнительных объектов (сцена одинакова при каждом запуске)
+        Pcg32 sceneRng(Pcg32::seedFrom(0));
+
+        // Дополнительные сферы внутри комнаты
+        const unsigned extraSpheres = EXTRA_SPHERES;
+        for(unsigned i = 0; i < extraSpheres; i++){
+            scene.addElement(std::make_shared<scene::Sphere>(white,RndVec(sceneRng,-4.5f,4.5f),RndFloat(sceneRng,0.02f,0.1f)));
+        }
+
+        // Сетка из файла (масштабируется так, чтобы поместиться в комнату)
+        if(std::string(MESH_FILE).length() > 0){
+            auto loadBeginTime = std::chrono::system_clock::now();
+            bool cacheHit = false;
+            auto mesh = scene::cache::LoadMeshCached(MESH_FILE, white, ThreadCount(), BVH_BUILD_METHOD, "", &cacheHit);
+            std::cout << "INFO: Mesh loaded in " << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - loadBeginTime).count() << " ms. (triangles : " << mesh->getTriangleCount() << ", from cache : " << (cacheHit ? "yes" : "no") << ")" << std::endl;
+
+            math::BBox<> bounds{};
+            if(mesh->boundingBox(&bounds)){
+                auto sizes = bounds.max - bounds.min;
+                float scale = 4.0f / std::max(std::max(sizes.x, sizes.y), std::max(sizes.z, 0.0001f));
+                auto position = math::Vec3<float>(0.0f, -5.0f + (sizes.y * scale) / 2.0f, 0.0f) - (math::Center(bounds) * scale);
+                scene.addElement(std::make_shared<scene::Instance>(mesh, position, math::Vec3<float>(0.0f,0.0f,0.0f), math::Vec3<float>(scale,scale,scale)));
+            }
+        }
+
+        // Экземпляры общей геометрии (нижний уровень иерархии строится один раз, в верхний попадают только экземпляры)
+        const unsigned extraInstances = EXTRA_INSTANCES;
+        if(extraInstances > 0){
+            scene::List cluster{};
+            cluster.addElement(std::make_shared<scene::Box>(white,math::Vec3<float>(0.0f,0.0f,0.0f),math::Vec3<float>(0.02f,0.3f,0.02f)));
+            cluster.addElement(std::make_shared<scene::Sphere>(green,math::Vec3<float>(0.0f,0.2f,0.0f),0.08f));
+            cluster.addElement(std::make_shared<scene::Sphere>(green,math::Vec3<float>(0.06f,0.1f,0.0f),0.05f));
+            cluster.addElement(std::make_shared<scene::Sphere>(green,math::Vec3<float>(-0.05f,0.12f,0.03f),0.05f));
+            auto clusterBvh = std::make_shared<scene::BVH>(cluster.getElements());
+
+            for(unsigned i = 0; i < extraInstances; i++){
+                float scale = RndFloat(sceneRng,0.5f,1.5f);
+                scene.addElement(std::make_shared<scene::Instance>(clusterBvh,RndVec(sceneRng,-4.5f,4.5f),RndVec(sceneRng,0.0f,360.0f),math::Vec3<float>(scale,scale,scale)));
+            }
+        }
+
+        // Иерархия ограничивающих объемов над элементами сцены (плоскости проверяются вне иерархии)
+        auto buildBeginTime = std::chrono::system_clock::now();
+#if BVH_WIDTH > 2
+        scene::WideBVH<BVH_WIDTH> sceneBvh(scene.getElements(), ThreadCount(), BVH_BUILD_METHOD);
+#else
+        scene::BVH sceneBvh(scene.getElements(), ThreadCount(), BVH_BUILD_METHOD);
+#endif
+        std::cout << "INFO: BVH built in " << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - buildBeginTime).count() << " ms. (nodes : " << sceneBvh.getNodeCount() << ")" << std::endl;
+#if BVH_WIDTH == 8 && !defined(WIDE_BVH_AVX2)
+        std::cout << "INFO: 8-wide BVH nodes are tested without AVX2 (build with -DWIDE_BVH_AVX2=ON, otherwise BVH_WIDTH 4 is faster)" << std::endl;
+#endif
+
+        // Источники света для явной выборки (флаг --no-light-sampling оставляет только разбросанные лучи)
+        const bool lightSampling = LIGHT_SAMPLING && !commandLine.has("no-light-sampling");
+        const std::string misNames[] = {"none", "balance", "power"};
+        const std::string misName = commandLine.getString("mis", misNames[MIS_HEURISTIC]);
+        auto misHeuristic = static_cast<scene::MisHeuristic>(std::find(misNames, misNames + 3, misName) - misNames);
+        if(misHeuristic > scene::eMisPower) throw std::runtime_error("ERROR: Unknown MIS heuristic \"" + misName + "\" (use none, balance or power).");
+        const scene::LightList lights = lightSampling ? scene::LightList(scene.getElements(), misHeuristic) : scene::LightList();
+        std::cout << "INFO: Light sampling " << (lightSampling ? "enabled" : "disabled") << " (lights : " << lights.size() << ", MIS : " << misName << ")" << std::endl;
+
+        // Параметры трассировки путей (итеративная трассировка не ветвится, поэтому при нескольких разбросанных лучах
+        // в точке используется рекурсивная)
+        PathSettings pathSettings{};
+        pathSettings.maxDepth = commandLine.getUnsigned("max-depth", MAX_RECURSION_DEPTH);
+        pathSettings.rouletteDepth = commandLine.getUnsigned("rr-depth", RUSSIAN_ROULETTE_DEPTH);
+        pathSettings.recursive = commandLine.has("recursive") || SAMPLES_PER_RAY > 1;
+        pathSettings.wavefront = (commandLine.has("wavefront") || commandLine.has("ray-sort")) && !pathSettings.recursive;
+        pathSettings.sortRays = commandLine.has("ray-sort") && pathSettings.wavefront;
+
+        // Аппаратные счетчики производительности (промахи кэша и т.д.) потоков рендеринга
+        const bool perfCounters = commandLine.has("perf-counters") && render::PerfCounters().available();
+        if(commandLine.has("perf-counters") && !perfCounters){
+            std::cout << "INFO: Hardware performance counters are not available on this system" << std::endl;
+        }
+        render::CounterValues counterValues{};
+
+        // Исполнитель кадров (потоки создаются один раз и используются всеми последующими кадрами)
+        render::Renderer renderer(ThreadCount(), TILE_SIZE, THREAD_AFFINITY);
+
+        // Кол-во семплов на пиксель, семплов за проход и ограничение времени (значения по умолчанию можно переопределить)
+        const unsigned samples = std::max(1u, commandLine.getUnsigned("samples", SAMPLES_PER_PIXEL));
+        const float timeLimit = commandLine.getFloat("time-limit", static_cast<float>(TIME_LIMIT));
 
-        // Показ кадра
-        PresentFrame(frameBuffer.getData(), static_cast<int>(frameBuffer.getWidth()), static_cast<int>(frameBuffer.getHeight()), g_hwnd);
+        // Правила распределения семплов (без адаптивности каждый пиксель получает ровно samples семплов)
+        render::AdaptiveSampling adaptive{};
+        adaptive.threshold = commandLine.getFloat("adaptive-threshold", ADAPTIVE_THRESHOLD);
+        adaptive.minSamples = adaptive.threshold > 0.0f ? std::max(1u, commandLine.getUnsigned("min-samples", ADAPTIVE_MIN_SAMPLES)) : samples;
+        adaptive.maxSamples = adaptive.threshold > 0.0f ? std::max(adaptive.minSamples, commandLine.getUnsigned("max-samples", ADAPTIVE_MAX_SAMPLES)) : samples;
 
-        /** MAIN LOOP **/
+        unsigned passSamples = commandLine.getUnsigned("pass-samples", SAMPLES_PER_PASS);
+        if(passSamples == 0) passSamples = adaptive.threshold > 0.0f ? adaptive.minSamples : (timeLimit > 0.0f ? 1 : samples);
 
-        // Оконное сообщение
-        MSG msg = {};
+        // Накопитель семплов (изображение уточняется проходами, отображаемый кадр получается из него после каждого прохода)
+        render::Accumulator accumulator(frameBuffer.getWidth(), frameBuffer.getHeight());
+        SAMPLER sampler(samples);
+
+        // Бюджет семплов кадра (в среднем samples на пиксель, при адаптивности распределяется неравномерно)
+        const uint64_t pixelCount = static_cast<uint64_t>(frameBuffer.getWidth()) * frameBuffer.getHeight();
+        const uint64_t sampleBudget = static_cast<uint64_t>(samples) * pixelCount;
+
+        // Трассировка сцены лучами проходами, пока есть нуждающиеся в семплах пиксели, бюджет и время
+        auto renderBeginTime = std::chrono::system_clock::now();
+        unsigned passes = 0;
+        double lastPassMilliseconds = 0.0;
+        while(true)
+        {
+            // Следующий проход не начинается, если он (по длительности предыдущего) не успеет завершиться
+            double elapsedMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::system_clock::now() - renderBeginTime).count();
+            if(timeLimit > 0.0f && passes > 0 && elapsedMilliseconds + lastPassMilliseconds > timeLimit * 1000.0) break;
+
+            // Кол-во семплов на пиксель за проход (не больше, чем позволяет оставшийся бюджет)
+            uint64_t activePixels = accumulator.updateActivePixels(adaptive);
+            uint64_t spentSamples = accumulator.getTotalSamples();
+            if(activePixels == 0 || spentSamples >= sampleBudget) break;
+            auto count = static_cast<unsigned>(std::min<uint64_t>(passSamples, (sampleBudget - spentSamples) / activePixels));
+            if(count == 0) break;
+
+            auto renderStats = Render(&renderer, &accumulator, sceneBvh, lights, pathSettings, sampler, 90.0f, count, adaptive, {0.0f,0.0f,10.0f},{0.0f,0.0f,0.0f}, 0, perfCounters ? &counterValues : nullptr);
+            passes++;
+            lastPassMilliseconds = renderStats.wallMilliseconds;
+
+            // Отображаемый кадр из накопленных семплов
+            accumulator.resolve(&frameBuffer);
+            std::cout << "INFO: Pass " << passes << " rendered in " << static_cast<long long>(renderStats.wallMilliseconds) << " ms. (pixels : " << activePixels << ", samples per pixel : " << static_cast<double>(accumulator.getTotalSamples()) / static_cast<double>(pixelCount) << "/" << samples << ", threads : " << renderStats.busyMilliseconds.size() << ", tiles : " << renderStats.tileMilliseconds.size() << ", steals : " << renderStats.steals << ", utilization : " << static_cast<int>(renderStats.utilization() * 100.0) << "%, slowest tile : " << renderStats.slowestTile() << " ms.)" << std::endl;
+
+#ifdef _WIN32
+            // Показ промежуточного кадра
+            if(!headless) PresentFrame(frameBuffer.getData(), static_cast<int>(frameBuffer.getWidth()), static_cast<int>(frameBuffer.getHeight()), g_hwnd);
+#endif
+        }
+        std::cout << "INFO: Scene rendered in " << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - renderBeginTime).count() << " ms. (passes : " << passes << ", samples per pixel : " << static_cast<double>(accumulator.getTotalSamples()) / static_cast<double>(pixelCount) << ", unconverged pixels : " << accumulator.updateActivePixels(adaptive) << ")" << std::endl;
+        if(perfCounters){
+            std::cout << "INFO: Hardware counters (instructions : " << counterValues.instructions << ", L1D read misses : " << counterValues.l1dMisses << ", cache references : " << counterValues.cacheReferences << ", cache misses : " << counterValues.cacheMisses << ")" << std::endl;
+        }
+
+        // Карта кол-ва семплов (для отладки адаптивного семплирования)
+        if(commandLine.has("sample-map"))
+        {
+            auto sampleMap = ImageBuffer<Pixel>(frameBuffer.getWidth(), frameBuffer.getHeight(), {0, 0, 0, 0});
+            accumulator.resolveSampleCounts(&sampleMap);
+            imagefile::SaveImage(commandLine.getString("sample-map"), sampleMap);
+            std::cout << "INFO: Sample map saved to \"" << commandLine.getString("sample-map") << "\"" << std::endl;
+        }
 
-        // Запуск цикла
-        while (true)
+        // Сохранение кадра в файл
+        if(headless)
+        {
+            imagefile::SaveImage(outputPath, frameBuffer);
+            std::cout << "INFO: Frame saved to \"" << outputPath << "\"" << std::endl;
+        }
+#ifdef _WIN32
+        else
         {
-            // Обработка оконных сообщений
-            if (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+            // Показ кадра
+            PresentFrame(frameBuffer.getData(), static_cast<int>(frameBuffer.getWidth()), static_cast<int>(frameBuffer.getHeight()), g_hwnd);
+
+            /** MAIN LOOP **/
+
+            // Оконное сообщение
+            MSG msg = {};
+
+            // Запуск цикла
+            while (true)
             {
-                DispatchMessage(&msg);
+                // Обработка оконных сообщений
+                if (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE))
+                {
+                    DispatchMessage(&msg);
 
-                if (msg.message == WM_QUIT) {
-                    break;
+                    if (msg.message == WM_QUIT) {
+                        break;
+                    }
                 }
             }
         }
+#endif
     }
     catch(std::exception& ex)
     {
         std::cout << ex.what() << std::endl;
+        if(g_lastError == ErrorCode::eNoErrors) g_lastError = ErrorCode::eRuntimeError;
     }
 
+#ifdef _WIN32
     // Уничтожение окна
-    DestroyWindow(g_hwnd);
+    if(g_hwnd) DestroyWindow(g_hwnd);
     // Вырегистрировать класс окна
-    UnregisterClass(g_strClassName, g_hInstance);
+    if(g_hInstance) UnregisterClass(g_strClassName, g_hInstance);
+#endif
 
     // Код выполнения/ошибки
     return static_cast<int>(g_lastError);
@@ -241,6 +548,7 @@ int main(int argc, char* argv[])
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+#ifdef _WIN32
 /** W I N A P I  S T U F F **/
 
 /**
@@ -306,136 +614,231 @@ void PresentFrame(void *pixels, int width, int height, HWND hWnd)
     // Уничтожить DC
     ReleaseDC(hWnd,hdc);
 }
+#endif
 
 /** R A Y T R A C I N G  M E T H O D S **/
 
 /**
- * \brief Метод рендеринга сцены
- * \param imageBuffer Целевой буфер изображения
+ * \brief Кол-во рабочих потоков
+ * \return Значение THREADS, либо кол-во аппаратных потоков процессора (если THREADS равно 0)
+ */
+unsigned ThreadCount()
+{
+    if(THREADS > 0) return static_cast<unsigned>(THREADS);
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+/**
+ * \brief Метод рендеринга сцены (один проход прогрессивного рендеринга)
+ * \param renderer Исполнитель кадров (постоянный пул потоков)
+ * \param accumulator Накопитель семплов кадра
  * \param scene Сцена
+ * \param lights Источники света для явной выборки (пустой список - только разбросанные лучи)
+ * \param path Параметры трассировки путей
+ * \param sampler Генератор семплов (каждый поток использует собственную копию)
  * \param fov Угол обзора
- * \param samples Кол-во семплов (лучей) на пиксель буфера
+ * \param samples Кол-во семплов (лучей), добавляемых к каждому пикселю
+ * \param adaptive Правила распределения семплов (пиксели, не отмеченные накопителем как активные, пропускаются)
  * \param viewPosition Положение камеры
  * \param viewOrient Ориентация наблюдателя
+ * \param frame Номер кадра (участвует в зерне генератора случайных чисел)
+ * \param counters Показания аппаратных счетчиков производительности, прибавляемые за проход (nullptr - не считаются)
+ * \return Статистика обработки участков кадра
  *
  * \details В данном методе происходит генерация лучей для каждого пикселя кадрового буфера и последующая
- * трассировка лучами сцены, а также запись полученных значений в пиксели кадрового буфера
+ * трассировка лучами сцены, а также добавление полученных значений в накопитель. Кадр обрабатывается
+ * участками, распределяемыми между потоками исполнителя с перехватом работы. Значения генератора
+ * семплов определяются только пикселем, номером семпла и кадром, поэтому результат не зависит от кол-ва потоков
+ * и порядка обработки пикселей. Номера семплов продолжают уже накопленные, поэтому несколько проходов дают
+ * тот же набор семплов, что и один проход с их суммарным кол-вом
  */
-void Render(
-        ImageBuffer<RGBQUAD> *imageBuffer,
-        const scene::List &scene,
+render::TileStats Render(
+        render::Renderer *renderer,
+        render::Accumulator *accumulator,
+        const scene::Hittable &scene,
+        const scene::LightList &lights,
+        const PathSettings &path,
+        const samplers::Sampler &sampler,
         const float &fov,
         unsigned samples,
+        const render::AdaptiveSampling& adaptive,
         math::Vec3<float> viewPosition,
-        math::Vec3<float> viewOrient)
+        math::Vec3<float> viewOrient,
+        unsigned frame,
+        render::CounterValues* counters)
 {
     // Размеры кадрового буфера
-    auto w = static_cast<float>(imageBuffer->getWidth());
-    auto h = static_cast<float>(imageBuffer->getHeight());
+    auto w = static_cast<float>(accumulator->getWidth());
+    auto h = static_cast<float>(accumulator->getHeight());
 
     // Угол обзора в радианах
     auto fovRadians = static_cast<float>(fov / (180.0f / M_PI));
 
-    // Всего пикселей в буфере
-    unsigned totalPixels = imageBuffer->getWidth() * imageBuffer->getHeight();
+    // Собственные копии генератора семплов для каждого потока
+    std::vector<std::unique_ptr<samplers::Sampler>> threadSamplers(renderer->getThreadCount());
+    for(auto& threadSampler : threadSamplers) threadSampler = sampler.clone();
 
-    // Лямбда - рендериг блока пикселей
-    auto renderBunch = [&](unsigned from, unsigned to){
-        // Проход по всем пикселям
-        for(unsigned i = from; i < to; i++)
-        {
-            // Получить координаты пикселя
-            unsigned row = i / imageBuffer->getWidth();
-            unsigned col = i % imageBuffer->getWidth();
+    // Буферы волновой трассировки для каждого потока (сохраняются между участками)
+    std::vector<std::unique_ptr<render::Wavefront>> threadWavefronts(path.wavefront ? renderer->getThreadCount() : 0);
+    for(auto& threadWavefront : threadWavefronts){
+        threadWavefront.reset(new render::Wavefront());
+        threadWavefront->setRaySorting(path.sortRays);
+    }
 
-            // Итоговый цвет пикселя
-            math::Vec3<float> pixelColor = {0.0f, 0.0f, 0.0f};
+    // Лямбда - первичный луч семпла (генератор семплов должен быть переведен на начало семпла)
+    auto primaryRay = [&](samplers::Sampler* threadSampler, unsigned col, unsigned row){
+        // Отклонение луча в пределах пикселя
+        // В случае мультисемплинга генерируется случайный сдвинг, в противном случае сдвиг устанавливается в центр пикселя
+        math::Vec2<float> pixelSample = threadSampler->get2D();
+        math::Vec2<float> pixelBias = (sampler.getSamplesPerPixel() > 1 ? pixelSample : math::Vec2<float>(0.5f, 0.5f));
 
-            // Проход по семплам пикселя
-            for(unsigned s = 0; s < samples; s++)
-            {
-                // Отклонение луча в пределах пикселя
-                // В случае мультисемплинга генерируется случайный сдвинг, в противном случае сдвиг устанавливается в центр пикселя
-                math::Vec2<float> pixelBias = (samples > 1 ? math::Vec2<float>(RndFloat(), RndFloat()) : math::Vec2<float>(0.5f, 0.5f));
+        // Вычислить отклонение луча для текущего пикселя по углу обзора и текущим координатам пикселя
+        float x = (2.0f * (static_cast<float>(col) + pixelBias.x) / w - 1.0f) * tanf(fovRadians / 2.0f) * w / h;
+        float y = -(2.0f * (static_cast<float>(row) + pixelBias.y) / h - 1.0f) * tanf(fovRadians / 2.0f);
 
-                // Вычислить отклонение луча для текущего пикселя по углу обзора и текущим координатам пикселя
-                float x = (2.0f * (static_cast<float>(col) + pixelBias.x) / w - 1.0f) * tanf(fovRadians / 2.0f) * w / h;
-                float y = -(2.0f * (static_cast<float>(row) + pixelBias.y) / h - 1.0f) * tanf(fovRadians / 2.0f);
+        // Направление луча (с учетом поворота камеры)
+        math::Vec3<float> dir = math::GetRotationMat(viewOrient) * math::Vec3<float>(x,y,-1.0f);
 
-                // Направление луча (с учетом поворота камеры)
-                math::Vec3<float> dir = math::GetRotationMat(viewOrient) * math::Vec3<float>(x,y,-1.0f);
+        // Создать луч
+        return math::Ray(viewPosition,dir);
+    };
+
+    // Лямбда - волновой рендеринг участка кадра (лучи всех семплов участка трассируются вместе)
+    auto renderTileWavefront = [&](const render::Tile& tile, unsigned thread){
+        samplers::Sampler* threadSampler = threadSamplers[thread].get();
+        render::Wavefront* wavefront = threadWavefronts[thread].get();
+        wavefront->clear();
 
-                // Создать луч
-                math::Ray ray(viewPosition,dir);
+        // Пиксели участка, которым нужны семплы (столбец, строка, кол-во семплов прохода)
+        std::vector<std::array<unsigned,3>> pixels;
+        pixels.reserve(tile.width * tile.height);
+
+        // Первичные лучи всех семплов участка
+        for(unsigned row = tile.y; row < tile.y + tile.height; row++)
+        {
+            for(unsigned col = tile.x; col < tile.x + tile.width; col++)
+            {
+                if(!accumulator->isActive(col, row)) continue;
 
-                // Трассировка сцены и получение цвета
-                math::Vec3<float> sampleColor = {0.0f,0.0f,0.0f};
-                TraceTay(ray, scene, &sampleColor);
+                unsigned i = row * accumulator->getWidth() + col;
+                unsigned firstSample = accumulator->getSampleCount(col, row);
+                unsigned sampleCount = std::min(samples, adaptive.maxSamples - firstSample);
+                pixels.push_back({col, row, sampleCount});
 
-                // Прибавить к итоговому цвету цвет семпла
-                pixelColor = pixelColor + sampleColor;
+                for(unsigned s = 0; s < sampleCount; s++)
+                {
+                    threadSampler->startPixelSample(i, firstSample + s, frame);
+                    math::Ray ray = primaryRay(threadSampler, col, row);
+                    wavefront->addPath(ray, threadSampler->getState());
+                }
             }
+        }
 
-            // Усреднение цвета
-            pixelColor = pixelColor / static_cast<float>(samples);
-
-            // Гамма коррекция (для гаммы в 2.0)
-            pixelColor = {
-                    std::sqrt(pixelColor.r),
-                    std::sqrt(pixelColor.g),
-                    std::sqrt(pixelColor.b),
-            };
-
-            // Установка цвета
-            imageBuffer->setPoint(col,row,{
-                    static_cast<BYTE>(math::Clamp(pixelColor.b, 0.0f, 1.0f) * 255.0f),
-                    static_cast<BYTE>(math::Clamp(pixelColor.g, 0.0f, 1.0f) * 255.0f),
-                    static_cast<BYTE>(math::Clamp(pixelColor.r, 0.0f, 1.0f) * 255.0f),
-                    255
-            });
+        // Трассировка всех путей участка
+        wavefront->trace(scene, lights, path.maxDepth, path.rouletteDepth, *threadSampler);
+
+        // Добавление семплов в накопитель (пути идут в порядке добавления)
+        uint32_t pathIndex = 0;
+        for(const auto& pixel : pixels)
+        {
+            render::PixelSamples pixelSamples{};
+            for(unsigned s = 0; s < pixel[2]; s++) pixelSamples.add(wavefront->getRadiance(pathIndex++));
+            accumulator->add(pixel[0], pixel[1], pixelSamples);
         }
     };
 
-    // Кол-во пикселей на 1 поток
-    unsigned pixelBunchSize = totalPixels / static_cast<unsigned>(THREADS);
+    // Лямбда - рендериг участка кадра
+    auto renderTile = [&](const render::Tile& tile, unsigned thread){
+        samplers::Sampler* threadSampler = threadSamplers[thread].get();
+
+        // Проход по всем пикселям участка
+        for(unsigned row = tile.y; row < tile.y + tile.height; row++)
+        {
+            for(unsigned col = tile.x; col < tile.x + tile.width; col++)
+            {
+                // Пиксели, которым семплы больше не нужны, пропускаются
+                if(!accumulator->isActive(col, row)) continue;
+
+                // Индекс пикселя
+                unsigned i = row * accumulator->getWidth() + col;
 
-    // Потоки
-    std::vector<std::thread> threads{};
+                // Номер первого семпла прохода (продолжение уже накопленных) и кол-во семплов прохода
+                unsigned firstSample = accumulator->getSampleCount(col, row);
+                unsigned sampleCount = std::min(samples, adaptive.maxSamples - firstSample);
 
-    // Запуск нужного кол-ва потоков
-    for(unsigned i = 0; i < THREADS; i++)
-    {
-        // Индекс начального и конечного пикселя
-        unsigned from = pixelBunchSize * i;
-        unsigned to = pixelBunchSize * (i + 1);
+                // Семплы прохода
+                render::PixelSamples pixelSamples{};
+
+                // Проход по семплам пикселя
+                for(unsigned s = 0; s < sampleCount; s++)
+                {
+                    // Начать новый семпл (первые два измерения - сдвиг в пределах пикселя)
+                    threadSampler->startPixelSample(i, firstSample + s, frame);
+
+                    // Первичный луч (сдвиг в пределах пикселя и направление камеры)
+                    math::Ray ray = primaryRay(threadSampler, col, row);
+
+                    // Трассировка сцены и получение цвета
+                    math::Vec3<float> sampleColor = {0.0f,0.0f,0.0f};
+                    if(path.recursive) TraceTay(ray, scene, lights, path, &sampleColor, *threadSampler);
+                    else TracePath(ray, scene, lights, path, &sampleColor, *threadSampler);
+
+                    // Учесть цвет семпла
+                    pixelSamples.add(sampleColor);
+                }
 
-        // Если это последний поток - добавить остаток от деления (на случай если кол-во пикселей ровно не делится на кол-во потоков)
-        if(i == (THREADS - 1)) to += (totalPixels % static_cast<unsigned>(THREADS));
+                // Добавление семплов в накопитель (усреднение и гамма коррекция - при получении изображения)
+                accumulator->add(col, row, pixelSamples);
+            }
+        }
+    };
 
-        // Запуск потока и добавление его в массив
-        threads.emplace_back(renderBunch,from,to);
+    // Обработка участков кадра всеми потоками исполнителя
+    std::function<void(const render::Tile&, unsigned)> tileFunction = renderTile;
+    if(path.wavefront) tileFunction = renderTileWavefront;
+
+    // Показания счетчиков производительности снимаются до и после каждого участка (счетчики у каждого потока свои)
+    std::vector<render::CounterValues> threadCounters(counters != nullptr ? renderer->getThreadCount() : 0);
+    if(counters != nullptr){
+        tileFunction = [&, renderTileFunction = tileFunction](const render::Tile& tile, unsigned thread){
+            static thread_local render::PerfCounters perfCounters;
+            render::CounterValues before = perfCounters.read();
+            renderTileFunction(tile, thread);
+            threadCounters[thread] += perfCounters.read() - before;
+        };
     }
 
-    // Ожидание завершения потоков
-    for(auto& t : threads) t.join();
+    renderer->submit(accumulator->getWidth(), accumulator->getHeight(), tileFunction);
+    render::TileStats stats = renderer->wait();
+    for(const auto& values : threadCounters) *counters += values;
+    return stats;
 }
 
 /**
  * \brief Метод трассировки сцены лучом
  * \param ray Луч
  * \param hittableElement Трассируемый элемент
+ * \param lights Источники света для явной выборки
+ * \param path Параметры трассировки путей
  * \param outColor Результирующий цвет для точки пересечения
- * \param recursionDepth Глубина рекурсии
+ * \param sampler Генератор семплов
+ * \param recursionDepth Глубина рекурсии (вклад пути до луча передается в его весе)
+ * \param scatterPdf Плотность вероятности направления луча в предыдущей точке (0 - первичный луч, зеркальное отражение
+ * или точка без явной выборки источников, излучение учитывается полностью)
  * \return Было ли пересечение с каким-либо объектом сцены
  */
 bool TraceTay(
         const math::Ray &ray,
         const scene::Hittable &sceneElement,
+        const scene::LightList &lights,
+        const PathSettings &path,
         math::Vec3<float> *outColor,
-        unsigned int recursionDepth)
+        samplers::Sampler& sampler,
+        unsigned int recursionDepth,
+        float scatterPdf)
 {
     // Если превышена глубина - отдать черный цвет
-    if(recursionDepth > MAX_RECURSION_DEPTH){
+    if(recursionDepth > path.maxDepth){
         *outColor = {0.0f,0.0f,0.0f};
         return false;
     }
@@ -455,31 +858,69 @@ bool TraceTay(
             // Если материал в точке пересечения разбрасывает лучи
             if(hitInfo.materialPtr->isScatters(ray,hitInfo))
             {
+                // Явная выборка источников (кроме зеркальных материалов) - теневой луч к случайной точке источника
+                // Свет, полученный явной выборкой, не усредняется вместе с разбросанными лучами
+                bool sampleLights = !lights.empty() && !hitInfo.materialPtr->isSpecular();
+                math::Vec3<float> directColor = {0.0f,0.0f,0.0f};
+                if(sampleLights)
+                {
+                    // Значения генератора запрашиваются всегда, чтобы измерения следующих точек не смещались
+                    float uLight = sampler.get1D();
+                    math::Vec2<float> uPoint = sampler.get2D();
+
+                    scene::LightSample lightSample{};
+                    if(lights.sample(hitInfo.point, uLight, uPoint, &lightSample) &&
+                       math::Dot(lightSample.direction, hitInfo.normal) > 0.0f &&
+                       !sceneElement.occluded(math::Ray(hitInfo.point, lightSample.direction), 0.01f, lightSample.distance - 0.01f))
+                    {
+                        // Вес MIS (то же направление могли выбрать SAMPLES_PER_RAY разбросанных лучей)
+                        math::Vec3<float> brdf = hitInfo.materialPtr->eval(ray, hitInfo, lightSample.direction);
+                        float brdfPdf = hitInfo.materialPtr->pdf(ray, hitInfo, lightSample.direction) * static_cast<float>(SAMPLES_PER_RAY);
+                        float weight = lights.lightWeight(lightSample.pdf, brdfPdf);
+                        directColor = brdf * lightSample.emitted * (weight / lightSample.pdf);
+                    }
+                }
+
+                // Русская рулетка - путь с малым вкладом (весом луча) продолжается с вероятностью, равной вкладу
+                // Продолжившиеся пути делятся на эту вероятность, поэтому оценка остается несмещенной
+                float survival = 1.0f;
+                if(recursionDepth >= path.rouletteDepth){
+                    survival = std::min(ray.getWeight(), 1.0f);
+                    if(sampler.get1D() >= survival) survival = 0.0f;
+                }
+
                 // Генерировать заданное кол-во расбросанных лучей
-                for(unsigned s = 0; s < SAMPLES_PER_RAY; s++)
+                for(unsigned s = 0; s < SAMPLES_PER_RAY && survival > 0.0f; s++)
                 {
                     // Затухание для разбросанного луча
                     math::Vec3<float> attenuation = {0.0f,0.0f,0.0f};
-                    // Разбросанный луч
-                    auto scatteredRay = hitInfo.materialPtr->scatteredRay(ray,hitInfo,&attenuation);
+                    // Разбросанный луч (его вес - вклад пути с учетом затухания и рулетки)
+                    auto scatteredRay = hitInfo.materialPtr->scatteredRay(ray,hitInfo,&attenuation,sampler);
+                    scatteredRay.setWeight(ray.getWeight() * render::MaxComponent(attenuation) / survival);
                     // Цвет полученный в результате трассировки луча
                     math::Vec3<float> scatteredRayColor = {0.0f,0.0f,0.0f};
 
+                    // Плотность направления нужна для веса MIS, если луч попадет в источник (только при явной выборке)
+                    float rayPdf = sampleLights ? hitInfo.materialPtr->pdf(ray,hitInfo,scatteredRay.getDirection()) * static_cast<float>(SAMPLES_PER_RAY) : 0.0f;
+
                     // Трассировка луча
-                    TraceTay(scatteredRay,sceneElement,&scatteredRayColor,recursionDepth + 1);
+                    TraceTay(scatteredRay,sceneElement,lights,path,&scatteredRayColor,sampler,recursionDepth + 1,rayPdf);
 
                     // Добавление к результирующему цвету
                     resultColor = resultColor + (attenuation * scatteredRayColor);
                 }
 
                 // Усреднение цвета
-                resultColor = resultColor / static_cast<float>(SAMPLES_PER_RAY);
+                if(survival > 0.0f) resultColor = resultColor / (static_cast<float>(SAMPLES_PER_RAY) * survival);
+                resultColor = resultColor + directColor;
             }
 
             // Если материал в точке пересечения излучает свет
+            // Источник, который мог быть выбран явно в предыдущей точке, учитывается с весом MIS
             if(hitInfo.materialPtr->isEmits(ray,hitInfo))
             {
-                resultColor = resultColor + hitInfo.materialPtr->emittedColor();
+                float weight = scatterPdf > 0.0f ? lights.scatterWeight(scatterPdf, lights.pdf(ray,hitInfo)) : 1.0f;
+                resultColor = resultColor + (hitInfo.materialPtr->emittedColor() * weight);
             }
 
             // Итоговый цвет
@@ -500,3 +941,95 @@ bool TraceTay(
     // Пересечение не засчитано
     return false;
 }
+
+/**
+ * \brief Итеративный метод трассировки сцены лучом (без рекурсии)
+ * \param ray Луч
+ * \param sceneElement Трассируемый элемент
+ * \param lights Источники света для явной выборки
+ * \param path Параметры трассировки путей
+ * \param outColor Результирующий цвет для точки пересечения
+ * \param sampler Генератор семплов
+ * \return Было ли пересечение с каким-либо объектом сцены
+ */
+bool TracePath(
+        const math::Ray &ray,
+        const scene::Hittable &sceneElement,
+        const scene::LightList &lights,
+        const PathSettings &path,
+        math::Vec3<float> *outColor,
+        samplers::Sampler& sampler)
+{
+    // Лучи пути (текущий и разбросанный меняются местами, чтобы не копировать только что записанный луч)
+    math::Ray rays[2] = {ray, {}};
+    unsigned current = 0;
+
+    // Собранный путем свет и затухание пути (доля света точки, доходящая до камеры)
+    math::Vec3<float> radiance = {0.0f,0.0f,0.0f};
+    math::Vec3<float> throughput = {1.0f,1.0f,1.0f};
+
+    // Плотность вероятности направления текущего луча (0 - излучение учитывается без веса MIS)
+    float scatterPdf = 0.0f;
+
+    // Информация о пересечении с объектом и было ли пересечение у первичного луча
+    HitInfo hitInfo{};
+    bool hit = false;
+
+    // Проход по точкам пути (лучи глубже maxDepth не трассируются)
+    for(unsigned depth = 0; depth <= path.maxDepth; depth++)
+    {
+        const math::Ray& currentRay = rays[current];
+
+        // Луч ушел в фон (черный) или попал в объект без материала - путь завершается
+        if(!sceneElement.intersectsRay(currentRay,0.01f,1000.0f,&hitInfo)) break;
+        hit = true;
+        if(hitInfo.materialPtr == nullptr) break;
+        const materials::Material* material = hitInfo.materialPtr;
+
+        // Излучение (источник, который мог быть выбран явно в предыдущей точке, учитывается с весом MIS)
+        if(material->isEmits(currentRay,hitInfo))
+        {
+            float weight = scatterPdf > 0.0f ? lights.scatterWeight(scatterPdf, lights.pdf(currentRay,hitInfo)) : 1.0f;
+            radiance = radiance + (throughput * material->emittedColor() * weight);
+        }
+
+        if(!material->isScatters(currentRay,hitInfo)) break;
+
+        // Явная выборка источников (кроме зеркальных материалов)
+        bool sampleLights = !lights.empty() && !material->isSpecular();
+        if(sampleLights)
+        {
+            float uLight = sampler.get1D();
+            math::Vec2<float> uPoint = sampler.get2D();
+
+            scene::LightSample lightSample{};
+            if(lights.sample(hitInfo.point, uLight, uPoint, &lightSample) &&
+               math::Dot(lightSample.direction, hitInfo.normal) > 0.0f &&
+               !sceneElement.occluded(math::Ray(hitInfo.point, lightSample.direction), 0.01f, lightSample.distance - 0.01f))
+            {
+                math::Vec3<float> brdf = material->eval(currentRay, hitInfo, lightSample.direction);
+                float weight = lights.lightWeight(lightSample.pdf, material->pdf(currentRay, hitInfo, lightSample.direction));
+                radiance = radiance + (throughput * brdf * lightSample.emitted * (weight / lightSample.pdf));
+            }
+        }
+
+        // Русская рулетка по весу луча (вкладу пути)
+        float survival = 1.0f;
+        if(depth >= path.rouletteDepth){
+            survival = std::min(currentRay.getWeight(), 1.0f);
+            if(sampler.get1D() >= survival) break;
+        }
+
+        // Разбросанный луч становится текущим
+        math::Vec3<float> attenuation = {0.0f,0.0f,0.0f};
+        math::Ray& scatteredRay = rays[current ^ 1u];
+        scatteredRay = material->scatteredRay(currentRay,hitInfo,&attenuation,sampler);
+        scatteredRay.setWeight(currentRay.getWeight() * render::MaxComponent(attenuation) / survival);
+        scatterPdf = sampleLights ? material->pdf(currentRay,hitInfo,scatteredRay.getDirection()) : 0.0f;
+        throughput = throughput * attenuation / survival;
+        current ^= 1u;
+    }
+
+    *outColor = radiance;
+    return hit;
+}
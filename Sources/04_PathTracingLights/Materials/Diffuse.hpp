@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../Utils.h"
+#include "../Samplers/Sampler.hpp"
 
 namespace materials
 {
@@ -59,15 +60,16 @@ namespace materials
          * \param rayIn Входной луч
          * \param hitInfo Информация о пересечении с поверхностью
          * \param attenuationOut Затухание для переотраженного луча
+         * \param sampler Генератор семплов (свой у каждого потока)
          * \return Переотраженный луч
          */
-        math::Ray scatteredRay(const math::Ray& rayIn, const HitInfo& hitInfo, math::Vec3<float>* attenuationOut) const override
+        math::Ray scatteredRay(const math::Ray& rayIn, const HitInfo& hitInfo, math::Vec3<float>* attenuationOut, samplers::Sampler& sampler) const override
         {
             // Данные о входном луче не задействованы
             (void) rayIn;
 
             // Отраженный от точки пересечения луч распространяется в случайном направлении в пределах полсуферы
-            math::Ray scattered(hitInfo.point,RndHemisphereVec3(hitInfo.normal));
+            math::Ray scattered(hitInfo.point,HemisphereVec(sampler.get2D(),hitInfo.normal));
 
             // Затухание (потеря света) происхолит по закону косинуса
             // Чем угол между нормалью поверхности и вектором отраженного луча меньше - тем сильнее освещенность
@@ -81,6 +83,49 @@ namespace materials
             return scattered;
         }
 
+        /**
+         * \brief Является ли отражение зеркальным
+         * \return Нет - свет отражается во всю полусферу
+         */
+        bool isSpecular() const override
+        {
+            return false;
+        }
+
+        /**
+         * \brief Доля света, приходящего с заданного направления и отражаемого в сторону входного луча
+         * \param rayIn Входной луч
+         * \param hitInfo Информация о пересечении с поверхностью
+         * \param direction Направление на источник света (единичный вектор)
+         * \return Значение BRDF, умноженное на косинус угла между направлением и нормалью
+         *
+         * \details Разбросанные лучи равномерно распределены по полусфере (плотность 1/2pi), а затухание равно
+         * albedo * cos, поэтому согласованная с ними BRDF равна albedo / 2pi
+         */
+        math::Vec3<float> eval(const math::Ray& rayIn, const HitInfo& hitInfo, const math::Vec3<float>& direction) const override
+        {
+            // Данные о входном луче не задействованы
+            (void) rayIn;
+
+            float cosTheta = std::max(math::Dot(direction,hitInfo.normal),0.0f);
+            return albedo_ * (cosTheta / (2.0f * static_cast<float>(M_PI)));
+        }
+
+        /**
+         * \brief Плотность вероятности того, что scatteredRay выберет заданное направление
+         * \param rayIn Входной луч
+         * \param hitInfo Информация о пересечении с поверхностью
+         * \param direction Направление (единичный вектор)
+         * \return Плотность по телесному углу (равномерно по полусфере)
+         */
+        float pdf(const math::Ray& rayIn, const HitInfo& hitInfo, const math::Vec3<float>& direction) const override
+        {
+            // Данные о входном луче не задействованы
+            (void) rayIn;
+
+            return math::Dot(direction,hitInfo.normal) > 0.0f ? HemispherePdf() : 0.0f;
+        }
+
         /**
          * \brief Излученный цвет
          * \return Цветовой вектор
@@ -58,14 +58,16 @@ namespace materials
          * \param rayIn Входной луч
          * \param hitInfo Информация о пересечении с поверхностью
          * \param attenuationOut Затухание для переотраженного луча
+         * \param sampler Генератор семплов (свой у каждого потока)
          * \return Переотраженный луч
          */
-        math::Ray scatteredRay(const math::Ray& rayIn, const HitInfo& hitInfo, math::Vec3<float>* attenuationOut) const override
+        math::Ray scatteredRay(const math::Ray& rayIn, const HitInfo& hitInfo, math::Vec3<float>* attenuationOut, samplers::Sampler& sampler) const override
         {
-            // Данные о входном луче, пересечении а также указатель на затухание не задействованы
+            // Данные о входном луче, пересечении, указатель на затухание и генератор семплов не задействованы
             (void) rayIn;
             (void) hitInfo;
             (void) attenuationOut;
+            (void) sampler;
 
             // Вернуть пучтой объект
             return {};
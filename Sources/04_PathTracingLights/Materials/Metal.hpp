@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../Utils.h"
+#include "../Samplers/Sampler.hpp"
 
 namespace materials
 {
@@ -62,9 +63,10 @@ namespace materials
          * \param rayIn Входной луч
          * \param hitInfo Информация о пересечении с поверхностью
          * \param attenuationOut Затухание для переотраженного луча
+         * \param sampler Генератор семплов (свой у каждого потока)
          * \return Переотраженный луч
          */
-        math::Ray scatteredRay(const math::Ray& rayIn, const HitInfo& hitInfo, math::Vec3<float>* attenuationOut) const override
+        math::Ray scatteredRay(const math::Ray& rayIn, const HitInfo& hitInfo, math::Vec3<float>* attenuationOut, samplers::Sampler& sampler) const override
         {
             // Данные о входном луче не задействованы
             (void) rayIn;
@@ -73,7 +75,7 @@ namespace materials
             math::Vec3<float> scatteredDir = math::Reflect(rayIn.getDirection(),hitInfo.normal);
 
             // Отраженный от точки пересечения луч распространяется в случайном направлении в пределах полсуферы
-            math::Ray scattered(hitInfo.point,RndHemisphereVec3(scatteredDir,60.0f * roughness_));
+            math::Ray scattered(hitInfo.point,HemisphereVec(sampler.get2D(),scatteredDir,60.0f * roughness_));
 
             // Затухание (потеря света) происхолит по закону косинуса
             // Чем угол между нормалью поверхности и вектором отраженного луча меньше - тем сильнее освещенность
@@ -87,6 +89,49 @@ namespace materials
             return scattered;
         }
 
+        /**
+         * \brief Является ли отражение зеркальным
+         * \return Да только для идеально гладкой поверхности (шероховатая отражает в конус вокруг зеркального направления)
+         */
+        bool isSpecular() const override
+        {
+            return roughness_ <= 0.0f;
+        }
+
+        /**
+         * \brief Доля света, приходящего с заданного направления и отражаемого в сторону входного луча
+         * \param rayIn Входной луч
+         * \param hitInfo Информация о пересечении с поверхностью
+         * \param direction Направление на источник света (единичный вектор)
+         * \return Значение BRDF, умноженное на косинус угла между направлением и нормалью
+         *
+         * \details Затухание разбросанного луча равно albedo * cos, поэтому BRDF равна albedo * pdf - постоянна
+         * внутри конуса отражения и равна нулю вне его
+         */
+        math::Vec3<float> eval(const math::Ray& rayIn, const HitInfo& hitInfo, const math::Vec3<float>& direction) const override
+        {
+            float cosTheta = std::max(math::Dot(direction,hitInfo.normal),0.0f);
+            return albedo_ * (cosTheta * this->pdf(rayIn,hitInfo,direction));
+        }
+
+        /**
+         * \brief Плотность вероятности того, что scatteredRay выберет заданное направление
+         * \param rayIn Входной луч
+         * \param hitInfo Информация о пересечении с поверхностью
+         * \param direction Направление (единичный вектор)
+         * \return Плотность по телесному углу (равномерно внутри конуса вокруг зеркального направления)
+         */
+        float pdf(const math::Ray& rayIn, const HitInfo& hitInfo, const math::Vec3<float>& direction) const override
+        {
+            if(isSpecular()) return 0.0f;
+
+            // Небольшой допуск, чтобы направления с края конуса, выбранные самим scatteredRay, не получали нулевую плотность
+            float thetaMax = 60.0f * roughness_;
+            float cosThetaMax = std::cos(thetaMax/57.2958f);
+            math::Vec3<float> reflected = math::Reflect(rayIn.getDirection(),hitInfo.normal);
+            return math::Dot(direction,reflected) >= cosThetaMax - 1e-4f ? HemispherePdf(thetaMax) : 0.0f;
+        }
+
         /**
          * \brief Излученный цвет
          * \return Цветовой вектор
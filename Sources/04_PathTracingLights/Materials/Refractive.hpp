@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../Utils.h"
+#include "../Samplers/Sampler.hpp"
 
 namespace materials
 {
@@ -75,9 +76,10 @@ namespace materials
          * \param rayIn Входной луч
          * \param hitInfo Информация о пересечении с поверхностью
          * \param attenuationOut Затухание для переотраженного луча
+         * \param sampler Генератор семплов (свой у каждого потока)
          * \return Переотраженный луч
          */
-        math::Ray scatteredRay(const math::Ray& rayIn, const HitInfo& hitInfo, math::Vec3<float>* attenuationOut) const override
+        math::Ray scatteredRay(const math::Ray& rayIn, const HitInfo& hitInfo, math::Vec3<float>* attenuationOut, samplers::Sampler& sampler) const override
         {
             // Коэффициент преломления инвертируется если луч выходит из вещества (удар о нелицевую сторону объекта)
             float refractionIndex = hitInfo.frontFaceSurface ? refractionIndex_ : 1.0f / refractionIndex_;
@@ -88,7 +90,7 @@ namespace materials
             // Если отражательной способности не достаточно - луч преломляется
             // Граница отражательной способности - случайное значение для каждого луча
             // Таким образом объект частично отражает, частично преломляет
-            if(reflectance(rayIn.getDirection(),hitInfo.normal,1.0f/refractionIndex) < RndFloat()){
+            if(reflectance(rayIn.getDirection(),hitInfo.normal,1.0f/refractionIndex) < sampler.get1D()){
                 scatteredDir = math::Refract(rayIn.getDirection(),hitInfo.normal,refractionIndex,true);
             }
 
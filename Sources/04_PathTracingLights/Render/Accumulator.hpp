@@ -0,0 +1,336 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+
+#include <Math.hpp>
+#include <ImageBuffer.hpp>
+#include <Pixel.hpp>
+
+namespace render
+{
+    /**
+     * \brief Наибольшая компонента цвета (по ней оценивается погрешность - яркость недооценивала бы шум
+     * насыщенных красных и синих поверхностей)
+     * \param color Цвет
+     * \return Значение
+     */
+    inline float MaxComponent(const math::Vec3<float>& color)
+    {
+        return std::max(color.r, std::max(color.g, color.b));
+    }
+
+    /**
+     * \brief Семплы пикселя, полученные за один проход
+     *
+     * \details Помимо суммы цветов ведется среднее и сумма квадратов отклонений наибольшей компоненты цвета
+     * (метод Уэлфорда) - для оценки погрешности без хранения отдельных семплов
+     */
+    struct PixelSamples
+    {
+        /// Сумма цветов
+        math::Vec3<float> sum = {0.0f, 0.0f, 0.0f};
+        /// Кол-во семплов
+        uint32_t count = 0;
+        /// Среднее значение
+        float mean = 0.0f;
+        /// Сумма квадратов отклонений от среднего
+        float m2 = 0.0f;
+
+        /**
+         * \brief Добавить семпл
+         * \param color Цвет семпла
+         */
+        void add(const math::Vec3<float>& color)
+        {
+            sum = sum + color;
+            count++;
+
+            float value = MaxComponent(color);
+            float delta = value - mean;
+            mean += delta / static_cast<float>(count);
+            m2 += delta * (value - mean);
+        }
+    };
+
+    /**
+     * \brief Правила распределения семплов между пикселями
+     *
+     * \details При нулевом пороге все пиксели получают одинаковое кол-во семплов (maxSamples). Иначе кадр делится
+     * на блоки, и блок перестает получать семплы, когда погрешность его среднего значения (в пространстве
+     * отображения - после гамма-коррекции) становится ниже порога, а освободившийся бюджет достается шумным блокам.
+     * Оценка по блоку, а не по отдельному пикселю, нужна потому, что при малом кол-ве семплов пиксель, ни разу
+     * не попавший в источник света, выглядит сошедшимся (нулевая дисперсия)
+     */
+    struct AdaptiveSampling
+    {
+        /// Порог погрешности (0 - без адаптивности)
+        float threshold = 0.0f;
+        /// Минимальное кол-во семплов пикселя (до него погрешность не оценивается)
+        uint32_t minSamples = 1;
+        /// Максимальное кол-во семплов пикселя
+        uint32_t maxSamples = 1;
+        /// Размер стороны блока, для которого оценивается погрешность
+        uint32_t blockSize = 8;
+    };
+
+    /**
+     * \brief Накопитель семплов кадра (HDR)
+     *
+     * \details Для каждого пикселя хранится сумма цветов семплов (без ограничения диапазона), кол-во семплов
+     * и статистика наибольшей компоненты цвета (для оценки погрешности при адаптивном семплировании).
+     * Проходы рендеринга добавляют к сумме новые семплы, а отображаемое 8-битное изображение в любой момент можно
+     * получить заново из среднего значения. Это позволяет уточнять изображение прогрессивно - до нужного кол-ва
+     * семплов или до истечения отведенного времени
+     */
+    class Accumulator
+    {
+    private:
+        /// Суммы цветов семплов
+        ImageBuffer<math::Vec3<float>> sums_;
+        /// Кол-во семплов
+        ImageBuffer<uint32_t> counts_;
+        /// Средние значения наибольшей компоненты
+        ImageBuffer<float> means_;
+        /// Суммы квадратов отклонений наибольшей компоненты
+        ImageBuffer<float> m2s_;
+        /// Признаки пикселей, получающих семплы в следующем проходе
+        ImageBuffer<uint8_t> active_;
+
+    public:
+        /**
+         * \brief Основной конструктор
+         * \param width Ширина кадра
+         * \param height Высота кадра
+         */
+        Accumulator(unsigned width, unsigned height):
+        sums_(width, height, {0.0f, 0.0f, 0.0f}),counts_(width, height, 0),means_(width, height, 0.0f),m2s_(width, height, 0.0f),active_(width, height, 1){}
+
+        /**
+         * \brief Получить ширину
+         * \return Ширина кадра
+         */
+        unsigned getWidth() const
+        {
+            return sums_.getWidth();
+        }
+
+        /**
+         * \brief Получить высоту
+         * \return Высота кадра
+         */
+        unsigned getHeight() const
+        {
+            return sums_.getHeight();
+        }
+
+        /**
+         * \brief Очистить накопленные семплы
+         */
+        void clear()
+        {
+            sums_.clear({0.0f, 0.0f, 0.0f});
+            counts_.clear(0);
+            means_.clear(0.0f);
+            m2s_.clear(0.0f);
+            active_.clear(1);
+        }
+
+        /**
+         * \brief Кол-во накопленных семплов пикселя
+         * \param x Координата пикселя по X
+         * \param y Координата пикселя по Y
+         * \return Кол-во семплов
+         */
+        uint32_t getSampleCount(unsigned x, unsigned y) const
+        {
+            return counts_.getData()[y * counts_.getWidth() + x];
+        }
+
+        /**
+         * \brief Средний цвет пикселя
+         * \param x Координата пикселя по X
+         * \param y Координата пикселя по Y
+         * \return Цвет (черный, если семплов нет)
+         */
+        math::Vec3<float> getMean(unsigned x, unsigned y) const
+        {
+            uint32_t count = this->getSampleCount(x, y);
+            if(count == 0) return {0.0f, 0.0f, 0.0f};
+            return sums_.getData()[y * sums_.getWidth() + x] / static_cast<float>(count);
+        }
+
+        /**
+         * \brief Погрешность среднего значения блока пикселей (в пространстве отображения)
+         * \param x0 Левая граница блока
+         * \param y0 Верхняя граница блока
+         * \param x1 Правая граница блока (не включительно)
+         * \param y1 Нижняя граница блока (не включительно)
+         * \param minSamples Минимальное кол-во семплов пикселя, при котором погрешность оценивается
+         * \return Среднеквадратичная стандартная ошибка, пересчитанная через производную гамма-коррекции (sqrt)
+         * в средней точке блока, либо максимальное значение float, если семплов недостаточно
+         *
+         * \details Ошибка делится на производную в среднем значении блока, а не пикселя: иначе пиксели, которые
+         * еще ни разу не попали в источник света (нулевое среднее и дисперсия), выглядели бы сошедшимися
+         */
+        float getBlockError(unsigned x0, unsigned y0, unsigned x1, unsigned y1, uint32_t minSamples) const
+        {
+            double variance = 0.0, mean = 0.0;
+            for(unsigned y = y0; y < y1; y++)
+            {
+                for(unsigned x = x0; x < x1; x++)
+                {
+                    unsigned i = y * sums_.getWidth() + x;
+                    uint32_t count = counts_.getData()[i];
+                    if(count < std::max(minSamples, 2u)) return std::numeric_limits<float>::max();
+
+                    auto n = static_cast<double>(count);
+                    variance += std::max(static_cast<double>(m2s_.getData()[i]), 0.0) / ((n - 1.0) * n);
+                    mean += static_cast<double>(means_.getData()[i]);
+                }
+            }
+
+            auto pixels = static_cast<double>((x1 - x0) * (y1 - y0));
+            return static_cast<float>(std::sqrt(variance / pixels) / (2.0 * std::sqrt(std::max(mean / pixels, 1e-4))));
+        }
+
+        /**
+         * \brief Определить пиксели, получающие семплы в следующем проходе
+         * \param adaptive Правила распределения семплов
+         * \return Кол-во таких пикселей
+         *
+         * \details Вызывается между проходами (во время прохода признаки только читаются, поэтому результат
+         * не зависит от порядка обработки участков)
+         */
+        uint64_t updateActivePixels(const AdaptiveSampling& adaptive)
+        {
+            uint64_t result = 0;
+            const uint32_t blockSize = std::max(adaptive.blockSize, 1u);
+
+            for(unsigned by = 0; by < this->getHeight(); by += blockSize)
+            {
+                for(unsigned bx = 0; bx < this->getWidth(); bx += blockSize)
+                {
+                    unsigned xEnd = std::min(bx + blockSize, this->getWidth());
+                    unsigned yEnd = std::min(by + blockSize, this->getHeight());
+
+                    // Нужны ли блоку семплы (без адаптивности - всегда, иначе по погрешности блока)
+                    bool blockActive = adaptive.threshold <= 0.0f ||
+                            this->getBlockError(bx, by, xEnd, yEnd, adaptive.minSamples) > adaptive.threshold;
+
+                    for(unsigned y = by; y < yEnd; y++){
+                        for(unsigned x = bx; x < xEnd; x++){
+                            bool active = blockActive && this->getSampleCount(x, y) < adaptive.maxSamples;
+                            active_.getData()[y * this->getWidth() + x] = active ? 1 : 0;
+                            if(active) result++;
+                        }
+                    }
+                }
+            }
+
+            return result;
+        }
+
+        /**
+         * \brief Получает ли пиксель семплы в текущем проходе
+         * \param x Координата пикселя по X
+         * \param y Координата пикселя по Y
+         * \return Да или нет
+         */
+        bool isActive(unsigned x, unsigned y) const
+        {
+            return active_.getData()[y * active_.getWidth() + x] != 0;
+        }
+
+        /**
+         * \brief Общее кол-во накопленных семплов
+         * \return Кол-во семплов
+         */
+        uint64_t getTotalSamples() const
+        {
+            uint64_t result = 0;
+            const uint32_t* counts = counts_.getData();
+            for(unsigned i = 0; i < this->getWidth() * this->getHeight(); i++) result += counts[i];
+            return result;
+        }
+
+        /**
+         * \brief Добавить семплы пикселя
+         * \param x Координата пикселя по X
+         * \param y Координата пикселя по Y
+         * \param samples Семплы прохода
+         *
+         * \details Статистика наибольшей компоненты объединяется с накопленной по формуле Чана. Пиксель должен изменяться
+         * только одним потоком одновременно (при обработке по участкам это выполняется автоматически)
+         */
+        void add(unsigned x, unsigned y, const PixelSamples& samples)
+        {
+            if(samples.count == 0) return;
+
+            unsigned i = y * sums_.getWidth() + x;
+            auto n1 = static_cast<float>(counts_.getData()[i]);
+            auto n2 = static_cast<float>(samples.count);
+            float delta = samples.mean - means_.getData()[i];
+
+            sums_.getData()[i] = sums_.getData()[i] + samples.sum;
+            counts_.getData()[i] += samples.count;
+            means_.getData()[i] += delta * n2 / (n1 + n2);
+            m2s_.getData()[i] += samples.m2 + delta * delta * n1 * n2 / (n1 + n2);
+        }
+
+        /**
+         * \brief Получить отображаемое изображение (гамма-коррекция и приведение к 8 битам на канал)
+         * \param target Буфер изображения (тех же размеров)
+         */
+        void resolve(ImageBuffer<Pixel>* target) const
+        {
+            for(unsigned y = 0; y < this->getHeight(); y++)
+            {
+                for(unsigned x = 0; x < this->getWidth(); x++)
+                {
+                    math::Vec3<float> color = this->getMean(x, y);
+
+                    // Гамма коррекция (для гаммы в 2.0)
+                    color = {std::sqrt(color.r), std::sqrt(color.g), std::sqrt(color.b)};
+
+                    target->setPoint(x, y, {
+                            static_cast<uint8_t>(math::Clamp(color.b, 0.0f, 1.0f) * 255.0f),
+                            static_cast<uint8_t>(math::Clamp(color.g, 0.0f, 1.0f) * 255.0f),
+                            static_cast<uint8_t>(math::Clamp(color.r, 0.0f, 1.0f) * 255.0f),
+                            255
+                    });
+                }
+            }
+        }
+
+        /**
+         * \brief Получить карту кол-ва семплов (для отладки адаптивного семплирования)
+         * \param target Буфер изображения (тех же размеров)
+         *
+         * \details Кол-во семплов нормируется на максимальное в кадре и отображается шкалой
+         * "черный - красный - желтый - белый"
+         */
+        void resolveSampleCounts(ImageBuffer<Pixel>* target) const
+        {
+            uint32_t maxCount = 1;
+            const uint32_t* counts = counts_.getData();
+            for(unsigned i = 0; i < this->getWidth() * this->getHeight(); i++) maxCount = std::max(maxCount, counts[i]);
+
+            for(unsigned y = 0; y < this->getHeight(); y++)
+            {
+                for(unsigned x = 0; x < this->getWidth(); x++)
+                {
+                    float value = static_cast<float>(this->getSampleCount(x, y)) / static_cast<float>(maxCount);
+                    target->setPoint(x, y, {
+                            static_cast<uint8_t>(math::Clamp(value * 3.0f - 2.0f, 0.0f, 1.0f) * 255.0f),
+                            static_cast<uint8_t>(math::Clamp(value * 3.0f - 1.0f, 0.0f, 1.0f) * 255.0f),
+                            static_cast<uint8_t>(math::Clamp(value * 3.0f, 0.0f, 1.0f) * 255.0f),
+                            255
+                    });
+                }
+            }
+        }
+    };
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+namespace render
+{
+    /**
+     * \brief Показания аппаратных счетчиков производительности
+     */
+    struct CounterValues
+    {
+        /// Выполненные инструкции
+        uint64_t instructions = 0;
+        /// Промахи кэша данных первого уровня (чтение)
+        uint64_t l1dMisses = 0;
+        /// Обращения к кэшу последнего уровня
+        uint64_t cacheReferences = 0;
+        /// Промахи кэша последнего уровня
+        uint64_t cacheMisses = 0;
+
+        /**
+         * \brief Прибавить показания
+         * \param other Показания
+         * \return Ссылка на себя
+         */
+        CounterValues& operator+=(const CounterValues& other)
+        {
+            instructions += other.instructions;
+            l1dMisses += other.l1dMisses;
+            cacheReferences += other.cacheReferences;
+            cacheMisses += other.cacheMisses;
+            return *this;
+        }
+
+        /**
+         * \brief Разность показаний (прирост счетчиков между двумя замерами)
+         * \param other Более ранние показания
+         * \return Разность
+         */
+        CounterValues operator-(const CounterValues& other) const
+        {
+            CounterValues result;
+            result.instructions = instructions - other.instructions;
+            result.l1dMisses = l1dMisses - other.l1dMisses;
+            result.cacheReferences = cacheReferences - other.cacheReferences;
+            result.cacheMisses = cacheMisses - other.cacheMisses;
+            return result;
+        }
+    };
+
+    /**
+     * \brief Аппаратные счетчики производительности вызывающего потока
+     *
+     * \details Счетчики открываются через perf_event_open (только Linux) и считают события процессора в
+     * пользовательском режиме с момента создания объекта. Объект создается в том потоке, события которого нужно
+     * считать. Если счетчики недоступны (другая ОС, виртуальная машина без PMU, запрет perf_event_paranoid),
+     * available() возвращает false, а показания остаются нулевыми
+     */
+    class PerfCounters
+    {
+    private:
+        /// Кол-во счетчиков
+        static constexpr unsigned kCount = 4;
+        /// Дескрипторы счетчиков (-1 - счетчик не открыт)
+        int fds_[kCount];
+
+#ifdef __linux__
+        /**
+         * \brief Открыть счетчик события для вызывающего потока
+         * \param type Тип события (PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE)
+         * \param config Событие
+         * \return Дескриптор или -1
+         */
+        static int open(uint32_t type, uint64_t config)
+        {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = type;
+            attr.config = config;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+
+        /**
+         * \brief Прочитать значение счетчика
+         * \param fd Дескриптор
+         * \return Значение
+         */
+        static uint64_t value(int fd)
+        {
+            uint64_t result = 0;
+            if(::read(fd, &result, sizeof(result)) != static_cast<ssize_t>(sizeof(result))) return 0;
+            return result;
+        }
+#endif
+
+    public:
+        /**
+         * \brief Конструктор (открывает счетчики вызывающего потока)
+         */
+        PerfCounters():fds_{-1,-1,-1,-1}
+        {
+#ifdef __linux__
+            fds_[0] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+            fds_[1] = open(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+            fds_[2] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES);
+            fds_[3] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+#endif
+        }
+
+        /**
+         * \brief Деструктор (закрывает счетчики)
+         */
+        ~PerfCounters()
+        {
+#ifdef __linux__
+            for(int fd : fds_) if(fd >= 0) ::close(fd);
+#endif
+        }
+
+        PerfCounters(const PerfCounters&) = delete;
+        PerfCounters& operator=(const PerfCounters&) = delete;
+
+        /**
+         * \brief Доступны ли счетчики
+         * \return Открыт ли хотя бы один счетчик
+         */
+        bool available() const
+        {
+            for(int fd : fds_) if(fd >= 0) return true;
+            return false;
+        }
+
+        /**
+         * \brief Текущие показания (недоступные счетчики дают ноль)
+         * \return Показания
+         */
+        CounterValues read() const
+        {
+            CounterValues result;
+#ifdef __linux__
+            if(fds_[0] >= 0) result.instructions = value(fds_[0]);
+            if(fds_[1] >= 0) result.l1dMisses = value(fds_[1]);
+            if(fds_[2] >= 0) result.cacheReferences = value(fds_[2]);
+            if(fds_[3] >= 0) result.cacheMisses = value(fds_[3]);
+#endif
+            return result;
+        }
+    };
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "ThreadPool.hpp"
+#include "TileScheduler.hpp"
+
+namespace render
+{
+    /**
+     * \brief Исполнитель кадров (постоянный пул потоков и планировщик участков)
+     *
+     * \details Потоки живут все время существования объекта, поэтому повторный рендеринг (прогрессивный или
+     * анимация) не тратит время на их создание. Кадр выдается методом submit, который сразу возвращает
+     * управление; завершение проверяется методом poll или ожидается методом wait. Функтор обработки участка
+     * и все, что он использует, должны существовать до завершения кадра
+     */
+    class Renderer
+    {
+    private:
+        /// Размер стороны участка
+        uint32_t tileSize_;
+        /// Планировщик участков текущего кадра
+        std::unique_ptr<TileScheduler> scheduler_;
+        /// Функтор обработки участка текущего кадра
+        std::function<void(const Tile&, unsigned)> renderTile_;
+        /// Пул потоков (объявлен последним, чтобы быть уничтоженным первым - до планировщика и функтора)
+        ThreadPool pool_;
+
+    public:
+        /**
+         * \brief Основной конструктор
+         * \param threads Кол-во потоков
+         * \param tileSize Размер стороны участка
+         * \param affinity Привязка потоков к ядрам
+         */
+        explicit Renderer(unsigned threads, uint32_t tileSize = 16, ThreadAffinity affinity = eAffinityNone):
+        tileSize_(tileSize),scheduler_(nullptr),renderTile_(),pool_(threads, affinity){}
+
+        /**
+         * \brief Получить кол-во потоков
+         * \return Кол-во потоков
+         */
+        unsigned getThreadCount() const
+        {
+            return pool_.getThreadCount();
+        }
+
+        /**
+         * \brief Выдать кадр на обработку (не дожидаясь завершения)
+         * \param width Ширина кадра
+         * \param height Высота кадра
+         * \param renderTile Функтор вида void(const Tile& tile, unsigned thread)
+         *
+         * \details Если предыдущий кадр еще обрабатывается - сначала дожидается его завершения
+         */
+        void submit(uint32_t width, uint32_t height, std::function<void(const Tile&, unsigned)> renderTile)
+        {
+            pool_.wait();
+
+            // Участки перестраиваются только при изменении размеров кадра
+            if(scheduler_ == nullptr || scheduler_->getTiles().empty() ||
+               scheduler_->getTiles().back().x + scheduler_->getTiles().back().width != width ||
+               scheduler_->getTiles().back().y + scheduler_->getTiles().back().height != height)
+            {
+                scheduler_.reset(new TileScheduler(width, height, tileSize_));
+            }
+
+            renderTile_ = std::move(renderTile);
+            scheduler_->begin(pool_.getThreadCount());
+            pool_.dispatch([this](unsigned thread){
+                scheduler_->work(thread, renderTile_);
+            });
+        }
+
+        /**
+         * \brief Завершена ли обработка кадра (не блокирует)
+         * \return Да или нет
+         */
+        bool poll()
+        {
+            return pool_.isIdle();
+        }
+
+        /**
+         * \brief Дождаться завершения кадра
+         * \return Статистика обработки участков
+         */
+        TileStats wait()
+        {
+            pool_.wait();
+            return scheduler_ != nullptr ? scheduler_->finish() : TileStats{};
+        }
+    };
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace render
+{
+    /**
+     * \brief Привязка потоков к ядрам процессора
+     */
+    enum ThreadAffinity
+    {
+        /// Без привязки (потоками распоряжается операционная система)
+        eAffinityNone,
+        /// Поток i закрепляется за логическим процессором i (кэши ядра не теряются между кадрами)
+        eAffinityPinned,
+    };
+
+    /**
+     * \brief Пул постоянных рабочих потоков
+     *
+     * \details Потоки создаются один раз и ожидают задания на условной переменной. Задание - функция, которая
+     * вызывается один раз в каждом потоке с его индексом (распределение работы внутри задания - забота
+     * вызывающего). Выдача задания не блокирует вызывающий поток, завершение можно ожидать или проверять
+     */
+    class ThreadPool
+    {
+    private:
+        /// Рабочие потоки
+        std::vector<std::thread> threads_;
+        /// Блокировка состояния пула
+        std::mutex mutex_;
+        /// Условная переменная появления задания (или остановки пула)
+        std::condition_variable wakeCondition_;
+        /// Условная переменная завершения задания всеми потоками
+        std::condition_variable doneCondition_;
+        /// Текущее задание
+        std::function<void(unsigned)> job_;
+        /// Номер текущего задания (потоки сравнивают его с номером последнего выполненного)
+        uint64_t generation_;
+        /// Кол-во потоков, еще не закончивших текущее задание
+        unsigned active_;
+        /// Признак остановки пула
+        bool stop_;
+
+        /**
+         * \brief Закрепить текущий поток за логическим процессором
+         * \param processor Индекс логического процессора
+         */
+        static void pinCurrentThread(unsigned processor)
+        {
+#ifdef _WIN32
+            SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(1) << (processor % (sizeof(DWORD_PTR) * 8)));
+#else
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(processor % CPU_SETSIZE, &set);
+            pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+        }
+
+        /**
+         * \brief Цикл рабочего потока
+         * \param index Индекс потока
+         */
+        void workerLoop(unsigned index)
+        {
+            uint64_t done = 0;
+            while(true)
+            {
+                std::function<void(unsigned)> job;
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    wakeCondition_.wait(lock, [&](){ return stop_ || generation_ != done; });
+                    if(stop_) return;
+                    done = generation_;
+                    job = job_;
+                }
+
+                job(index);
+
+                std::lock_guard<std::mutex> lock(mutex_);
+                if(--active_ == 0) doneCondition_.notify_all();
+            }
+        }
+
+    public:
+        /**
+         * \brief Основной конструктор
+         * \param threads Кол-во потоков
+         * \param affinity Привязка потоков к ядрам
+         */
+        explicit ThreadPool(unsigned threads, ThreadAffinity affinity = eAffinityNone):generation_(0),active_(0),stop_(false)
+        {
+            threads = std::max(threads, 1u);
+            unsigned processors = std::max(1u, std::thread::hardware_concurrency());
+
+            for(unsigned i = 0; i < threads; i++){
+                threads_.emplace_back([this, i, affinity, processors](){
+                    if(affinity == eAffinityPinned) pinCurrentThread(i % processors);
+                    this->workerLoop(i);
+                });
+            }
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        /**
+         * \brief Деструктор (дожидается текущего задания и останавливает потоки)
+         */
+        ~ThreadPool()
+        {
+            this->wait();
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stop_ = true;
+            }
+            wakeCondition_.notify_all();
+            for(auto& thread : threads_) thread.join();
+        }
+
+        /**
+         * \brief Получить кол-во потоков
+         * \return Кол-во потоков
+         */
+        unsigned getThreadCount() const
+        {
+            return static_cast<unsigned>(threads_.size());
+        }
+
+        /**
+         * \brief Выдать задание всем потокам (не дожидаясь его выполнения)
+         * \param job Функция вида void(unsigned thread), вызывается один раз в каждом потоке
+         *
+         * \details Если предыдущее задание еще выполняется - сначала дожидается его завершения
+         */
+        void dispatch(std::function<void(unsigned)> job)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                doneCondition_.wait(lock, [&](){ return active_ == 0; });
+                job_ = std::move(job);
+                active_ = static_cast<unsigned>(threads_.size());
+                generation_++;
+            }
+            wakeCondition_.notify_all();
+        }
+
+        /**
+         * \brief Выполнено ли текущее задание (не блокирует)
+         * \return Да или нет
+         */
+        bool isIdle()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return active_ == 0;
+        }
+
+        /**
+         * \brief Дождаться выполнения текущего задания
+         */
+        void wait()
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            doneCondition_.wait(lock, [&](){ return active_ == 0; });
+        }
+    };
+}
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include <memory>
+#include <cstdint>
+
+namespace render
+{
+    /**
+     * \brief Прямоугольный участок кадра
+     */
+    struct Tile
+    {
+        /// Левая граница
+        uint32_t x;
+        /// Верхняя граница
+        uint32_t y;
+        /// Ширина
+        uint32_t width;
+        /// Высота
+        uint32_t height;
+    };
+
+    /**
+     * \brief Статистика выполнения (для оценки загрузки потоков)
+     */
+    struct TileStats
+    {
+        /// Общее время выполнения (мс)
+        double wallMilliseconds = 0.0;
+        /// Время обработки каждого участка (мс, в порядке участков)
+        std::vector<float> tileMilliseconds;
+        /// Суммарное время работы каждого потока (мс)
+        std::vector<double> busyMilliseconds;
+        /// Кол-во обработанных каждым потоком участков
+        std::vector<uint32_t> tilesPerThread;
+        /// Кол-во участков, забранных из чужих очередей
+        uint32_t steals = 0;
+
+        /**
+         * \brief Загрузка потоков
+         * \return Доля времени, которую потоки были заняты работой (от 0 до 1)
+         */
+        double utilization() const
+        {
+            if(busyMilliseconds.empty() || wallMilliseconds <= 0.0) return 0.0;
+            double busy = 0.0;
+            for(double value : busyMilliseconds) busy += value;
+            return busy / (wallMilliseconds * static_cast<double>(busyMilliseconds.size()));
+        }
+
+        /**
+         * \brief Время обработки самого долгого участка
+         * \return Время (мс)
+         */
+        float slowestTile() const
+        {
+            return tileMilliseconds.empty() ? 0.0f : *std::max_element(tileMilliseconds.begin(), tileMilliseconds.end());
+        }
+    };
+
+    /**
+     * \brief Планировщик обработки кадра по участкам с перехватом работы (work stealing)
+     *
+     * \details Кадр делится на квадратные участки, которые изначально распределяются между потоками непрерывными
+     * блоками (соседние участки обрабатываются одним потоком). Поток берет участки из начала своей очереди, а когда
+     * она пуста - забирает участок из конца очереди другого потока. Так потоки, которым достались простые участки,
+     * помогают потокам со сложными, и никто не простаивает до конца кадра
+     */
+    class TileScheduler
+    {
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        /**
+         * \brief Очередь участков потока
+         */
+        struct Queue
+        {
+            /// Блокировка (захватывается на время извлечения одного участка)
+            std::mutex mutex;
+            /// Индексы участков
+            std::deque<uint32_t> tiles;
+        };
+
+        /// Участки кадра
+        std::vector<Tile> tiles_;
+        /// Очереди участков потоков
+        std::unique_ptr<Queue[]> queues_;
+        /// Кол-во потоков текущего кадра
+        unsigned threads_;
+        /// Кол-во участков, забранных из чужих очередей
+        std::atomic<uint32_t> steals_;
+        /// Статистика текущего кадра
+        TileStats stats_;
+        /// Момент начала кадра
+        Clock::time_point beginTime_;
+        /// Момент завершения работы каждого потока
+        std::vector<Clock::time_point> endTimes_;
+
+    public:
+        /**
+         * \brief Основной конструктор
+         * \param width Ширина кадра
+         * \param height Высота кадра
+         * \param tileSize Размер стороны участка
+         */
+        TileScheduler(uint32_t width = 0, uint32_t height = 0, uint32_t tileSize = 16):threads_(0),steals_(0)
+        {
+            tileSize = std::max(tileSize, 1u);
+            for(uint32_t y = 0; y < height; y += tileSize){
+                for(uint32_t x = 0; x < width; x += tileSize){
+                    tiles_.push_back({x, y, std::min(tileSize, width - x), std::min(tileSize, height - y)});
+                }
+            }
+        }
+
+        /**
+         * \brief Получить участки кадра
+         * \return Константная ссылка на массив участков
+         */
+        const std::vector<Tile>& getTiles() const
+        {
+            return tiles_;
+        }
+
+        /**
+         * \brief Начать обработку кадра (распределить участки по очередям потоков)
+         * \param threads Кол-во потоков
+         *
+         * \details Вызывается до запуска потоков. Участки распределяются непрерывными блоками
+         */
+        void begin(unsigned threads)
+        {
+            threads_ = std::max(threads, 1u);
+            queues_.reset(new Queue[threads_]);
+
+            auto tileCount = static_cast<uint32_t>(tiles_.size());
+            for(unsigned i = 0; i < threads_; i++){
+                uint32_t from = static_cast<uint32_t>(static_cast<uint64_t>(tileCount) * i / threads_);
+                uint32_t to = static_cast<uint32_t>(static_cast<uint64_t>(tileCount) * (i + 1) / threads_);
+                for(uint32_t t = from; t < to; t++) queues_[i].tiles.push_back(t);
+            }
+
+            stats_ = TileStats{};
+            stats_.tileMilliseconds.resize(tiles_.size(), 0.0f);
+            stats_.busyMilliseconds.resize(threads_, 0.0);
+            stats_.tilesPerThread.resize(threads_, 0);
+            steals_ = 0;
+            beginTime_ = Clock::now();
+            endTimes_.assign(threads_, beginTime_);
+        }
+
+        /**
+         * \brief Получить следующий участок для потока
+         * \param thread Индекс потока
+         * \param tileOut Индекс участка
+         * \return Есть ли еще работа (false - все участки разобраны, новые не появятся)
+         */
+        bool next(unsigned thread, uint32_t* tileOut)
+        {
+            // Сначала своя очередь (с начала)
+            {
+                std::lock_guard<std::mutex> lock(queues_[thread].mutex);
+                if(!queues_[thread].tiles.empty()){
+                    *tileOut = queues_[thread].tiles.front();
+                    queues_[thread].tiles.pop_front();
+                    return true;
+                }
+            }
+
+            // Затем чужие (с конца, начиная с соседнего потока)
+            for(unsigned offset = 1; offset < threads_; offset++){
+                Queue& victim = queues_[(thread + offset) % threads_];
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                if(!victim.tiles.empty()){
+                    *tileOut = victim.tiles.back();
+                    victim.tiles.pop_back();
+                    steals_++;
+                    return true;
+                }
+            }
+
+            endTimes_[thread] = Clock::now();
+            return false;
+        }
+
+        /**
+         * \brief Обработка участков одним потоком (до тех пор, пока работа не закончится)
+         * \tparam F Тип функтора обработки участка
+         * \param thread Индекс потока
+         * \param processTile Функтор вида void(const Tile& tile, unsigned thread)
+         */
+        template <typename F>
+        void work(unsigned thread, F&& processTile)
+        {
+            uint32_t tile = 0;
+            while(this->next(thread, &tile))
+            {
+                auto tileBeginTime = Clock::now();
+                processTile(tiles_[tile], thread);
+                auto milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - tileBeginTime).count();
+
+                stats_.tileMilliseconds[tile] = static_cast<float>(milliseconds);
+                stats_.busyMilliseconds[thread] += milliseconds;
+                stats_.tilesPerThread[thread]++;
+            }
+        }
+
+        /**
+         * \brief Завершить обработку кадра
+         * \return Статистика выполнения
+         *
+         * \details Вызывается после завершения работы всех потоков
+         */
+        TileStats finish()
+        {
+            Clock::time_point endTime = beginTime_;
+            for(const auto& time : endTimes_) endTime = std::max(endTime, time);
+            stats_.wallMilliseconds = std::chrono::duration<double, std::milli>(endTime - beginTime_).count();
+            stats_.steals = steals_.load();
+            return stats_;
+        }
+    };
+}
@@ -0,0 +1,355 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include <Math.hpp>
+#include <Ray.hpp>
+
+#include "../Utils.h"
+#include "../Samplers/Sampler.hpp"
+#include "../Scene/Lights.hpp"
+#include "Accumulator.hpp"
+
+namespace render
+{
+    /**
+     * \brief Волновая (потоковая) трассировка путей
+     *
+     * \details Вместо прохода каждого пути от начала до конца все пути пакета продвигаются на одну точку за шаг,
+     * а шаг разбит на стадии, каждая из которых проходит по всем путям: поиск пересечений, группировка путей
+     * по материалу, обработка материалов (излучение, выбор точки на источнике, рулетка, разброс луча) и
+     * трассировка теневых лучей. Состояние путей хранится отдельными массивами по полям, поэтому стадия
+     * затрагивает только нужные ей поля, а пути с одинаковым материалом обрабатываются подряд (одни и те же
+     * ветви и виртуальные методы). Завершившиеся пути убираются из списка активных после каждого шага.
+     *
+     * Вторичные лучи после диффузного отражения направлены куда угодно, и соседние в списке пути обходят разные
+     * части иерархии объемов. При включенной сортировке лучей (setRaySorting) перед поиском пересечений
+     * вторичные лучи упорядочиваются по ключу из октанта направления и кода Мортона начала луча, чтобы подряд
+     * шли лучи из близких точек в близких направлениях и обход использовал уже загруженные в кэш узлы.
+     *
+     * Значения генератора семплов запрашиваются в том же порядке, что и при итеративной трассировке (TracePath),
+     * поэтому результат совпадает с ней (и не зависит от порядка путей). Объект хранит буферы между пакетами,
+     * каждый поток использует собственный
+     */
+    class Wavefront
+    {
+    private:
+        /// Текущие лучи путей (вес луча - вклад пути для "русской рулетки")
+        std::vector<math::Ray> rays_;
+        /// Затухание путей
+        std::vector<math::Vec3<float>> throughputs_;
+        /// Собранный путями свет
+        std::vector<math::Vec3<float>> radiances_;
+        /// Плотности вероятности направлений текущих лучей (0 - излучение учитывается без веса MIS)
+        std::vector<float> scatterPdfs_;
+        /// Состояния генератора семплов
+        std::vector<samplers::Sampler::State> samplerStates_;
+        /// Пересечения текущих лучей
+        std::vector<HitInfo> hits_;
+
+        /// Индексы активных путей
+        std::vector<uint32_t> active_;
+        /// Индексы путей, продолжающихся на следующем шаге
+        std::vector<uint32_t> next_;
+        /// Индексы активных путей, сгруппированные по материалу
+        std::vector<uint32_t> sorted_;
+        /// Номер группы материала для каждого активного пути
+        std::vector<uint32_t> groups_;
+        /// Материалы групп (в порядке появления)
+        std::vector<const materials::Material*> groupMaterials_;
+        /// Начала групп в массиве sorted_
+        std::vector<uint32_t> groupOffsets_;
+
+        /// Сортировка вторичных лучей перед поиском пересечений
+        bool sortRays_ = false;
+        /// Ключи сортировки активных путей
+        std::vector<uint32_t> keys_;
+        /// Промежуточные буферы поразрядной сортировки (ключи и индексы путей)
+        std::vector<uint32_t> keysTemp_;
+        std::vector<uint32_t> activeTemp_;
+
+        /// Пути теневых лучей
+        std::vector<uint32_t> shadowPaths_;
+        /// Теневые лучи
+        std::vector<math::Ray> shadowRays_;
+        /// Расстояния до точек на источниках
+        std::vector<float> shadowDistances_;
+        /// Вклад источника при отсутствии преград
+        std::vector<math::Vec3<float>> shadowContributions_;
+
+        /**
+         * \brief Разрядить 9 младших бит числа (между каждыми двумя битами вставляются два нулевых)
+         * \param v Исходное число
+         * \return Разреженное 27-битное число
+         */
+        static uint32_t expandBits9(uint32_t v)
+        {
+            v &= 0x1ffu;
+            v = (v * 0x00010001u) & 0xFF0000FFu;
+            v = (v * 0x00000101u) & 0x0F00F00Fu;
+            v = (v * 0x00000011u) & 0xC30C30C3u;
+            v = (v * 0x00000005u) & 0x49249249u;
+            return v;
+        }
+
+        /**
+         * \brief Стадия упорядочивания лучей (по октанту направления, затем по коду Мортона начала луча)
+         *
+         * \details Начала лучей квантуются до 9 бит на ось в пределах их общего описывающего параллелепипеда,
+         * старшие 3 бита ключа - знаки компонент направления. Ключи сортируются поразрядно (4 прохода по 8 бит),
+         * сортировка устойчива, поэтому лучи с одинаковым ключом сохраняют исходный порядок
+         */
+        void sortByRayKey()
+        {
+            const size_t count = active_.size();
+
+            // Общий описывающий параллелепипед начал лучей
+            math::BBox<> bounds = math::EmptyBBox<float>();
+            for(uint32_t path : active_) bounds = math::Union(bounds, rays_[path].getOrigin());
+            math::Vec3<float> extent = bounds.max - bounds.min;
+            math::Vec3<float> scale = {
+                    extent.x > 0.0f ? 511.0f / extent.x : 0.0f,
+                    extent.y > 0.0f ? 511.0f / extent.y : 0.0f,
+                    extent.z > 0.0f ? 511.0f / extent.z : 0.0f};
+
+            // Ключи
+            keys_.resize(count);
+            for(size_t i = 0; i < count; i++)
+            {
+                const math::Ray& ray = rays_[active_[i]];
+                math::Vec3<float> cell = (ray.getOrigin() - bounds.min) * scale;
+                auto x = static_cast<uint32_t>(std::min(std::max(cell.x, 0.0f), 511.0f));
+                auto y = static_cast<uint32_t>(std::min(std::max(cell.y, 0.0f), 511.0f));
+                auto z = static_cast<uint32_t>(std::min(std::max(cell.z, 0.0f), 511.0f));
+                uint32_t octant =
+                        (ray.getDirection().x < 0.0f ? 4u : 0u) |
+                        (ray.getDirection().y < 0.0f ? 2u : 0u) |
+                        (ray.getDirection().z < 0.0f ? 1u : 0u);
+                keys_[i] = (octant << 27u) | (expandBits9(x) << 2u) | (expandBits9(y) << 1u) | expandBits9(z);
+            }
+
+            // Поразрядная сортировка (30-битный ключ - 4 прохода по 8 бит)
+            keysTemp_.resize(count);
+            activeTemp_.resize(count);
+            for(unsigned shift = 0; shift < 32; shift += 8)
+            {
+                uint32_t offsets[257] = {};
+                for(uint32_t key : keys_) offsets[((key >> shift) & 0xffu) + 1]++;
+                for(unsigned b = 1; b < 257; b++) offsets[b] += offsets[b - 1];
+                for(size_t i = 0; i < count; i++)
+                {
+                    uint32_t position = offsets[(keys_[i] >> shift) & 0xffu]++;
+                    keysTemp_[position] = keys_[i];
+                    activeTemp_[position] = active_[i];
+                }
+                keys_.swap(keysTemp_);
+                active_.swap(activeTemp_);
+            }
+        }
+
+        /**
+         * \brief Стадия поиска пересечений (пути, луч которых ушел в фон или попал в объект без материала, завершаются)
+         * \param scene Сцена
+         */
+        void intersect(const scene::Hittable& scene)
+        {
+            size_t count = 0;
+            for(uint32_t path : active_)
+            {
+                HitInfo& hit = hits_[path];
+                if(scene.intersectsRay(rays_[path], 0.01f, 1000.0f, &hit) && hit.materialPtr != nullptr){
+                    active_[count++] = path;
+                }
+            }
+            active_.resize(count);
+        }
+
+        /**
+         * \brief Стадия группировки путей по материалу (сортировка подсчетом - материалов в сцене немного)
+         */
+        void sortByMaterial()
+        {
+            groupMaterials_.clear();
+            groups_.resize(active_.size());
+
+            for(size_t i = 0; i < active_.size(); i++)
+            {
+                const materials::Material* material = hits_[active_[i]].materialPtr;
+                auto it = std::find(groupMaterials_.begin(), groupMaterials_.end(), material);
+                groups_[i] = static_cast<uint32_t>(it - groupMaterials_.begin());
+                if(it == groupMaterials_.end()) groupMaterials_.push_back(material);
+            }
+
+            groupOffsets_.assign(groupMaterials_.size() + 1, 0);
+            for(uint32_t group : groups_) groupOffsets_[group + 1]++;
+            for(size_t g = 1; g < groupOffsets_.size(); g++) groupOffsets_[g] += groupOffsets_[g - 1];
+
+            sorted_.resize(active_.size());
+            for(size_t i = 0; i < active_.size(); i++){
+                sorted_[groupOffsets_[groups_[i]]++] = active_[i];
+            }
+        }
+
+        /**
+         * \brief Стадия обработки материалов (пути идут группами одного материала)
+         * \param lights Источники света для явной выборки
+         * \param depth Глубина текущего шага
+         * \param rouletteDepth Глубина, начиная с которой применяется "русская рулетка"
+         * \param sampler Генератор семплов (состояние каждого пути восстанавливается)
+         */
+        void shade(const scene::LightList& lights, unsigned depth, unsigned rouletteDepth, samplers::Sampler& sampler)
+        {
+            next_.clear();
+            shadowPaths_.clear();
+            shadowRays_.clear();
+            shadowDistances_.clear();
+            shadowContributions_.clear();
+
+            for(uint32_t path : sorted_)
+            {
+                const math::Ray& ray = rays_[path];
+                const HitInfo& hit = hits_[path];
+                const materials::Material* material = hit.materialPtr;
+                math::Vec3<float>& throughput = throughputs_[path];
+
+                // Излучение (источник, который мог быть выбран явно в предыдущей точке, учитывается с весом MIS)
+                if(material->isEmits(ray, hit))
+                {
+                    float weight = scatterPdfs_[path] > 0.0f ? lights.scatterWeight(scatterPdfs_[path], lights.pdf(ray, hit)) : 1.0f;
+                    radiances_[path] = radiances_[path] + (throughput * material->emittedColor() * weight);
+                }
+
+                if(!material->isScatters(ray, hit)) continue;
+                sampler.setState(samplerStates_[path]);
+
+                // Явная выборка источников - теневой луч откладывается до стадии трассировки теневых лучей
+                bool sampleLights = !lights.empty() && !material->isSpecular();
+                if(sampleLights)
+                {
+                    float uLight = sampler.get1D();
+                    math::Vec2<float> uPoint = sampler.get2D();
+
+                    scene::LightSample lightSample{};
+                    if(lights.sample(hit.point, uLight, uPoint, &lightSample) && math::Dot(lightSample.direction, hit.normal) > 0.0f)
+                    {
+                        math::Vec3<float> brdf = material->eval(ray, hit, lightSample.direction);
+                        float weight = lights.lightWeight(lightSample.pdf, material->pdf(ray, hit, lightSample.direction));
+                        shadowPaths_.push_back(path);
+                        shadowRays_.emplace_back(hit.point, lightSample.direction);
+                        shadowDistances_.push_back(lightSample.distance);
+                        shadowContributions_.push_back(throughput * brdf * lightSample.emitted * (weight / lightSample.pdf));
+                    }
+                }
+
+                // Русская рулетка по весу луча (вкладу пути)
+                float survival = 1.0f;
+                if(depth >= rouletteDepth){
+                    survival = std::min(ray.getWeight(), 1.0f);
+                    if(sampler.get1D() >= survival) continue;
+                }
+
+                // Разбросанный луч заменяет текущий
+                math::Vec3<float> attenuation = {0.0f,0.0f,0.0f};
+                math::Ray scattered = material->scatteredRay(ray, hit, &attenuation, sampler);
+                scattered.setWeight(ray.getWeight() * MaxComponent(attenuation) / survival);
+                scatterPdfs_[path] = sampleLights ? material->pdf(ray, hit, scattered.getDirection()) : 0.0f;
+                throughput = throughput * attenuation / survival;
+                rays_[path] = scattered;
+
+                samplerStates_[path] = sampler.getState();
+                next_.push_back(path);
+            }
+        }
+
+        /**
+         * \brief Стадия трассировки теневых лучей (свет источника добавляется путям, для которых он не перекрыт)
+         * \param scene Сцена
+         */
+        void traceShadows(const scene::Hittable& scene)
+        {
+            for(size_t i = 0; i < shadowPaths_.size(); i++)
+            {
+                if(!scene.occluded(shadowRays_[i], 0.01f, shadowDistances_[i] - 0.01f)){
+                    uint32_t path = shadowPaths_[i];
+                    radiances_[path] = radiances_[path] + shadowContributions_[i];
+                }
+            }
+        }
+
+    public:
+        /**
+         * \brief Включить или выключить упорядочивание вторичных лучей перед поиском пересечений
+         * \param enabled Упорядочивать ли лучи
+         */
+        void setRaySorting(bool enabled)
+        {
+            sortRays_ = enabled;
+        }
+
+        /**
+         * \brief Убрать все пути (буферы сохраняются для следующего пакета)
+         */
+        void clear()
+        {
+            rays_.clear();
+            throughputs_.clear();
+            radiances_.clear();
+            scatterPdfs_.clear();
+            samplerStates_.clear();
+        }
+
+        /**
+         * \brief Добавить путь
+         * \param ray Первичный луч
+         * \param samplerState Состояние генератора семплов после выбора первичного луча
+         * \return Индекс пути
+         */
+        uint32_t addPath(const math::Ray& ray, const samplers::Sampler::State& samplerState)
+        {
+            rays_.push_back(ray);
+            throughputs_.push_back({1.0f,1.0f,1.0f});
+            radiances_.push_back({0.0f,0.0f,0.0f});
+            scatterPdfs_.push_back(0.0f);
+            samplerStates_.push_back(samplerState);
+            return static_cast<uint32_t>(rays_.size() - 1);
+        }
+
+        /**
+         * \brief Трассировка всех добавленных путей
+         * \param scene Сцена
+         * \param lights Источники света для явной выборки
+         * \param maxDepth Максимальная глубина пути
+         * \param rouletteDepth Глубина, начиная с которой пути прерываются "русской рулеткой"
+         * \param sampler Генератор семплов
+         */
+        void trace(const scene::Hittable& scene, const scene::LightList& lights, unsigned maxDepth, unsigned rouletteDepth, samplers::Sampler& sampler)
+        {
+            hits_.resize(rays_.size());
+            active_.resize(rays_.size());
+            for(size_t i = 0; i < active_.size(); i++) active_[i] = static_cast<uint32_t>(i);
+
+            for(unsigned depth = 0; depth <= maxDepth && !active_.empty(); depth++)
+            {
+                // Первичные лучи и так идут по пикселям участка (когерентны), упорядочиваются только вторичные
+                if(sortRays_ && depth > 0) sortByRayKey();
+                intersect(scene);
+                sortByMaterial();
+                shade(lights, depth, rouletteDepth, sampler);
+                traceShadows(scene);
+                active_.swap(next_);
+            }
+        }
+
+        /**
+         * \brief Собранный путем свет
+         * \param path Индекс пути
+         * \return Цвет
+         */
+        const math::Vec3<float>& getRadiance(uint32_t path) const
+        {
+            return radiances_[path];
+        }
+    };
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "Sampler.hpp"
+
+namespace samplers
+{
+    /**
+     * \brief Семплы последовательности Холтона
+     *
+     * \details Измерение d - обратная запись индекса семпла в системе счисления с основанием, равным d-му простому
+     * числу. Чтобы соседние пиксели не получали одинаковые значения, последовательность каждого пикселя и измерения
+     * сдвигается на случайную величину (поворот Кренли-Паттерсона). Измерения за пределами таблицы простых чисел
+     * заполняются псевдослучайными значениями
+     */
+    class Halton : public Sampler
+    {
+    private:
+        /// Кол-во измерений с собственным основанием
+        static const uint32_t kMaxDimensions = 32;
+
+        /**
+         * \brief Основание системы счисления для измерения
+         * \param dimension Измерение
+         * \return Простое число
+         */
+        static uint32_t prime(uint32_t dimension)
+        {
+            static const uint32_t primes[kMaxDimensions] = {
+                    2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53,
+                    59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109, 113, 127, 131};
+            return primes[dimension];
+        }
+
+        /**
+         * \brief Обратная запись числа относительно запятой (radical inverse)
+         * \param index Число
+         * \param base Основание системы счисления
+         * \return Значение в пределах [0, 1)
+         */
+        static float radicalInverse(uint32_t index, uint32_t base)
+        {
+            const double inverseBase = 1.0 / static_cast<double>(base);
+            double factor = inverseBase;
+            double result = 0.0;
+            while(index > 0){
+                result += static_cast<double>(index % base) * factor;
+                index /= base;
+                factor *= inverseBase;
+            }
+            return static_cast<float>(result);
+        }
+
+        /**
+         * \brief Значение для измерения текущего семпла
+         * \param dimension Измерение
+         * \return Значение в пределах [0, 1)
+         */
+        float sample(uint32_t dimension)
+        {
+            if(dimension >= kMaxDimensions) return rng_.nextFloat();
+
+            float value = radicalInverse(sampleIndex_, prime(dimension)) + ToUnitFloat(this->dimensionSeed(dimension));
+            value -= std::floor(value);
+            return std::min(value, 0.99999994f);
+        }
+
+    public:
+        /**
+         * \brief Основной конструктор
+         * \param samplesPerPixel Кол-во семплов на пиксель
+         */
+        explicit Halton(unsigned samplesPerPixel = 1):Sampler(samplesPerPixel){}
+
+        /**
+         * \brief Копия генератора
+         * \return Умный указатель на копию
+         */
+        std::unique_ptr<Sampler> clone() const override
+        {
+            return std::unique_ptr<Sampler>(new Halton(*this));
+        }
+
+        /**
+         * \brief Значение для следующего измерения
+         * \return Значение в пределах [0, 1)
+         */
+        float get1D() override
+        {
+            return this->sample(dimension_++);
+        }
+
+        /**
+         * \brief Значения для двух следующих измерений
+         * \return Пара значений в пределах [0, 1)
+         */
+        math::Vec2<float> get2D() override
+        {
+            float x = this->sample(dimension_++);
+            float y = this->sample(dimension_++);
+            return {x, y};
+        }
+    };
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "Sampler.hpp"
+
+namespace samplers
+{
+    /**
+     * \brief Независимые псевдослучайные семплы
+     *
+     * \details Все измерения берутся из генератора PCG32 с зерном (пиксель, семпл, кадр). Наихудшая сходимость,
+     * используется как эталон для сравнения
+     */
+    class Independent : public Sampler
+    {
+    public:
+        /**
+         * \brief Основной конструктор
+         * \param samplesPerPixel Кол-во семплов на пиксель
+         */
+        explicit Independent(unsigned samplesPerPixel = 1):Sampler(samplesPerPixel){}
+
+        /**
+         * \brief Копия генератора
+         * \return Умный указатель на копию
+         */
+        std::unique_ptr<Sampler> clone() const override
+        {
+            return std::unique_ptr<Sampler>(new Independent(*this));
+        }
+
+        /**
+         * \brief Значение для следующего измерения
+         * \return Значение в пределах [0, 1)
+         */
+        float get1D() override
+        {
+            dimension_++;
+            return rng_.nextFloat();
+        }
+
+        /**
+         * \brief Значения для двух следующих измерений
+         * \return Пара значений в пределах [0, 1)
+         */
+        math::Vec2<float> get2D() override
+        {
+            dimension_ += 2;
+            float x = rng_.nextFloat();
+            float y = rng_.nextFloat();
+            return {x, y};
+        }
+    };
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <memory>
+
+#include "../Utils.h"
+
+namespace samplers
+{
+    /**
+     * \brief Обращение порядка бит
+     * \param x Значение
+     * \return Значение с обратным порядком бит
+     */
+    inline uint32_t ReverseBits(uint32_t x)
+    {
+        x = ((x >> 1u) & 0x55555555u) | ((x & 0x55555555u) << 1u);
+        x = ((x >> 2u) & 0x33333333u) | ((x & 0x33333333u) << 2u);
+        x = ((x >> 4u) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4u);
+        x = ((x >> 8u) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8u);
+        return (x >> 16u) | (x << 16u);
+    }
+
+    /**
+     * \brief Перевод 32-битного значения в число с плавающей точкой
+     * \param x Значение
+     * \return Значение в пределах [0, 1)
+     */
+    inline float ToUnitFloat(uint32_t x)
+    {
+        return static_cast<float>(x >> 8u) * (1.0f / 16777216.0f);
+    }
+
+    /**
+     * \brief Базовый класс генератора семплов
+     *
+     * \details Генератор выдает значения для каждого измерения пути луча: первые два измерения - сдвиг
+     * луча в пределах пикселя, далее - значения, запрашиваемые материалами в каждой точке пересечения.
+     * Перед трассировкой каждого семпла вызывается startPixelSample, после чего измерения выдаются
+     * по порядку методами get1D и get2D. Объект хранит состояние текущего семпла, поэтому каждый поток
+     * использует собственную копию (см. clone)
+     */
+    class Sampler
+    {
+    public:
+        /**
+         * \brief Состояние текущего семпла
+         *
+         * \details Позволяет одному объекту поочередно продолжать много семплов (волновая трассировка хранит
+         * состояние каждого пути и восстанавливает его перед запросом следующих измерений)
+         */
+        struct State
+        {
+            /// Индекс пикселя
+            uint32_t pixel;
+            /// Индекс семпла в пикселе
+            uint32_t sampleIndex;
+            /// Номер кадра
+            uint32_t frame;
+            /// Следующее измерение
+            uint32_t dimension;
+            /// Генератор случайных чисел семпла
+            Pcg32 rng;
+        };
+
+    protected:
+        /// Кол-во семплов на пиксель
+        unsigned samplesPerPixel_;
+        /// Индекс текущего пикселя
+        uint32_t pixel_;
+        /// Индекс текущего семпла в пикселе
+        uint32_t sampleIndex_;
+        /// Номер кадра
+        uint32_t frame_;
+        /// Следующее измерение
+        uint32_t dimension_;
+        /// Генератор случайных чисел текущего семпла
+        Pcg32 rng_;
+
+        /**
+         * \brief Зерно для текущего пикселя и измерения (для скремблирования и перестановок)
+         * \param dimension Измерение
+         * \return Зерно
+         */
+        uint32_t dimensionSeed(uint32_t dimension) const
+        {
+            return static_cast<uint32_t>(Pcg32::seedFrom(pixel_, dimension, frame_));
+        }
+
+    public:
+        /**
+         * \brief Основной конструктор
+         * \param samplesPerPixel Кол-во семплов на пиксель
+         */
+        explicit Sampler(unsigned samplesPerPixel = 1):
+        samplesPerPixel_(std::max(samplesPerPixel, 1u)),pixel_(0),sampleIndex_(0),frame_(0),dimension_(0),rng_(){}
+
+        /**
+         * \brief Деструктор
+         */
+        virtual ~Sampler() = default;
+
+        /**
+         * \brief Копия генератора (для использования в отдельном потоке)
+         * \return Умный указатель на копию
+         */
+        virtual std::unique_ptr<Sampler> clone() const = 0;
+
+        /**
+         * \brief Начать новый семпл пикселя
+         * \param pixel Индекс пикселя
+         * \param sampleIndex Индекс семпла в пикселе
+         * \param frame Номер кадра
+         */
+        virtual void startPixelSample(uint32_t pixel, uint32_t sampleIndex, uint32_t frame = 0)
+        {
+            pixel_ = pixel;
+            sampleIndex_ = sampleIndex;
+            frame_ = frame;
+            dimension_ = 0;
+            rng_ = Pcg32(Pcg32::seedFrom(pixel, sampleIndex, frame));
+        }
+
+        /**
+         * \brief Получить состояние текущего семпла
+         * \return Состояние
+         */
+        State getState() const
+        {
+            return {pixel_, sampleIndex_, frame_, dimension_, rng_};
+        }
+
+        /**
+         * \brief Продолжить ранее начатый семпл
+         * \param state Состояние (полученное методом getState)
+         */
+        void setState(const State& state)
+        {
+            pixel_ = state.pixel;
+            sampleIndex_ = state.sampleIndex;
+            frame_ = state.frame;
+            dimension_ = state.dimension;
+            rng_ = state.rng;
+        }
+
+        /**
+         * \brief Значение для следующего измерения
+         * \return Значение в пределах [0, 1)
+         */
+        virtual float get1D() = 0;
+
+        /**
+         * \brief Значения для двух следующих измерений
+         * \return Пара значений в пределах [0, 1)
+         */
+        virtual math::Vec2<float> get2D() = 0;
+
+        /**
+         * \brief Получить кол-во семплов на пиксель
+         * \return Кол-во семплов
+         */
+        unsigned getSamplesPerPixel() const
+        {
+            return samplesPerPixel_;
+        }
+    };
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "Sampler.hpp"
+
+namespace samplers
+{
+    /**
+     * \brief Семплы последовательности Соболя со скремблированием Оуэна (Burley 2020)
+     *
+     * \details Каждая пара измерений берется из первых двух измерений последовательности Соболя (для них не нужны
+     * таблицы направляющих чисел). Независимость пар обеспечивается перемешиванием индекса семпла
+     * и вложенным скремблированием Оуэна значений с зерном, зависящим от пикселя и измерения. Скремблирование
+     * сохраняет стратификацию при любом кол-ве семплов, лучшие результаты - при степени двойки
+     */
+    class Sobol : public Sampler
+    {
+    private:
+        /**
+         * \brief Хеш Лейна-Карраса (каждый бит зависит только от младших бит, т.е. перестановка с сохранением стратов
+         * для обращенного порядка бит)
+         * \param x Значение
+         * \param seed Зерно
+         * \return Хешированное значение
+         */
+        static uint32_t laineKarras(uint32_t x, uint32_t seed)
+        {
+            x += seed;
+            x ^= x * 0x6c50b47cu;
+            x ^= x * 0xb82f1e52u;
+            x ^= x * 0xc7afe638u;
+            x ^= x * 0x8d22f6e6u;
+            return x;
+        }
+
+        /**
+         * \brief Вложенное равномерное скремблирование Оуэна
+         * \param x Значение (32-битная дробь)
+         * \param seed Зерно
+         * \return Скремблированное значение
+         */
+        static uint32_t scramble(uint32_t x, uint32_t seed)
+        {
+            return ReverseBits(laineKarras(ReverseBits(x), seed));
+        }
+
+        /**
+         * \brief Таблица второго измерения последовательности Соболя (по байтам индекса)
+         */
+        struct SecondDimensionTable
+        {
+            /// Сумма (XOR) направляющих чисел для каждого значения каждого байта индекса
+            uint32_t values[4][256];
+
+            /**
+             * \brief Конструктор (заполнение таблицы)
+             */
+            SecondDimensionTable():values()
+            {
+                // Направляющие числа второго измерения: v[0] = 2^31, v[i] = v[i-1] ^ (v[i-1] >> 1)
+                uint32_t directions[32];
+                directions[0] = 0x80000000u;
+                for(unsigned i = 1; i < 32; i++) directions[i] = directions[i - 1] ^ (directions[i - 1] >> 1u);
+
+                for(unsigned byte = 0; byte < 4; byte++){
+                    for(unsigned value = 0; value < 256; value++){
+                        uint32_t result = 0;
+                        for(unsigned bit = 0; bit < 8; bit++){
+                            if(value & (1u << bit)) result ^= directions[byte * 8 + bit];
+                        }
+                        values[byte][value] = result;
+                    }
+                }
+            }
+        };
+
+        /**
+         * \brief Второе измерение последовательности Соболя
+         * \param index Индекс точки
+         * \return Значение (32-битная дробь)
+         */
+        static uint32_t sobolSecond(uint32_t index)
+        {
+            static const SecondDimensionTable table;
+            return table.values[0][index & 0xffu] ^
+                   table.values[1][(index >> 8u) & 0xffu] ^
+                   table.values[2][(index >> 16u) & 0xffu] ^
+                   table.values[3][index >> 24u];
+        }
+
+        /**
+         * \brief Пара значений для пары измерений текущего семпла
+         * \param dimension Первое измерение пары
+         * \return Пара значений в пределах [0, 1)
+         */
+        math::Vec2<float> sample(uint32_t dimension) const
+        {
+            uint32_t seed = this->dimensionSeed(dimension);
+            uint32_t index = scramble(sampleIndex_, seed);
+
+            // Первое измерение Соболя - обращение бит индекса (scramble(ReverseBits(index)) без двойного обращения)
+            uint32_t x = ReverseBits(laineKarras(index, seed * 0x9e3779b9u + 0x7f4a7c15u));
+            uint32_t y = scramble(sobolSecond(index), seed * 0x85ebca6bu + 0xc2b2ae35u);
+            return {ToUnitFloat(x), ToUnitFloat(y)};
+        }
+
+    public:
+        /**
+         * \brief Основной конструктор
+         * \param samplesPerPixel Кол-во семплов на пиксель
+         */
+        explicit Sobol(unsigned samplesPerPixel = 1):Sampler(samplesPerPixel){}
+
+        /**
+         * \brief Копия генератора
+         * \return Умный указатель на копию
+         */
+        std::unique_ptr<Sampler> clone() const override
+        {
+            return std::unique_ptr<Sampler>(new Sobol(*this));
+        }
+
+        /**
+         * \brief Значение для следующего измерения
+         * \return Значение в пределах [0, 1)
+         */
+        float get1D() override
+        {
+            return this->sample(dimension_++).x;
+        }
+
+        /**
+         * \brief Значения для двух следующих измерений
+         * \return Пара значений в пределах [0, 1)
+         */
+        math::Vec2<float> get2D() override
+        {
+            math::Vec2<float> result = this->sample(dimension_);
+            dimension_ += 2;
+            return result;
+        }
+    };
+}
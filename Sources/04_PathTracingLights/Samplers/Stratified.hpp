@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cmath>
+
+#include "Sampler.hpp"
+
+namespace samplers
+{
+    /**
+     * \brief Стратифицированные семплы (коррелированная мульти-джиттер выборка, Kensler 2013)
+     *
+     * \details Семплы пикселя распределяются по слоям: в одномерном случае - по одному на каждый из N отрезков,
+     * в двумерном - по сетке m x n, где каждая строка и каждый столбец также содержат ровно по одному семплу.
+     * Порядок слоев перемешивается отдельно для каждого пикселя и измерения, поэтому измерения не коррелируют
+     * между собой. Качество зависит от заранее известного кол-ва семплов на пиксель
+     */
+    class Stratified : public Sampler
+    {
+    private:
+        /// Кол-во столбцов сетки двумерных слоев
+        uint32_t columns_;
+        /// Кол-во строк сетки двумерных слоев
+        uint32_t rows_;
+
+        /**
+         * \brief Перестановка индекса без хранения таблицы
+         * \param i Индекс
+         * \param length Кол-во элементов
+         * \param seed Зерно перестановки
+         * \return Переставленный индекс в пределах [0, length)
+         */
+        static uint32_t permute(uint32_t i, uint32_t length, uint32_t seed)
+        {
+            uint32_t w = length - 1;
+            w |= w >> 1u;
+            w |= w >> 2u;
+            w |= w >> 4u;
+            w |= w >> 8u;
+            w |= w >> 16u;
+
+            // Обратимое хеширование в пределах степени двойки, значения за пределами length отбрасываются
+            do{
+                i ^= seed; i *= 0xe170893du; i ^= seed >> 16u;
+                i ^= (i & w) >> 4u; i ^= seed >> 8u; i *= 0x0929eb3fu; i ^= seed >> 23u;
+                i ^= (i & w) >> 1u; i *= 1u | seed >> 27u; i *= 0x6935fa69u;
+                i ^= (i & w) >> 11u; i *= 0x74dcb303u; i ^= (i & w) >> 2u;
+                i *= 0x9e501cc3u; i ^= (i & w) >> 2u; i *= 0xc860a3dfu;
+                i &= w; i ^= i >> 5u;
+            }while(i >= length);
+
+            return (i + seed) % length;
+        }
+
+        /**
+         * \brief Хеш индекса в число с плавающей точкой (сдвиг внутри слоя)
+         * \param i Индекс
+         * \param seed Зерно
+         * \return Значение в пределах [0, 1)
+         */
+        static float jitter(uint32_t i, uint32_t seed)
+        {
+            i ^= seed; i ^= i >> 17u; i ^= i >> 10u; i *= 0xb36534e5u;
+            i ^= i >> 12u; i ^= i >> 21u; i *= 0x93fc4795u;
+            i ^= 0xdf6e307fu; i ^= i >> 17u; i *= 1u | seed >> 18u;
+            return ToUnitFloat(i);
+        }
+
+    public:
+        /**
+         * \brief Основной конструктор
+         * \param samplesPerPixel Кол-во семплов на пиксель
+         */
+        explicit Stratified(unsigned samplesPerPixel = 1):Sampler(samplesPerPixel),columns_(1),rows_(1)
+        {
+            // Сетка, максимально близкая к квадратной (лишние ячейки при неполном заполнении не используются)
+            columns_ = std::max(1u, static_cast<uint32_t>(std::sqrt(static_cast<float>(samplesPerPixel_))));
+            rows_ = (samplesPerPixel_ + columns_ - 1) / columns_;
+        }
+
+        /**
+         * \brief Копия генератора
+         * \return Умный указатель на копию
+         */
+        std::unique_ptr<Sampler> clone() const override
+        {
+            return std::unique_ptr<Sampler>(new Stratified(*this));
+        }
+
+        /**
+         * \brief Значение для следующего измерения
+         * \return Значение в пределах [0, 1)
+         */
+        float get1D() override
+        {
+            uint32_t seed = this->dimensionSeed(dimension_++);
+            if(sampleIndex_ >= samplesPerPixel_) return rng_.nextFloat();
+
+            uint32_t stratum = permute(sampleIndex_, samplesPerPixel_, seed);
+            return (static_cast<float>(stratum) + jitter(sampleIndex_, seed * 0x68bc21ebu)) / static_cast<float>(samplesPerPixel_);
+        }
+
+        /**
+         * \brief Значения для двух следующих измерений
+         * \return Пара значений в пределах [0, 1)
+         */
+        math::Vec2<float> get2D() override
+        {
+            uint32_t seed = this->dimensionSeed(dimension_);
+            dimension_ += 2;
+            if(sampleIndex_ >= samplesPerPixel_){
+                float x = rng_.nextFloat();
+                float y = rng_.nextFloat();
+                return {x, y};
+            }
+
+            // Номер семпла перемешивается, затем определяется ячейка сетки и сдвиг внутри нее
+            uint32_t s = permute(sampleIndex_, samplesPerPixel_, seed * 0x51633e2du);
+            uint32_t column = s % columns_;
+            uint32_t row = s / columns_;
+            uint32_t sx = permute(column, columns_, seed * 0xa511e9b3u);
+            uint32_t sy = permute(row, rows_, seed * 0x63d83595u);
+            float jx = jitter(s, seed * 0xa399d265u);
+            float jy = jitter(s, seed * 0x711ad6a5u);
+
+            return {
+                std::min((static_cast<float>(column) + (static_cast<float>(sy) + jx) / static_cast<float>(rows_)) / static_cast<float>(columns_), 0.99999994f),
+                std::min((static_cast<float>(row) + (static_cast<float>(sx) + jy) / static_cast<float>(columns_)) / static_cast<float>(rows_), 0.99999994f)
+            };
+        }
+    };
+}
@@ -0,0 +1,1281 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <utility>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "../Utils.h"
+
+// Кол-во корзин (bins) при поиске разделения узла по эвристике площади поверхности (SAH)
+#ifndef BVH_SAH_BINS
+#define BVH_SAH_BINS 12
+#endif
+
+// Максимальное кол-во примитивов в листе (больше - узел разделяется принудительно)
+#ifndef BVH_MAX_LEAF_SIZE
+#define BVH_MAX_LEAF_SIZE 8
+#endif
+
+// Стоимость обхода узла относительно стоимости пересечения с примитивом (для SAH)
+#ifndef BVH_TRAVERSAL_COST
+#define BVH_TRAVERSAL_COST 1.0f
+#endif
+
+// Минимальное кол-во примитивов узла, при котором его правое поддерево строится отдельной задачей
+#ifndef BVH_PARALLEL_TASK_THRESHOLD
+#define BVH_PARALLEL_TASK_THRESHOLD 1024
+#endif
+
+// Минимальное кол-во примитивов узла, при котором распределение по корзинам выполняется несколькими потоками
+#ifndef BVH_PARALLEL_BINNING_THRESHOLD
+#define BVH_PARALLEL_BINNING_THRESHOLD 65536
+#endif
+
+// Максимальное кол-во примитивов, для которого линейный построитель использует 30-битные коды Мортона
+#ifndef BVH_LBVH_NARROW_CODES_LIMIT
+#define BVH_LBVH_NARROW_CODES_LIMIT 65536
+#endif
+
+// Во сколько раз SAH-стоимость иерархии после обновления границ может превысить стоимость после построения,
+// прежде чем иерархия будет перестроена полностью
+#ifndef BVH_REFIT_REBUILD_THRESHOLD
+#define BVH_REFIT_REBUILD_THRESHOLD 1.5f
+#endif
+
+// Размер стека обхода иерархии
+#ifndef BVH_STACK_SIZE
+#define BVH_STACK_SIZE 128
+#endif
+
+// Максимальная глубина листа (при обходе в стеке не может оказаться больше узлов, чем глубина листа)
+#define BVH_MAX_DEPTH (BVH_STACK_SIZE - 1)
+static_assert(BVH_MAX_DEPTH > 32, "BVH_STACK_SIZE is too small for 32-bit primitive counts");
+
+namespace scene
+{
+    /**
+     * \brief Узел иерархии ограничивающих объемов (32 байта)
+     *
+     * \details Узлы хранятся в плоском массиве в порядке обхода в глубину. Левый потомок внутреннего узла всегда
+     * следует сразу за ним, индекс правого потомка хранится явно. Лист хранит диапазон примитивов
+     */
+    struct BVHNode
+    {
+        /// Описывающий параллелипипед узла
+        math::BBox<> bounds;
+        /// Индекс правого потомка (для внутреннего узла) либо индекс первого примитива (для листа)
+        uint32_t offset;
+        /// Кол-во примитивов (0 для внутреннего узла)
+        uint16_t primitiveCount;
+        /// Ось по которой разделен узел
+        uint16_t axis;
+    };
+
+    /**
+     * \brief Способ построения иерархии
+     */
+    enum BVHBuildMethod
+    {
+        /// Разбиение сверху вниз по эвристике площади поверхности (медленнее, качественнее)
+        eBinnedSAH,
+        /// Линейное построение по кодам Мортона (быстрее, подходит для перестроения каждый кадр)
+        eLinearMorton,
+    };
+
+    /**
+     * \brief Иерархия ограничивающих объемов (BVH) над произвольным набором примитивов
+     *
+     * \details Строится по описывающим параллелипипедам примитивов при помощи эвристики площади поверхности (SAH)
+     * с разбиением на корзины. Ничего не знает о самих примитивах - пересечение с ними выполняется переданным
+     * при обходе функтором, поэтому может использоваться как для элементов сцены, так и, например, для треугольников
+     */
+    class BVHTree
+    {
+    private:
+        /**
+         * \brief Результат распределения примитивов диапазона по корзинам (по всем трем осям)
+         */
+        struct Binning
+        {
+            /// Параллелипипед всех примитивов диапазона
+            math::BBox<> bounds = math::EmptyBBox();
+            /// Параллелипипед центров примитивов диапазона
+            math::BBox<> centroidBounds = math::EmptyBBox();
+            /// Параллелипипеды корзин для каждой оси
+            math::BBox<> binBounds[3][BVH_SAH_BINS];
+            /// Кол-во примитивов в корзинах для каждой оси
+            uint32_t binCounts[3][BVH_SAH_BINS];
+
+            Binning()
+            {
+                for(unsigned axis = 0; axis < 3; axis++){
+                    for(unsigned i = 0; i < BVH_SAH_BINS; i++){
+                        binBounds[axis][i] = math::EmptyBBox();
+                        binCounts[axis][i] = 0;
+                    }
+                }
+            }
+
+            /**
+             * \brief Объединить с результатом для другой части диапазона
+             * \param other Результат для другой части
+             *
+             * \details Объединение параллелипипедов и сложение кол-в не зависит от порядка, поэтому итог
+             * не зависит от того, на сколько частей был разбит диапазон
+             */
+            void merge(const Binning& other)
+            {
+                for(unsigned axis = 0; axis < 3; axis++){
+                    for(unsigned i = 0; i < BVH_SAH_BINS; i++){
+                        binBounds[axis][i] = math::Union(binBounds[axis][i], other.binBounds[axis][i]);
+                        binCounts[axis][i] += other.binCounts[axis][i];
+                    }
+                }
+            }
+        };
+
+        /// Узлы иерархии (корень - нулевой узел)
+        std::vector<BVHNode> nodes_;
+        /// SAH-стоимость иерархии сразу после построения
+        float buildCost_ = 0.0f;
+        /// Индексы исходных примитивов в порядке их следования в листьях
+        std::vector<uint32_t> indices_;
+        /// Центры описывающих параллелипипедов примитивов (используются только при построении)
+        std::vector<math::Vec3<float>> centroids_;
+        /// Описывающие параллелипипеды примитивов (указатель действителен только во время построения)
+        const std::vector<math::BBox<>>* boxes_ = nullptr;
+
+        /**
+         * \brief Компонента вектора по индексу оси
+         * \param v Вектор
+         * \param axis Ось (0 - X, 1 - Y, 2 - Z)
+         * \return Значение компоненты
+         */
+        static float axisValue(const math::Vec3<float>& v, unsigned axis)
+        {
+            return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+        }
+
+        /**
+         * \brief Индекс корзины для центра примитива
+         * \param centroid Центр примитива
+         * \param axis Ось
+         * \param cMin Минимальная координата центров по оси
+         * \param scale Кол-во корзин деленное на протяженность центров по оси
+         * \return Индекс корзины
+         */
+        static unsigned binIndex(const math::Vec3<float>& centroid, unsigned axis, float cMin, float scale)
+        {
+            auto bin = static_cast<unsigned>((axisValue(centroid, axis) - cMin) * scale);
+            return std::min(bin, static_cast<unsigned>(BVH_SAH_BINS - 1));
+        }
+
+        /**
+         * \brief Параллелипипеды части диапазона примитивов
+         * \param begin Начало части
+         * \param end Конец части
+         * \param result Результат (параллелипипеды объединяются с уже имеющимися)
+         */
+        void computeBounds(uint32_t begin, uint32_t end, Binning* result) const
+        {
+            for(uint32_t i = begin; i < end; i++){
+                result->bounds = math::Union(result->bounds, (*boxes_)[indices_[i]]);
+                result->centroidBounds = math::Union(result->centroidBounds, centroids_[indices_[i]]);
+            }
+        }
+
+        /**
+         * \brief Распределение части диапазона примитивов по корзинам
+         * \param begin Начало части
+         * \param end Конец части
+         * \param centroidBounds Параллелипипед центров всего диапазона
+         * \param result Результат (корзины объединяются с уже имеющимися)
+         */
+        void computeBins(uint32_t begin, uint32_t end, const math::BBox<>& centroidBounds, Binning* result) const
+        {
+            for(unsigned axis = 0; axis < 3; axis++)
+            {
+                float cMin = axisValue(centroidBounds.min, axis);
+                float cMax = axisValue(centroidBounds.max, axis);
+                if(cMax <= cMin) continue;
+
+                float scale = static_cast<float>(BVH_SAH_BINS) / (cMax - cMin);
+                for(uint32_t i = begin; i < end; i++){
+                    auto bin = binIndex(centroids_[indices_[i]], axis, cMin, scale);
+                    result->binCounts[axis][bin]++;
+                    result->binBounds[axis][bin] = math::Union(result->binBounds[axis][bin], (*boxes_)[indices_[i]]);
+                }
+            }
+        }
+
+        /**
+         * \brief Параллельно выполнить операцию над частями диапазона и объединить результаты
+         * \tparam F Тип операции вида void(uint32_t begin, uint32_t end, Binning* result)
+         * \param begin Начало диапазона
+         * \param end Конец диапазона
+         * \param threads Кол-во потоков
+         * \param result Итоговый результат
+         * \param operation Операция
+         */
+        template <typename F>
+        static void parallelReduce(uint32_t begin, uint32_t end, unsigned threads, Binning* result, const F& operation)
+        {
+            uint32_t count = end - begin;
+
+            // Для небольших диапазонов потоки не создаются
+            if(threads <= 1 || count < BVH_PARALLEL_BINNING_THRESHOLD){
+                operation(begin, end, result);
+                return;
+            }
+
+            // Каждый поток обрабатывает свою часть диапазона в собственный результат
+            std::vector<Binning> partial(threads);
+            std::vector<std::thread> workers{};
+            uint32_t chunk = count / threads;
+
+            for(unsigned i = 0; i < threads; i++){
+                uint32_t from = begin + chunk * i;
+                uint32_t to = (i == threads - 1) ? end : from + chunk;
+                workers.emplace_back([&operation, &partial, from, to, i](){ operation(from, to, &partial[i]); });
+            }
+
+            for(auto& t : workers) t.join();
+
+            // Объединение частичных результатов
+            for(const auto& p : partial){
+                result->bounds = math::Union(result->bounds, p.bounds);
+                result->centroidBounds = math::Union(result->centroidBounds, p.centroidBounds);
+                result->merge(p);
+            }
+        }
+
+        /**
+         * \brief Рекурсивное построение поддерева для диапазона примитивов
+         * \param begin Начало диапазона (в массиве индексов)
+         * \param end Конец диапазона (в массиве индексов)
+         * \param threads Кол-во потоков доступных для построения данного поддерева
+         * \param nodes Массив в конец которого добавляются узлы поддерева
+         * \param depth Глубина создаваемого узла
+         * \return Индекс созданного узла
+         *
+         * \details Если потоков больше одного, правое поддерево строится отдельной задачей в собственный массив,
+         * который затем присоединяется к итоговому. Порядок узлов и разбиения при этом не зависят от кол-ва потоков.
+         * Когда оставшейся глубины хватает только на сбалансированное поддерево, узел делится по медиане -
+         * так глубина листьев не превышает BVH_MAX_DEPTH даже при вырожденных разбиениях SAH
+         */
+        uint32_t buildRecursive(uint32_t begin, uint32_t end, unsigned threads, std::vector<BVHNode>* nodes, unsigned depth = 0)
+        {
+            // Новый узел (ссылки на элементы массива не сохраняются, т.к. он растет при построении)
+            auto nodeIndex = static_cast<uint32_t>(nodes->size());
+            nodes->emplace_back();
+
+            // Параллелипипед узла и параллелипипед центров примитивов
+            Binning binning{};
+            parallelReduce(begin, end, threads, &binning, [this](uint32_t from, uint32_t to, Binning* result){
+                computeBounds(from, to, result);
+            });
+
+            math::BBox<> bounds = binning.bounds;
+            math::BBox<> centroidBounds = binning.centroidBounds;
+            (*nodes)[nodeIndex].bounds = bounds;
+            uint32_t count = end - begin;
+
+            // Лист - если примитив один
+            if(count <= 1){
+                (*nodes)[nodeIndex].offset = begin;
+                (*nodes)[nodeIndex].primitiveCount = static_cast<uint16_t>(count);
+                (*nodes)[nodeIndex].axis = 0;
+                return nodeIndex;
+            }
+
+            // Глубина на пределе - разделение по медиане вдоль наибольшей оси центров (либо лист, если примитивов немного)
+            if(depth + ceilLog2(count) >= BVH_MAX_DEPTH)
+            {
+                if(count <= BVH_MAX_LEAF_SIZE){
+                    (*nodes)[nodeIndex].offset = begin;
+                    (*nodes)[nodeIndex].primitiveCount = static_cast<uint16_t>(count);
+                    (*nodes)[nodeIndex].axis = 0;
+                    return nodeIndex;
+                }
+
+                math::Vec3<float> extent = centroidBounds.max - centroidBounds.min;
+                unsigned axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+                uint32_t middle = begin + count / 2;
+                std::nth_element(indices_.begin() + begin, indices_.begin() + middle, indices_.begin() + end, [&](uint32_t a, uint32_t b){
+                    return axisValue(centroids_[a], axis) < axisValue(centroids_[b], axis);
+                });
+
+                buildRecursive(begin, middle, 1, nodes, depth + 1);
+                uint32_t right = buildRecursive(middle, end, 1, nodes, depth + 1);
+                (*nodes)[nodeIndex].offset = right;
+                (*nodes)[nodeIndex].primitiveCount = 0;
+                (*nodes)[nodeIndex].axis = static_cast<uint16_t>(axis);
+                return nodeIndex;
+            }
+
+            // Распределение примитивов по корзинам
+            parallelReduce(begin, end, threads, &binning, [this, &centroidBounds](uint32_t from, uint32_t to, Binning* result){
+                computeBins(from, to, centroidBounds, result);
+            });
+
+            // Лучшее найденное разделение
+            float bestCost = std::numeric_limits<float>::max();
+            unsigned bestAxis = 0;
+            unsigned bestBin = 0;
+
+            // Поиск разделения по всем осям
+            for(unsigned axis = 0; axis < 3; axis++)
+            {
+                // Все центры в одной точке по данной оси - разделять бессмысленно
+                if(axisValue(centroidBounds.max, axis) <= axisValue(centroidBounds.min, axis)) continue;
+
+                const math::BBox<>* binBounds = binning.binBounds[axis];
+                const uint32_t* binCounts = binning.binCounts[axis];
+
+                // Площади и кол-ва примитивов слева от каждой границы между корзинами
+                float leftAreas[BVH_SAH_BINS - 1];
+                uint32_t leftCounts[BVH_SAH_BINS - 1];
+                math::BBox<> accumulated = math::EmptyBBox();
+                uint32_t accumulatedCount = 0;
+                for(unsigned i = 0; i < BVH_SAH_BINS - 1; i++){
+                    accumulated = math::Union(accumulated, binBounds[i]);
+                    accumulatedCount += binCounts[i];
+                    leftAreas[i] = math::SurfaceArea(accumulated);
+                    leftCounts[i] = accumulatedCount;
+                }
+
+                // Проход справа налево и оценка стоимости каждой границы
+                accumulated = math::EmptyBBox();
+                accumulatedCount = 0;
+                for(unsigned i = BVH_SAH_BINS - 1; i > 0; i--){
+                    accumulated = math::Union(accumulated, binBounds[i]);
+                    accumulatedCount += binCounts[i];
+
+                    float cost = leftAreas[i - 1] * static_cast<float>(leftCounts[i - 1]) + math::SurfaceArea(accumulated) * static_cast<float>(accumulatedCount);
+                    if(leftCounts[i - 1] > 0 && accumulatedCount > 0 && cost < bestCost){
+                        bestCost = cost;
+                        bestAxis = axis;
+                        bestBin = i;
+                    }
+                }
+            }
+
+            // Стоимость листа и стоимость лучшего разделения (в единицах стоимости пересечения с примитивом)
+            float area = math::SurfaceArea(bounds);
+            float leafCost = static_cast<float>(count);
+            float splitCost = area > 0.0f ? BVH_TRAVERSAL_COST + bestCost / area : std::numeric_limits<float>::max();
+
+            // Если разделение не выгодно (или невозможно) и примитивов немного - создать лист
+            if(count <= BVH_MAX_LEAF_SIZE && leafCost <= splitCost){
+                (*nodes)[nodeIndex].offset = begin;
+                (*nodes)[nodeIndex].primitiveCount = static_cast<uint16_t>(count);
+                (*nodes)[nodeIndex].axis = 0;
+                return nodeIndex;
+            }
+
+            // Разделение диапазона индексов
+            uint32_t middle = begin + count / 2;
+            if(bestCost < std::numeric_limits<float>::max())
+            {
+                float cMin = axisValue(centroidBounds.min, bestAxis);
+                float scale = static_cast<float>(BVH_SAH_BINS) / (axisValue(centroidBounds.max, bestAxis) - cMin);
+                auto it = std::partition(indices_.begin() + begin, indices_.begin() + end, [&](uint32_t index){
+                    return binIndex(centroids_[index], bestAxis, cMin, scale) < bestBin;
+                });
+                middle = static_cast<uint32_t>(it - indices_.begin());
+            }
+
+            // Если разделение вырождено (все центры совпадают) - делить диапазон пополам
+            if(middle == begin || middle == end) middle = begin + count / 2;
+
+            // Построение потомков (левый потомок следует сразу за текущим узлом)
+            uint32_t right = 0;
+            if(threads > 1 && count >= BVH_PARALLEL_TASK_THRESHOLD)
+            {
+                // Правое поддерево строится отдельной задачей (диапазоны индексов не пересекаются)
+                std::vector<BVHNode> rightNodes{};
+                unsigned rightThreads = threads / 2;
+                std::thread task([this, middle, end, rightThreads, depth, &rightNodes](){
+                    buildRecursive(middle, end, rightThreads, &rightNodes, depth + 1);
+                });
+                buildRecursive(begin, middle, threads - rightThreads, nodes, depth + 1);
+                task.join();
+
+                // Присоединение узлов правого поддерева (индексы потомков смещаются, индексы примитивов - нет)
+                right = static_cast<uint32_t>(nodes->size());
+                for(auto node : rightNodes){
+                    if(node.primitiveCount == 0) node.offset += right;
+                    nodes->push_back(node);
+                }
+            }
+            else
+            {
+                buildRecursive(begin, middle, 1, nodes, depth + 1);
+                right = buildRecursive(middle, end, 1, nodes, depth + 1);
+            }
+
+            (*nodes)[nodeIndex].offset = right;
+            (*nodes)[nodeIndex].primitiveCount = 0;
+            (*nodes)[nodeIndex].axis = static_cast<uint16_t>(bestAxis);
+            return nodeIndex;
+        }
+
+        /**
+         * \brief Внутренний узел промежуточной иерархии линейного построителя (LBVH)
+         */
+        struct LinearNode
+        {
+            /// Индексы потомков (внутреннего узла либо позиции примитива в отсортированном массиве)
+            uint32_t children[2];
+            /// Является ли потомок листом
+            bool isLeaf[2];
+            /// Диапазон отсортированных примитивов поддерева
+            uint32_t first, last;
+        };
+
+        /// Коды Мортона примитивов (используются только при линейном построении)
+        std::vector<uint64_t> mortonCodes_;
+
+        /**
+         * \brief Кол-во старших нулевых бит 64-битного числа
+         * \param v Число (не ноль)
+         * \return Кол-во нулевых бит
+         */
+        static int countLeadingZeros(uint64_t v)
+        {
+#if defined(_MSC_VER)
+            unsigned long index = 0;
+            _BitScanReverse64(&index, v);
+            return 63 - static_cast<int>(index);
+#else
+            return __builtin_clzll(v);
+#endif
+        }
+
+        /**
+         * \brief Округленный вверх двоичный логарифм (глубина сбалансированного дерева над заданным кол-вом листьев)
+         * \param v Исходное число
+         * \return Логарифм (0 для v <= 1)
+         */
+        static unsigned ceilLog2(uint32_t v)
+        {
+            return v <= 1 ? 0u : static_cast<unsigned>(64 - countLeadingZeros(static_cast<uint64_t>(v - 1)));
+        }
+
+        /**
+         * \brief Разрядить 10 младших бит числа (между каждыми двумя битами вставляются два нулевых)
+         * \param v Исходное число
+         * \return Разреженное 30-битное число
+         */
+        static uint64_t expandBits10(uint64_t v)
+        {
+            v &= 0x3ffu;
+            v = (v * 0x00010001u) & 0xFF0000FFu;
+            v = (v * 0x00000101u) & 0x0F00F00Fu;
+            v = (v * 0x00000011u) & 0xC30C30C3u;
+            v = (v * 0x00000005u) & 0x49249249u;
+            return v;
+        }
+
+        /**
+         * \brief Разрядить 21 младший бит числа (между каждыми двумя битами вставляются два нулевых)
+         * \param v Исходное число
+         * \return Разреженное 63-битное число
+         */
+        static uint64_t expandBits21(uint64_t v)
+        {
+            v &= 0x1fffffu;
+            v = (v | v << 32u) & 0x1f00000000ffffull;
+            v = (v | v << 16u) & 0x1f0000ff0000ffull;
+            v = (v | v << 8u) & 0x100f00f00f00f00full;
+            v = (v | v << 4u) & 0x10c30c30c30c30c3ull;
+            v = (v | v << 2u) & 0x1249249249249249ull;
+            return v;
+        }
+
+        /**
+         * \brief Параллельная поразрядная (LSD radix) сортировка кодов Мортона вместе с индексами примитивов
+         * \param bits Значащих бит в кодах
+         * \param threads Кол-во потоков
+         *
+         * \details Сортировка устойчива и не зависит от кол-ва потоков: каждый поток считает гистограмму своей
+         * части, после чего смещения назначаются в порядке (разряд, поток)
+         */
+        void radixSort(unsigned bits, unsigned threads)
+        {
+            auto count = static_cast<uint32_t>(mortonCodes_.size());
+            std::vector<uint64_t> keysTemp(count);
+            std::vector<uint32_t> valuesTemp(count);
+            std::vector<uint32_t> histograms(threads * 256);
+
+            for(unsigned shift = 0; shift < bits; shift += 8)
+            {
+                // Гистограммы разрядов для частей массива
+                std::fill(histograms.begin(), histograms.end(), 0u);
+                parallelFor(count, threads, [&](uint32_t from, uint32_t to, unsigned part){
+                    uint32_t* histogram = histograms.data() + part * 256;
+                    for(uint32_t i = from; i < to; i++) histogram[(mortonCodes_[i] >> shift) & 0xffu]++;
+                });
+
+                // Смещения (в порядке разряда, затем части - это сохраняет устойчивость)
+                uint32_t offset = 0;
+                for(unsigned digit = 0; digit < 256; digit++){
+                    for(unsigned part = 0; part < threads; part++){
+                        uint32_t c = histograms[part * 256 + digit];
+                        histograms[part * 256 + digit] = offset;
+                        offset += c;
+                    }
+                }
+
+                // Перенос элементов
+                parallelFor(count, threads, [&](uint32_t from, uint32_t to, unsigned part){
+                    uint32_t* offsets = histograms.data() + part * 256;
+                    for(uint32_t i = from; i < to; i++){
+                        uint32_t destination = offsets[(mortonCodes_[i] >> shift) & 0xffu]++;
+                        keysTemp[destination] = mortonCodes_[i];
+                        valuesTemp[destination] = indices_[i];
+                    }
+                });
+
+                mortonCodes_.swap(keysTemp);
+                indices_.swap(valuesTemp);
+            }
+        }
+
+        /**
+         * \brief Длина общего префикса кодов двух примитивов (с учетом индексов при совпадении кодов)
+         * \param i Позиция первого примитива
+         * \param j Позиция второго примитива
+         * \return Длина префикса, либо -1 если j вне массива
+         */
+        int commonPrefix(int64_t i, int64_t j) const
+        {
+            if(j < 0 || j >= static_cast<int64_t>(mortonCodes_.size())) return -1;
+            uint64_t a = mortonCodes_[static_cast<size_t>(i)];
+            uint64_t b = mortonCodes_[static_cast<size_t>(j)];
+            if(a == b) return 64 + countLeadingZeros(static_cast<uint64_t>(i) ^ static_cast<uint64_t>(j));
+            return countLeadingZeros(a ^ b);
+        }
+
+        /**
+         * \brief Построение внутреннего узла промежуточной иерархии (Karras 2012)
+         * \param index Индекс внутреннего узла
+         * \return Узел
+         *
+         * \details Каждый узел строится независимо от остальных, поэтому все узлы могут строиться параллельно
+         */
+        LinearNode buildLinearNode(int64_t index) const
+        {
+            // Направление диапазона узла
+            int d = (commonPrefix(index, index + 1) - commonPrefix(index, index - 1)) >= 0 ? 1 : -1;
+
+            // Верхняя граница длины диапазона
+            int prefixMin = commonPrefix(index, index - d);
+            int64_t lengthMax = 2;
+            while(commonPrefix(index, index + lengthMax * d) > prefixMin) lengthMax *= 2;
+
+            // Точная длина диапазона (двоичный поиск)
+            int64_t length = 0;
+            for(int64_t t = lengthMax / 2; t >= 1; t /= 2){
+                if(commonPrefix(index, index + (length + t) * d) > prefixMin) length += t;
+            }
+            int64_t j = index + length * d;
+
+            // Позиция разделения - там, где заканчивается общий префикс всего диапазона (двоичный поиск)
+            int prefixNode = commonPrefix(index, j);
+            int64_t split = 0;
+            for(int64_t divisor = 2;; divisor *= 2){
+                int64_t t = (length + divisor - 1) / divisor;
+                if(commonPrefix(index, index + (split + t) * d) > prefixNode) split += t;
+                if(t <= 1) break;
+            }
+            int64_t gamma = index + split * d + std::min(d, 0);
+
+            LinearNode node{};
+            node.first = static_cast<uint32_t>(std::min(index, j));
+            node.last = static_cast<uint32_t>(std::max(index, j));
+            node.children[0] = static_cast<uint32_t>(gamma);
+            node.isLeaf[0] = node.first == static_cast<uint32_t>(gamma);
+            node.children[1] = static_cast<uint32_t>(gamma + 1);
+            node.isLeaf[1] = node.last == static_cast<uint32_t>(gamma + 1);
+            return node;
+        }
+
+        /**
+         * \brief Перенос поддерева промежуточной иерархии в итоговый массив узлов
+         * \param linearNodes Внутренние узлы промежуточной иерархии
+         * \param index Индекс узла (внутреннего или позиции примитива)
+         * \param isLeaf Является ли узел листом
+         * \return Индекс созданного узла
+         *
+         * \details Параллелипипеды считаются снизу вверх. Небольшие поддеревья, для которых лист выгоднее
+         * по эвристике SAH, сворачиваются в один лист
+         */
+        uint32_t emitLinear(const std::vector<LinearNode>& linearNodes, uint32_t index, bool isLeaf)
+        {
+            auto nodeIndex = static_cast<uint32_t>(nodes_.size());
+            nodes_.emplace_back();
+
+            if(isLeaf){
+                nodes_[nodeIndex].bounds = (*boxes_)[indices_[index]];
+                nodes_[nodeIndex].offset = index;
+                nodes_[nodeIndex].primitiveCount = 1;
+                nodes_[nodeIndex].axis = 0;
+                return nodeIndex;
+            }
+
+            const LinearNode& linearNode = linearNodes[index];
+            uint32_t left = emitLinear(linearNodes, linearNode.children[0], linearNode.isLeaf[0]);
+            uint32_t right = emitLinear(linearNodes, linearNode.children[1], linearNode.isLeaf[1]);
+
+            math::BBox<> bounds = math::Union(nodes_[left].bounds, nodes_[right].bounds);
+            uint32_t count = linearNode.last - linearNode.first + 1;
+            uint32_t leftCount = linearNode.children[0] - linearNode.first + 1;
+
+            // Свернуть поддерево в лист, если это выгоднее по SAH
+            float area = math::SurfaceArea(bounds);
+            float splitCost = BVH_TRAVERSAL_COST + (math::SurfaceArea(nodes_[left].bounds) * static_cast<float>(leftCount) +
+                    math::SurfaceArea(nodes_[right].bounds) * static_cast<float>(count - leftCount)) / std::max(area, std::numeric_limits<float>::min());
+
+            if(count <= BVH_MAX_LEAF_SIZE && static_cast<float>(count) <= splitCost){
+                nodes_.resize(nodeIndex + 1);
+                nodes_[nodeIndex].bounds = bounds;
+                nodes_[nodeIndex].offset = linearNode.first;
+                nodes_[nodeIndex].primitiveCount = static_cast<uint16_t>(count);
+                nodes_[nodeIndex].axis = 0;
+                return nodeIndex;
+            }
+
+            nodes_[nodeIndex].bounds = bounds;
+            nodes_[nodeIndex].offset = right;
+            nodes_[nodeIndex].primitiveCount = 0;
+            nodes_[nodeIndex].axis = 0;
+            return nodeIndex;
+        }
+
+        /**
+         * \brief Линейное построение иерархии по кодам Мортона (LBVH)
+         * \param threads Кол-во потоков
+         *
+         * \details Центры примитивов квантуются в пределах общего параллелипипеда и кодируются кривой Мортона
+         * (30 бит для небольших наборов, 63 бита для больших), коды сортируются поразрядно, после чего иерархия
+         * строится за O(n). Построение значительно быстрее SAH, но качество иерархии ниже. Каждый уровень удлиняет
+         * общий префикс хотя бы на бит, поэтому глубина не превышает разрядности кода и индекса (меньше BVH_MAX_DEPTH)
+         */
+        void buildLinear(unsigned threads)
+        {
+            auto count = static_cast<uint32_t>(indices_.size());
+
+            // Параллелипипед центров
+            math::BBox<> centroidBounds = math::EmptyBBox();
+            for(const auto& c : centroids_) centroidBounds = math::Union(centroidBounds, c);
+
+            // Разрядность кодов
+            bool wide = count > BVH_LBVH_NARROW_CODES_LIMIT;
+            unsigned bitsPerAxis = wide ? 21u : 10u;
+            float quantization = static_cast<float>((1u << bitsPerAxis) - 1u);
+            math::Vec3<float> extent = centroidBounds.max - centroidBounds.min;
+            math::Vec3<float> scale = {
+                    extent.x > 0.0f ? quantization / extent.x : 0.0f,
+                    extent.y > 0.0f ? quantization / extent.y : 0.0f,
+                    extent.z > 0.0f ? quantization / extent.z : 0.0f
+            };
+
+            // Коды Мортона
+            mortonCodes_.resize(count);
+            parallelFor(count, threads, [&](uint32_t from, uint32_t to, unsigned){
+                for(uint32_t i = from; i < to; i++){
+                    math::Vec3<float> q = (centroids_[i] - centroidBounds.min) * scale;
+                    auto x = static_cast<uint64_t>(q.x), y = static_cast<uint64_t>(q.y), z = static_cast<uint64_t>(q.z);
+                    mortonCodes_[i] = wide ?
+                            (expandBits21(x) << 2u) | (expandBits21(y) << 1u) | expandBits21(z) :
+                            (expandBits10(x) << 2u) | (expandBits10(y) << 1u) | expandBits10(z);
+                }
+            });
+
+            // Сортировка
+            radixSort(wide ? 63u : 30u, threads);
+
+            // Внутренние узлы промежуточной иерархии (корень - нулевой)
+            std::vector<LinearNode> linearNodes(count - 1);
+            parallelFor(count - 1, threads, [&](uint32_t from, uint32_t to, unsigned){
+                for(uint32_t i = from; i < to; i++) linearNodes[i] = buildLinearNode(i);
+            });
+
+            // Перенос в итоговый формат узлов (единственный примитив - иерархия из одного листа)
+            emitLinear(linearNodes, 0, count == 1);
+            mortonCodes_.clear();
+            mortonCodes_.shrink_to_fit();
+        }
+
+        /**
+         * \brief Пересчет границ узлов непрерывного диапазона (поддерева) снизу вверх
+         * \param first Индекс корня поддерева
+         * \param last Индекс, следующий за последним узлом поддерева
+         * \param boxes Описывающие параллелипипеды примитивов
+         *
+         * \details Узлы хранятся в порядке обхода в глубину, поэтому поддерево занимает непрерывный диапазон, а
+         * потомки всегда следуют после родителя - при обратном проходе они уже пересчитаны
+         */
+        void refitRange(uint32_t first, uint32_t last, const std::vector<math::BBox<>>& boxes)
+        {
+            for(uint32_t i = last; i-- > first;)
+            {
+                BVHNode& node = nodes_[i];
+                if(node.primitiveCount > 0){
+                    math::BBox<> bounds = math::EmptyBBox();
+                    for(uint32_t j = node.offset; j < node.offset + node.primitiveCount; j++){
+                        bounds = math::Union(bounds, boxes[indices_[j]]);
+                    }
+                    node.bounds = bounds;
+                } else {
+                    node.bounds = math::Union(nodes_[i + 1].bounds, nodes_[node.offset].bounds);
+                }
+            }
+        }
+
+        /**
+         * \brief Разбить верхние уровни иерархии на независимые поддеревья
+         * \param index Индекс корня текущего поддерева
+         * \param end Индекс, следующий за последним узлом текущего поддерева
+         * \param depth Оставшаяся глубина разбиения
+         * \param top Внутренние узлы выше поддеревьев (в порядке обхода в глубину)
+         * \param ranges Диапазоны узлов поддеревьев
+         */
+        void splitSubtrees(uint32_t index, uint32_t end, unsigned depth, std::vector<uint32_t>* top, std::vector<std::pair<uint32_t,uint32_t>>* ranges) const
+        {
+            const BVHNode& node = nodes_[index];
+            if(depth == 0 || node.primitiveCount > 0){
+                ranges->emplace_back(index, end);
+                return;
+            }
+
+            top->push_back(index);
+            splitSubtrees(index + 1, node.offset, depth - 1, top, ranges);
+            splitSubtrees(node.offset, end, depth - 1, top, ranges);
+        }
+
+    public:
+        /**
+         * \brief Конструктор по умолчанию (пустая иерархия)
+         */
+        BVHTree() = default;
+
+        /**
+         * \brief Параллельно выполнить операцию над частями диапазона [0, count)
+         * \tparam F Тип операции вида void(uint32_t begin, uint32_t end, unsigned part)
+         * \param count Размер диапазона
+         * \param parts Кол-во частей (потоков)
+         * \param operation Операция
+         */
+        template <typename F>
+        static void parallelFor(uint32_t count, unsigned parts, const F& operation)
+        {
+            if(parts <= 1){
+                operation(0, count, 0);
+                return;
+            }
+
+            std::vector<std::thread> workers{};
+            uint32_t chunk = count / parts;
+            for(unsigned i = 0; i < parts; i++){
+                uint32_t from = chunk * i;
+                uint32_t to = (i == parts - 1) ? count : from + chunk;
+                workers.emplace_back([&operation, from, to, i](){ operation(from, to, i); });
+            }
+
+            for(auto& t : workers) t.join();
+        }
+
+        /**
+         * \brief Построение иерархии
+         * \param boxes Описывающие параллелипипеды примитивов (индекс в массиве - индекс примитива)
+         * \param threads Кол-во потоков (результат построения от него не зависит)
+         * \param method Способ построения (качество иерархии или скорость построения)
+         */
+        void build(const std::vector<math::BBox<>>& boxes, unsigned threads = 1, BVHBuildMethod method = eBinnedSAH)
+        {
+            nodes_.clear();
+            indices_.resize(boxes.size());
+            centroids_.resize(boxes.size());
+            boxes_ = &boxes;
+
+            for(uint32_t i = 0; i < boxes.size(); i++){
+                indices_[i] = i;
+                centroids_[i] = math::Center(boxes[i]);
+            }
+
+            if(!boxes.empty()){
+                nodes_.reserve(boxes.size() * 2 - 1);
+                if(method == eLinearMorton) buildLinear(std::max(threads, 1u));
+                else buildRecursive(0, static_cast<uint32_t>(boxes.size()), std::max(threads, 1u), &nodes_);
+            }
+
+            boxes_ = nullptr;
+            centroids_.clear();
+            centroids_.shrink_to_fit();
+
+            buildCost_ = this->sahCost();
+        }
+
+        /**
+         * \brief Обновление границ узлов после перемещения примитивов (без изменения структуры)
+         * \param boxes Новые описывающие параллелипипеды примитивов (в том же порядке, что и при построении)
+         * \param threads Кол-во потоков
+         *
+         * \details Верхние уровни иерархии разбиваются на независимые поддеревья, которые пересчитываются
+         * параллельно, после чего последовательно пересчитываются узлы над ними. Качество иерархии при этом
+         * ухудшается по мере перемещения примитивов (см. getCostRatio)
+         */
+        void refit(const std::vector<math::BBox<>>& boxes, unsigned threads = 1)
+        {
+            if(nodes_.empty()) return;
+
+            if(threads <= 1){
+                refitRange(0, static_cast<uint32_t>(nodes_.size()), boxes);
+                return;
+            }
+
+            // Глубина разбиения - с запасом по кол-ву поддеревьев на поток (для балансировки)
+            unsigned depth = 2;
+            while((1u << depth) < threads * 4) depth++;
+
+            std::vector<uint32_t> top{};
+            std::vector<std::pair<uint32_t,uint32_t>> ranges{};
+            splitSubtrees(0, static_cast<uint32_t>(nodes_.size()), depth, &top, &ranges);
+
+            parallelFor(static_cast<uint32_t>(ranges.size()), std::min(threads, static_cast<unsigned>(ranges.size())), [&](uint32_t from, uint32_t to, unsigned){
+                for(uint32_t i = from; i < to; i++) refitRange(ranges[i].first, ranges[i].second, boxes);
+            });
+
+            // Узлы над поддеревьями (в обратном порядке - потомки раньше родителей)
+            for(auto it = top.rbegin(); it != top.rend(); ++it){
+                BVHNode& node = nodes_[*it];
+                node.bounds = math::Union(nodes_[*it + 1].bounds, nodes_[node.offset].bounds);
+            }
+        }
+
+        /**
+         * \brief Стоимость иерархии по эвристике площади поверхности (SAH)
+         * \return Ожидаемая стоимость поиска пересечения (в единицах стоимости пересечения с примитивом)
+         */
+        float sahCost() const
+        {
+            if(nodes_.empty()) return 0.0f;
+
+            float cost = 0.0f;
+            for(const auto& node : nodes_){
+                float area = math::SurfaceArea(node.bounds);
+                cost += node.primitiveCount > 0 ? area * static_cast<float>(node.primitiveCount) : area * BVH_TRAVERSAL_COST;
+            }
+
+            float rootArea = math::SurfaceArea(nodes_[0].bounds);
+            return rootArea > 0.0f ? cost / rootArea : cost;
+        }
+
+        /**
+         * \brief Отношение текущей SAH-стоимости к стоимости сразу после построения
+         * \return Во сколько раз ухудшилось качество иерархии
+         */
+        float getCostRatio() const
+        {
+            return buildCost_ > 0.0f ? this->sahCost() / buildCost_ : 1.0f;
+        }
+
+        /**
+         * \brief Получить узлы иерархии
+         * \return Константная ссылка на массив узлов
+         */
+        const std::vector<BVHNode>& getNodes() const
+        {
+            return nodes_;
+        }
+
+        /**
+         * \brief Получить индексы примитивов в порядке их следования в листьях
+         * \return Константная ссылка на массив индексов
+         */
+        const std::vector<uint32_t>& getIndices() const
+        {
+            return indices_;
+        }
+
+        /**
+         * \brief Поиск ближайшего пересечения луча с примитивами иерархии
+         * \tparam F Тип функтора пересечения с примитивом
+         * \param ray Луч
+         * \param tMin Минимальное расстояние
+         * \param tMax Максимальное расстояние
+         * \param intersect Функтор вида bool(uint32_t leafIndex, float tMin, float& closest), где leafIndex - индекс
+         * в массиве getIndices(). При пересечении функтор должен уменьшить closest до расстояния пересечения
+         * \return Было ли пересечение с каким-либо примитивом
+         */
+        template <typename F>
+        bool traverse(const math::Ray& ray, float tMin, float tMax, F&& intersect) const
+        {
+            return traverse(nodes_.data(), static_cast<uint32_t>(nodes_.size()), ray, tMin, tMax, std::forward<F>(intersect));
+        }
+
+        /**
+         * \brief Поиск ближайшего пересечения луча по внешнему массиву узлов (например, отображенному из файла)
+         * \tparam F Тип функтора пересечения с примитивом
+         * \param nodes Узлы иерархии (в формате BVHTree)
+         * \param nodeCount Кол-во узлов
+         * \param ray Луч
+         * \param tMin Минимальное расстояние
+         * \param tMax Максимальное расстояние
+         * \param intersect Функтор вида bool(uint32_t leafIndex, float tMin, float& closest)
+         * \return Было ли пересечение с каким-либо примитивом
+         */
+        template <typename F>
+        static bool traverse(const BVHNode* nodes, uint32_t nodeCount, const math::Ray& ray, float tMin, float tMax, F&& intersect)
+        {
+            if(nodeCount == 0) return false;
+
+            // Расстояние до ближайшего пересечения и было ли оно
+            float closest = tMax;
+            bool hitAnything = false;
+
+            // Стек отложенных узлов (индекс узла и расстояние до входа в его параллелипипед)
+            uint32_t stackNodes[BVH_STACK_SIZE];
+            float stackDistances[BVH_STACK_SIZE];
+            unsigned stackSize = 0;
+
+            // Начать с корня, если луч вообще пересекает сцену
+            float tEnter = 0.0f;
+            if(!ray.intersectsBBox(nodes[0].bounds, tMin, closest, &tEnter)) return false;
+            uint32_t current = 0;
+
+            while(true)
+            {
+                const BVHNode& node = nodes[current];
+
+                // Лист - проверка пересечения со всеми примитивами
+                if(node.primitiveCount > 0)
+                {
+                    for(uint32_t i = node.offset; i < node.offset + node.primitiveCount; i++){
+                        if(intersect(i, tMin, closest)) hitAnything = true;
+                    }
+                }
+                // Внутренний узел - сначала посещается ближайший потомок, дальний откладывается в стек
+                else
+                {
+                    uint32_t left = current + 1;
+                    uint32_t right = node.offset;
+                    float tLeft = 0.0f, tRight = 0.0f;
+                    bool hitLeft = ray.intersectsBBox(nodes[left].bounds, tMin, closest, &tLeft);
+                    bool hitRight = ray.intersectsBBox(nodes[right].bounds, tMin, closest, &tRight);
+
+                    if(hitLeft && hitRight)
+                    {
+                        if(tRight < tLeft){
+                            std::swap(left, right);
+                            std::swap(tLeft, tRight);
+                        }
+
+                        stackNodes[stackSize] = right;
+                        stackDistances[stackSize] = tRight;
+                        stackSize++;
+                        current = left;
+                        continue;
+                    }
+
+                    if(hitLeft){ current = left; continue; }
+                    if(hitRight){ current = right; continue; }
+                }
+
+                // Извлечь из стека следующий узел, пропуская те, что дальше уже найденного пересечения
+                bool found = false;
+                while(stackSize > 0){
+                    stackSize--;
+                    if(stackDistances[stackSize] <= closest){
+                        current = stackNodes[stackSize];
+                        found = true;
+                        break;
+                    }
+                }
+
+                if(!found) break;
+            }
+
+            return hitAnything;
+        }
+
+        /**
+         * \brief Поиск любого пересечения луча с примитивами иерархии (завершается на первом найденном)
+         * \tparam F Тип функтора пересечения с примитивом
+         * \param ray Луч
+         * \param tMin Минимальное расстояние
+         * \param tMax Максимальное расстояние
+         * \param intersect Функтор вида bool(uint32_t leafIndex), где leafIndex - индекс в массиве getIndices()
+         * \return Было ли пересечение с каким-либо примитивом
+         */
+        template <typename F>
+        bool traverseAny(const math::Ray& ray, float tMin, float tMax, F&& intersect) const
+        {
+            return traverseAny(nodes_.data(), static_cast<uint32_t>(nodes_.size()), ray, tMin, tMax, std::forward<F>(intersect));
+        }
+
+        /**
+         * \brief Поиск любого пересечения луча по внешнему массиву узлов
+         * \tparam F Тип функтора пересечения с примитивом
+         * \param nodes Узлы иерархии (в формате BVHTree)
+         * \param nodeCount Кол-во узлов
+         * \param ray Луч
+         * \param tMin Минимальное расстояние
+         * \param tMax Максимальное расстояние
+         * \param intersect Функтор вида bool(uint32_t leafIndex)
+         * \return Было ли пересечение с каким-либо примитивом
+         *
+         * \details Отрезок луча не сокращается, поэтому порядок обхода потомков не важен - расстояния до
+         * параллелипипедов не сравниваются и в стек не сохраняются
+         */
+        template <typename F>
+        static bool traverseAny(const BVHNode* nodes, uint32_t nodeCount, const math::Ray& ray, float tMin, float tMax, F&& intersect)
+        {
+            if(nodeCount == 0) return false;
+
+            // Стек отложенных узлов
+            uint32_t stack[BVH_STACK_SIZE];
+            unsigned stackSize = 0;
+
+            if(!ray.intersectsBBox(nodes[0].bounds, tMin, tMax, nullptr)) return false;
+            uint32_t current = 0;
+
+            while(true)
+            {
+                const BVHNode& node = nodes[current];
+
+                // Лист - первое же пересечение завершает поиск
+                if(node.primitiveCount > 0)
+                {
+                    for(uint32_t i = node.offset; i < node.offset + node.primitiveCount; i++){
+                        if(intersect(i)) return true;
+                    }
+                }
+                // Внутренний узел - левый потомок посещается сразу, правый откладывается в стек
+                else
+                {
+                    uint32_t left = current + 1;
+                    uint32_t right = node.offset;
+                    bool hitLeft = ray.intersectsBBox(nodes[left].bounds, tMin, tMax, nullptr);
+                    bool hitRight = ray.intersectsBBox(nodes[right].bounds, tMin, tMax, nullptr);
+
+                    if(hitLeft && hitRight){
+                        stack[stackSize++] = right;
+                        current = left;
+                        continue;
+                    }
+
+                    if(hitLeft){ current = left; continue; }
+                    if(hitRight){ current = right; continue; }
+                }
+
+                if(stackSize == 0) break;
+                current = stack[--stackSize];
+            }
+
+            return false;
+        }
+    };
+
+    /**
+     * \brief Иерархия ограничивающих объемов над элементами сцены
+     *
+     * \details Наследуется от Hittable и может заменить собой List. Ограниченные элементы помещаются в иерархию,
+     * неограниченные (плоскости) проверяются отдельно линейным перебором
+     */
+    class BVH : public Hittable
+    {
+    protected:
+        /// Иерархия
+        BVHTree tree_;
+        /// Ограниченные элементы сцены (в порядке следования в листьях иерархии)
+        std::vector<std::shared_ptr<Hittable>> elements_;
+        /// Неограниченные элементы сцены (не помещаются в иерархию)
+        std::vector<std::shared_ptr<Hittable>> unbounded_;
+        /// Способ построения (используется и при автоматическом перестроении)
+        BVHBuildMethod method_ = eBinnedSAH;
+
+    public:
+        /**
+         * \brief Конструктор по умолчанию
+         */
+        BVH():Hittable(){}
+
+        /**
+         * \brief Основной конструктор
+         * \param elements Элементы сцены
+         * \param threads Кол-во потоков построения
+         * \param method Способ построения
+         */
+        explicit BVH(const std::vector<std::shared_ptr<Hittable>>& elements, unsigned threads = 1, BVHBuildMethod method = eBinnedSAH):Hittable()
+        {
+            this->build(elements, threads, method);
+        }
+
+        /**
+         * \brief Деструктор
+         */
+        ~BVH() override = default;
+
+        /**
+         * \brief Построение иерархии
+         * \param elements Элементы сцены
+         * \param threads Кол-во потоков построения (результат построения от него не зависит)
+         * \param method Способ построения (может выбираться для каждого кадра отдельно)
+         */
+        virtual void build(const std::vector<std::shared_ptr<Hittable>>& elements, unsigned threads = 1, BVHBuildMethod method = eBinnedSAH)
+        {
+            std::vector<std::shared_ptr<Hittable>> bounded;
+            std::vector<math::BBox<>> boxes;
+            unbounded_.clear();
+            method_ = method;
+
+            // Разделить элементы на ограниченные и неограниченные
+            for(const auto& element : elements)
+            {
+                math::BBox<> box{};
+                if(element->boundingBox(&box)){
+                    bounded.push_back(element);
+                    boxes.push_back(box);
+                } else {
+                    unbounded_.push_back(element);
+                }
+            }
+
+            // Построить иерархию и упорядочить элементы так, как они следуют в листьях
+            tree_.build(boxes, threads, method);
+            elements_.clear();
+            elements_.reserve(bounded.size());
+            for(auto index : tree_.getIndices()) elements_.push_back(bounded[index]);
+        }
+
+        /**
+         * \brief Обновление иерархии после перемещения элементов
+         * \param threads Кол-во потоков
+         * \return Была ли иерархия перестроена полностью
+         *
+         * \details Границы узлов пересчитываются без изменения структуры. Если качество иерархии (SAH-стоимость
+         * относительно стоимости после последнего построения) ухудшилось более чем в BVH_REFIT_REBUILD_THRESHOLD раз,
+         * либо какой-то из элементов перестал быть ограниченным, иерархия перестраивается полностью
+         */
+        virtual bool refit(unsigned threads = 1)
+        {
+            // Новые параллелипипеды элементов (в порядке исходных индексов иерархии)
+            const auto& indices = tree_.getIndices();
+            std::vector<math::BBox<>> boxes(elements_.size());
+            std::vector<char> bounded(std::max(threads, 1u), 1);
+            BVHTree::parallelFor(static_cast<uint32_t>(elements_.size()), std::max(threads, 1u), [&](uint32_t from, uint32_t to, unsigned part){
+                for(uint32_t i = from; i < to; i++){
+                    if(!elements_[i]->boundingBox(&boxes[indices[i]])) bounded[part] = 0;
+                }
+            });
+
+            if(std::find(bounded.begin(), bounded.end(), 0) == bounded.end())
+            {
+                tree_.refit(boxes, threads);
+                if(tree_.getCostRatio() <= BVH_REFIT_REBUILD_THRESHOLD) return false;
+            }
+
+            // Полное перестроение
+            std::vector<std::shared_ptr<Hittable>> elements(elements_);
+            elements.insert(elements.end(), unbounded_.begin(), unbounded_.end());
+            this->build(elements, threads, method_);
+            return true;
+        }
+
+        /**
+         * \brief Отношение текущей SAH-стоимости иерархии к стоимости после последнего построения
+         * \return Во сколько раз ухудшилось качество иерархии
+         */
+        float getCostRatio() const
+        {
+            return tree_.getCostRatio();
+        }
+
+        /**
+         * \brief Получить кол-во узлов иерархии
+         * \return Кол-во узлов
+         */
+        size_t getNodeCount() const
+        {
+            return tree_.getNodes().size();
+        }
+
+        /**
+         * \brief Пересечение всех объектов сцены и луча
+         * \param ray Луч
+         * \param tMin Минимальное расстояние
+         * \param tMax Максимальное расстояние
+         * \param hitInfo Информация о пересечении
+         * \return Было ли пересечение с объектом
+         */
+        bool intersectsRay(const math::Ray& ray, float tMin, float tMax, HitInfo* hitInfo) const override
+        {
+            // Информация о пересечении
+            HitInfo hit{};
+            // Было ли пересечение с каким-либо объектом
+            bool hitAnything = false;
+            // Расстояние до ближ. пересечения
+            float closest = tMax;
+
+            // Неограниченные элементы (их обычно мало) проверяются первыми, чтобы сократить дальность для иерархии
+            for(const auto& element : unbounded_)
+            {
+                if(element->intersectsRay(ray,tMin,closest,&hit)){
+                    hitAnything = true;
+                    closest = hit.t;
+                    if(hitInfo != nullptr) *hitInfo = hit;
+                }
+            }
+
+            // Обход иерархии
+            bool hitTree = tree_.traverse(ray, tMin, closest, [&](uint32_t index, float tMinLeaf, float& tClosest){
+                if(elements_[index]->intersectsRay(ray,tMinLeaf,tClosest,&hit)){
+                    tClosest = hit.t;
+                    if(hitInfo != nullptr) *hitInfo = hit;
+                    return true;
+                }
+                return false;
+            });
+
+            return hitAnything || hitTree;
+        }
+
+        /**
+         * \brief Перекрывает ли какой-либо элемент луч на заданном отрезке
+         * \param ray Луч
+         * \param tMin Минимальное расстояние
+         * \param tMax Максимальное расстояние
+         * \return Было ли пересечение с каким-либо элементом
+         */
+        bool occluded(const math::Ray& ray, float tMin, float tMax) const override
+        {
+            for(const auto& element : unbounded_){
+                if(element->occluded(ray,tMin,tMax)) return true;
+            }
+
+            return tree_.traverseAny(ray, tMin, tMax, [&](uint32_t index){
+                return elements_[index]->occluded(ray,tMin,tMax);
+            });
+        }
+
+        /**
+         * \brief Описывающий параллелипипед всех элементов
+         * \param bboxOut Описывающий параллелипипед в мировых координатах
+         * \return Ограничены ли все элементы
+         */
+        bool boundingBox(math::BBox<>* bboxOut) const override
+        {
+            if(!unbounded_.empty() || tree_.getNodes().empty()) return false;
+            if(bboxOut != nullptr) *bboxOut = tree_.getNodes()[0].bounds;
+            return true;
+        }
+    };
+}
@@ -11,6 +11,10 @@ namespace scene
         math::Vec3<float> position_;
         /// Ориентация в пространстве
         math::Vec3<float> orientation_;
+        /// Матрица поворота из мирового пространства в пространство объекта (применяется к лучу)
+        math::Mat3<float> toObject_;
+        /// Матрица поворота из пространства объекта в мировое (обратная к toObject_)
+        math::Mat3<float> toWorld_;
         /// Размеры ящика
         math::Vec3<float> sizes_;
         /// Инвертировать нормали
@@ -21,7 +25,7 @@ namespace scene
          * \brief Конструктор по умолчанию
          */
         Box():
-        Hittable(),position_({0.0f,0.0f,0.0f}),orientation_({0.0f,0.0f,0.0f}),sizes_({1.0f,1.0f,1.0f}),flipNormals_(false){}
+        Hittable(),position_({0.0f,0.0f,0.0f}),orientation_({0.0f,0.0f,0.0f}),toObject_(1.0f),toWorld_(1.0f),sizes_({1.0f,1.0f,1.0f}),flipNormals_(false){}
 
         /**
          * \brief Основной конструктор
@@ -37,13 +41,32 @@ namespace scene
           const math::Vec3<float>& sizes = {1.0f,1.0f,1.0f},
           const math::Vec3<float>& orientation = {0.0f,0.0f,0.0f},
           bool flipped = false):
-        Hittable(materialPtr),position_(position),orientation_(orientation),sizes_(sizes),flipNormals_(flipped){}
+        Hittable(materialPtr),position_(position),orientation_(orientation),toObject_(math::GetRotationMat(-orientation)),toWorld_(math::Transpose(toObject_)),sizes_(sizes),flipNormals_(flipped){}
 
         /**
          * \brief Деструктор
          */
         ~Box() override = default;
 
+        /**
+         * \brief Получить положение центра ящика
+         * \return Положение
+         */
+        const math::Vec3<float>& getPosition() const
+        {
+            return position_;
+        }
+
+        /**
+         * \brief Задать положение центра ящика
+         * \param position Положение
+         * \details После перемещения содержащая объект иерархия должна быть обновлена (BVH::refit)
+         */
+        void setPosition(const math::Vec3<float>& position)
+        {
+            position_ = position;
+        }
+
         /**
          * \brief Пересечение луча и прямоугольника
          * \param ray Луч
@@ -59,12 +82,12 @@ namespace scene
 
             // Для того чтобы трансформировать объект (положение, ориентацию) нужно применить обратную трансформацию к лучу
             // T.е сдвигается не сам объект, а луч относительно объекта.
-            auto inverseRotation = math::GetRotationMat(-orientation_);
+            // Матрица обратного поворота (toObject_) вычисляется один раз в конструкторе
 
             // Траснформированный луч
             math::Ray transformedRay(
-                    inverseRotation * (ray.getOrigin() - position_),
-                    inverseRotation * ray.getDirection());
+                    toObject_ * (ray.getOrigin() - position_),
+                    toObject_ * ray.getDirection());
 
             // Половинные ширина, высота и длина
             float halfWidth = this->sizes_.x / 2.0f;
@@ -85,14 +108,14 @@ namespace scene
                 {
                     default:
                     case 0:
-                        if(transformedRay.intersectsAARectangleXy(-halfLength,-halfWidth,halfWidth,-halfHeight,halfLength,tMin,tClosest,&t)){
+                        if(transformedRay.intersectsAARectangleXy(-halfLength,-halfWidth,halfWidth,-halfHeight,halfHeight,tMin,tClosest,&t)){
                             hitAnything = true;
                             tClosest = t;
                             normalClosest = {0.0f,0.0f,-1.0f};
                         }
                         break;
                     case 1:
-                        if(transformedRay.intersectsAARectangleXy(halfLength,-halfWidth,halfWidth,-halfHeight,halfLength,tMin,tClosest,&t)){
+                        if(transformedRay.intersectsAARectangleXy(halfLength,-halfWidth,halfWidth,-halfHeight,halfHeight,tMin,tClosest,&t)){
                             hitAnything = true;
                             tClosest = t;
                             normalClosest = {0.0f,0.0f,1.0f};
@@ -137,7 +160,8 @@ namespace scene
                 hitInfo->point = ray.getOrigin() + (ray.getDirection() * t);
                 hitInfo->normal = normalClosest;
                 hitInfo->frontFaceSurface = true;
-                hitInfo->materialPtr = this->materialPtr_;
+                hitInfo->materialPtr = this->materialPtr_.get();
+                hitInfo->objectPtr = this;
 
                 // Если нужно инвертировать нормали
                 if(flipNormals_){
@@ -151,10 +175,34 @@ namespace scene
                 }
 
                 // Поскольку нормаль считалась в пространстве объекта ее нужно перевести в глобальное пространство
-                hitInfo->normal = math::GetRotationMat(orientation_) * hitInfo->normal;
+                hitInfo->normal = toWorld_ * hitInfo->normal;
             }
 
             return hitAnything;
         }
+
+        /**
+         * \brief Описывающий параллелипипед ящика
+         * \param bboxOut Описывающий параллелипипед в мировых координатах
+         * \return Ограничен ли объект
+         */
+        bool boundingBox(math::BBox<>* bboxOut) const override
+        {
+            if(bboxOut != nullptr)
+            {
+                // Половинные размеры
+                math::Vec3<float> half = this->sizes_ / 2.0f;
+
+                // Объединить все углы ящика в мировых координатах
+                math::BBox<> result = math::EmptyBBox();
+                for(unsigned i = 0; i < 8; i++){
+                    math::Vec3<float> corner = {(i & 1u) ? half.x : -half.x, (i & 2u) ? half.y : -half.y, (i & 4u) ? half.z : -half.z};
+                    result = math::Union(result, position_ + (toWorld_ * corner));
+                }
+
+                *bboxOut = result;
+            }
+            return true;
+        }
     };
 }
\ No newline at end of file
@@ -0,0 +1,178 @@
+#pragma once
+
+#include "../Utils.h"
+
+namespace scene
+{
+    /**
+     * \brief Экземпляр геометрии (instance)
+     *
+     * \details Ссылается на общую геометрию (нижний уровень - BLAS, как правило BVH в пространстве объекта) и хранит
+     * лишь заранее вычисленную аффинную трансформацию 3x4 из мирового пространства в пространство объекта. Память
+     * сцены пропорциональна кол-ву уникальной геометрии, а не кол-ву экземпляров. Верхний уровень (TLAS) - обычный
+     * BVH над экземплярами
+     */
+    class Instance : public Hittable
+    {
+    private:
+        /// Общая геометрия экземпляра (в пространстве объекта)
+        std::shared_ptr<Hittable> geometry_;
+        /// Линейная часть трансформации из мирового пространства в пространство объекта
+        math::Mat3<float> toObject_;
+        /// Смещение трансформации из мирового пространства в пространство объекта
+        math::Vec3<float> toObjectOffset_;
+        /// Трансформация нормалей из пространства объекта в мировое (транспонированная toObject_)
+        math::Mat3<float> normalToWorld_;
+        /// Описывающий параллелипипед в мировых координатах
+        math::BBox<> bounds_;
+        /// Ограничена ли геометрия
+        bool bounded_;
+
+        /**
+         * \brief Вычисление трансформации в пространство объекта и мирового описывающего параллелипипеда
+         * \param toWorld Линейная часть трансформации из пространства объекта в мировое
+         * \param position Положение объекта в мировом пространстве
+         */
+        void setTransform(const math::Mat3<float>& toWorld, const math::Vec3<float>& position)
+        {
+            toObject_ = math::Inverse(toWorld);
+            toObjectOffset_ = -(toObject_ * position);
+            normalToWorld_ = math::Transpose(toObject_);
+
+            // Описывающий параллелипипед - объединение трансформированных углов параллелипипеда геометрии
+            math::BBox<> local{};
+            bounded_ = geometry_ != nullptr && geometry_->boundingBox(&local);
+            bounds_ = math::EmptyBBox();
+            if(bounded_){
+                for(unsigned i = 0; i < 8; i++){
+                    math::Vec3<float> corner = {(i & 1u) ? local.max.x : local.min.x, (i & 2u) ? local.max.y : local.min.y, (i & 4u) ? local.max.z : local.min.z};
+                    bounds_ = math::Union(bounds_, position + (toWorld * corner));
+                }
+            }
+        }
+
+    public:
+        /**
+         * \brief Конструктор по умолчанию
+         */
+        Instance():Hittable(),toObject_(1.0f),toObjectOffset_({0.0f,0.0f,0.0f}),normalToWorld_(1.0f),bounds_(math::EmptyBBox()),bounded_(false){}
+
+        /**
+         * \brief Основной конструктор
+         * \param geometry Общая геометрия
+         * \param position Положение экземпляра
+         * \param orientation Ориентация в пространстве
+         * \param scale Масштаб
+         * \param materialPtr Материал (если задан, заменяет материал геометрии)
+         */
+        explicit Instance(
+                const std::shared_ptr<Hittable>& geometry,
+                const math::Vec3<float>& position = {0.0f,0.0f,0.0f},
+                const math::Vec3<float>& orientation = {0.0f,0.0f,0.0f},
+                const math::Vec3<float>& scale = {1.0f,1.0f,1.0f},
+                const std::shared_ptr<materials::Material>& materialPtr = nullptr):
+        Hittable(materialPtr),geometry_(geometry),toObjectOffset_({0.0f,0.0f,0.0f}),bounded_(false)
+        {
+            // Та же ориентация, что и у Box/Rectangle (GetRotationMat применяется к лучу с обратными углами)
+            this->setTransform(math::Transpose(math::GetRotationMat(-orientation)) * math::GetScaleMat(scale), position);
+        }
+
+        /**
+         * \brief Конструктор с произвольной аффинной трансформацией
+         * \param geometry Общая геометрия
+         * \param toWorld Линейная часть трансформации из пространства объекта в мировое
+         * \param position Положение экземпляра
+         * \param materialPtr Материал (если задан, заменяет материал геометрии)
+         */
+        Instance(
+                const std::shared_ptr<Hittable>& geometry,
+                const math::Mat3<float>& toWorld,
+                const math::Vec3<float>& position,
+                const std::shared_ptr<materials::Material>& materialPtr = nullptr):
+        Hittable(materialPtr),geometry_(geometry),toObjectOffset_({0.0f,0.0f,0.0f}),bounded_(false)
+        {
+            this->setTransform(toWorld, position);
+        }
+
+        /**
+         * \brief Деструктор
+         */
+        ~Instance() override = default;
+
+        /**
+         * \brief Получить общую геометрию
+         * \return Указатель на геометрию
+         */
+        const std::shared_ptr<Hittable>& getGeometry() const
+        {
+            return geometry_;
+        }
+
+        /**
+         * \brief Пересечение луча и экземпляра
+         * \param ray Луч
+         * \param tMin Минимальное расстояние
+         * \param tMax Максимальное расстояние
+         * \param hitInfo Информация о пересечении
+         * \return Было ли пересечение с объектом
+         */
+        bool intersectsRay(const math::Ray& ray, float tMin, float tMax, HitInfo* hitInfo) const override
+        {
+            if(geometry_ == nullptr) return false;
+
+            // Направление в пространстве объекта (с учетом масштаба его длина может отличаться от единицы)
+            math::Vec3<float> direction = toObject_ * ray.getDirection();
+            float scale = math::Length(direction);
+
+            // Луч в пространстве объекта (направление нормализуется, поэтому расстояния умножаются на длину)
+            math::Ray transformedRay(toObject_ * ray.getOrigin() + toObjectOffset_, direction);
+
+            HitInfo hit{};
+            if(!geometry_->intersectsRay(transformedRay, tMin * scale, tMax * scale, hitInfo != nullptr ? &hit : nullptr)){
+                return false;
+            }
+
+            if(hitInfo != nullptr)
+            {
+                // Перевод результата в мировое пространство (нормаль - транспонированной обратной матрицей)
+                hitInfo->t = hit.t / scale;
+                hitInfo->point = ray.getOrigin() + (ray.getDirection() * hitInfo->t);
+                hitInfo->normal = math::Normalize(normalToWorld_ * hit.normal);
+                hitInfo->frontFaceSurface = hit.frontFaceSurface;
+                hitInfo->materialPtr = this->materialPtr_ != nullptr ? this->materialPtr_.get() : hit.materialPtr;
+                hitInfo->objectPtr = this;
+            }
+
+            return true;
+        }
+
+        /**
+         * \brief Перекрывает ли экземпляр луч на заданном отрезке
+         * \param ray Луч
+         * \param tMin Минимальное расстояние
+         * \param tMax Максимальное расстояние
+         * \return Было ли пересечение с геометрией экземпляра
+         */
+        bool occluded(const math::Ray& ray, float tMin, float tMax) const override
+        {
+            if(geometry_ == nullptr) return false;
+
+            math::Vec3<float> direction = toObject_ * ray.getDirection();
+            float scale = math::Length(direction);
+            math::Ray transformedRay(toObject_ * ray.getOrigin() + toObjectOffset_, direction);
+
+            return geometry_->occluded(transformedRay, tMin * scale, tMax * scale);
+        }
+
+        /**
+         * \brief Описывающий параллелипипед экземпляра
+         * \param bboxOut Описывающий параллелипипед в мировых координатах
+         * \return Ограничен ли объект
+         */
+        bool boundingBox(math::BBox<>* bboxOut) const override
+        {
+            if(bounded_ && bboxOut != nullptr) *bboxOut = bounds_;
+            return bounded_;
+        }
+    };
+}
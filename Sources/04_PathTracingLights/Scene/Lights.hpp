@@ -0,0 +1,206 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "../Utils.h"
+
+namespace scene
+{
+    /**
+     * \brief Способ сочетания явной выборки источников и разбросанных лучей (multiple importance sampling)
+     */
+    enum MisHeuristic
+    {
+        /// Без сочетания - свет источников из списка учитывается только явной выборкой
+        eMisNone,
+        /// Балансная эвристика (вес пропорционален плотности)
+        eMisBalance,
+        /// Степенная эвристика (вес пропорционален квадрату плотности)
+        eMisPower
+    };
+
+    /**
+     * \brief Выбранная точка на источнике света
+     */
+    struct LightSample
+    {
+        /// Направление от освещаемой точки к точке источника (единичный вектор)
+        math::Vec3<float> direction = {};
+        /// Расстояние до точки источника
+        float distance = 0.0f;
+        /// Плотность вероятности направления (по телесному углу, с учетом вероятности выбора источника)
+        float pdf = 0.0f;
+        /// Излучаемый источником цвет
+        math::Vec3<float> emitted = {};
+    };
+
+    /**
+     * \brief Список источников света для явной выборки (next event estimation)
+     *
+     * \details Источниками считаются элементы сцены, материал которых излучает свет, а геометрия поддерживает
+     * выборку точек по площади (прямоугольники, сферы). Излучающие объекты других типов (и вложенные в экземпляры)
+     * в список не попадают - их свет по-прежнему находят только разбросанные лучи.
+     *
+     * Направление на источник может быть получено обеими стратегиями, поэтому вклад каждой умножается на вес
+     * эвристики (в сумме веса дают единицу): явная выборка хороша для маленьких источников и широких отражений,
+     * разбросанные лучи - для узкого конуса шероховатого металла, где случайная точка источника почти всегда
+     * оказывается вне конуса, а попавшая в него дает очень яркий семпл
+     */
+    class LightList
+    {
+    private:
+        /// Источники света
+        std::vector<const Hittable*> lights_;
+        /// Способ сочетания стратегий
+        MisHeuristic heuristic_ = eMisPower;
+
+        /**
+         * \brief Вес стратегии по эвристике
+         * \param pdf Плотность вероятности направления для оцениваемой стратегии
+         * \param otherPdf Плотность вероятности того же направления для другой стратегии
+         * \return Вес
+         */
+        float heuristicWeight(float pdf, float otherPdf) const
+        {
+            if(pdf <= 0.0f) return 0.0f;
+
+            // Через отношение плотностей (квадраты самих плотностей у скользящих направлений могут переполниться)
+            float ratio = std::min(otherPdf / pdf, 1e8f);
+            if(heuristic_ == eMisPower) ratio *= ratio;
+            return 1.0f / (1.0f + ratio);
+        }
+
+    public:
+        /**
+         * \brief Конструктор по умолчанию (пустой список - явная выборка отключена)
+         */
+        LightList() = default;
+
+        /**
+         * \brief Основной конструктор
+         * \param elements Элементы сцены
+         * \param heuristic Способ сочетания явной выборки и разбросанных лучей
+         */
+        explicit LightList(const std::vector<std::shared_ptr<Hittable>>& elements, MisHeuristic heuristic = eMisPower):heuristic_(heuristic)
+        {
+            for(const auto& element : elements)
+            {
+                const auto& material = element->getMaterial();
+                if(material == nullptr || element->area() <= 0.0f) continue;
+
+                math::Vec3<float> emitted = material->emittedColor();
+                if(emitted.x > 0.0f || emitted.y > 0.0f || emitted.z > 0.0f){
+                    lights_.push_back(element.get());
+                }
+            }
+        }
+
+        /**
+         * \brief Пуст ли список
+         * \return Да или нет
+         */
+        bool empty() const
+        {
+            return lights_.empty();
+        }
+
+        /**
+         * \brief Кол-во источников
+         * \return Кол-во
+         */
+        size_t size() const
+        {
+            return lights_.size();
+        }
+
+        /**
+         * \brief Входит ли объект в список
+         * \param object Объект (из информации о пересечении)
+         * \return Да или нет
+         */
+        bool contains(const Hittable* object) const
+        {
+            return object != nullptr && std::find(lights_.begin(), lights_.end(), object) != lights_.end();
+        }
+
+        /**
+         * \brief Выбрать точку на одном из источников
+         * \param point Освещаемая точка
+         * \param uLight Значение в пределах [0, 1) для выбора источника
+         * \param uPoint Пара значений в пределах [0, 1) для выбора точки на источнике
+         * \param sampleOut Выбранная точка
+         * \return Видна ли освещаемой точке лицевая (излучающая) сторона источника
+         *
+         * \details Источник выбирается равновероятно, точка - равномерно по площади. Плотность по площади 1/A
+         * переводится в плотность по телесному углу умножением на d^2 / cos (угол между нормалью источника и
+         * направлением на освещаемую точку)
+         */
+        bool sample(const math::Vec3<float>& point, float uLight, const math::Vec2<float>& uPoint, LightSample* sampleOut) const
+        {
+            if(lights_.empty()) return false;
+
+            auto index = std::min(static_cast<size_t>(uLight * static_cast<float>(lights_.size())), lights_.size() - 1);
+            const Hittable* light = lights_[index];
+
+            math::Vec3<float> lightPoint, lightNormal;
+            light->samplePoint(uPoint, &lightPoint, &lightNormal);
+
+            math::Vec3<float> toLight = lightPoint - point;
+            float distanceSquared = math::Dot(toLight, toLight);
+            if(distanceSquared <= 0.0f) return false;
+
+            float distance = sqrtf(distanceSquared);
+            math::Vec3<float> direction = toLight / distance;
+
+            // Свет излучается только лицевой стороной
+            float cosLight = -math::Dot(direction, lightNormal);
+            if(cosLight <= 0.0f) return false;
+
+            sampleOut->direction = direction;
+            sampleOut->distance = distance;
+            sampleOut->pdf = distanceSquared / (cosLight * light->area() * static_cast<float>(lights_.size()));
+            sampleOut->emitted = light->getMaterial()->emittedColor();
+            return true;
+        }
+
+        /**
+         * \brief Плотность вероятности того, что sample выберет точку, найденную лучом
+         * \param ray Луч (из освещаемой точки)
+         * \param hitInfo Информация о пересечении луча с источником
+         * \return Плотность по телесному углу (0, если объект не входит в список)
+         */
+        float pdf(const math::Ray& ray, const HitInfo& hitInfo) const
+        {
+            if(!contains(hitInfo.objectPtr)) return 0.0f;
+
+            float cosLight = std::fabs(math::Dot(ray.getDirection(), hitInfo.normal));
+            if(cosLight <= 0.0f) return 0.0f;
+            return (hitInfo.t * hitInfo.t) / (cosLight * hitInfo.objectPtr->area() * static_cast<float>(lights_.size()));
+        }
+
+        /**
+         * \brief Вес явной выборки источника
+         * \param lightPdf Плотность вероятности направления при явной выборке
+         * \param scatterPdf Плотность вероятности того же направления у разбросанных лучей
+         * \return Вес
+         */
+        float lightWeight(float lightPdf, float scatterPdf) const
+        {
+            return heuristic_ == eMisNone ? 1.0f : heuristicWeight(lightPdf, scatterPdf);
+        }
+
+        /**
+         * \brief Вес излучения источника, найденного разбросанным лучом
+         * \param scatterPdf Плотность вероятности направления разбросанного луча
+         * \param lightPdf Плотность вероятности того же направления при явной выборке (0 - источник не в списке)
+         * \return Вес
+         */
+        float scatterWeight(float scatterPdf, float lightPdf) const
+        {
+            if(lightPdf <= 0.0f) return 1.0f;
+            return heuristic_ == eMisNone ? 0.0f : heuristicWeight(scatterPdf, lightPdf);
+        }
+    };
+}
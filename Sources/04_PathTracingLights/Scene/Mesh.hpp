@@ -0,0 +1,273 @@
+#pragma once
+
+#include "BVH.hpp"
+
+namespace scene
+{
+    /**
+     * \brief Данные индексированной треугольной сетки
+     *
+     * \details Хранятся отдельно от Mesh и передаются по указателю, что позволяет нескольким объектам
+     * использовать одни и те же массивы
+     */
+    struct MeshData
+    {
+        /// Положения вершин
+        std::vector<math::Vec3<float>> positions;
+        /// Нормали вершин (пустой массив - используются нормали треугольников)
+        std::vector<math::Vec3<float>> normals;
+        /// Индексы вершин (по три на треугольник, обход против часовой стрелки для лицевой стороны)
+        std::vector<uint32_t> indices;
+
+        /**
+         * \brief Получить кол-во треугольников
+         * \return Кол-во треугольников
+         */
+        size_t getTriangleCount() const
+        {
+            return indices.size() / 3;
+        }
+    };
+
+    /**
+     * \brief Представление готовой к использованию сетки (массивы вершин, индексов и узлов иерархии)
+     *
+     * \details Массивы не копируются - они принадлежат объекту owner (данные, построенные в памяти, либо
+     * отображенный в память файл кэша), который удерживается пока существует представление
+     */
+    struct MeshView
+    {
+        /// Владелец памяти массивов
+        std::shared_ptr<const void> owner;
+        /// Положения вершин
+        const math::Vec3<float>* positions = nullptr;
+        /// Нормали вершин (nullptr - используются нормали треугольников)
+        const math::Vec3<float>* normals = nullptr;
+        /// Индексы вершин (по три на треугольник)
+        const uint32_t* indices = nullptr;
+        /// Узлы иерархии над треугольниками
+        const BVHNode* nodes = nullptr;
+        /// Индексы треугольников в порядке следования в листьях иерархии
+        const uint32_t* order = nullptr;
+        /// Кол-во вершин
+        uint32_t vertexCount = 0;
+        /// Кол-во треугольников
+        uint32_t triangleCount = 0;
+        /// Кол-во узлов иерархии
+        uint32_t nodeCount = 0;
+    };
+
+    /**
+     * \brief Треугольная сетка
+     *
+     * \details Для поиска пересечений с треугольниками строится собственная иерархия ограничивающих объемов
+     * (в пространстве сетки). Нормаль в точке пересечения интерполируется по барицентрическим координатам.
+     * Сетка может быть построена из MeshData, либо использовать готовые массивы (например, из кэша)
+     */
+    class Mesh : public Hittable
+    {
+    private:
+        /**
+         * \brief Данные сетки, построенной в памяти (владелец массивов представления)
+         */
+        struct Storage
+        {
+            /// Данные сетки
+            std::shared_ptr<const MeshData> data;
+            /// Иерархия над треугольниками сетки
+            BVHTree tree;
+        };
+
+        /// Массивы сетки
+        MeshView view_;
+
+        /**
+         * \brief Пересечение луча с треугольником
+         * \param ray Луч
+         * \param triangle Индекс треугольника
+         * \param tMin Минимальное расстояние
+         * \param tMax Максимальное расстояние
+         * \param tOut Расстояние до пересечения
+         * \param barycentricCoords Барицентрические координаты точки пересечения
+         * \return Было ли пересечение
+         */
+        bool intersectsTriangle(const math::Ray& ray, uint32_t triangle, float tMin, float tMax, float* tOut, math::Vec2<float>* barycentricCoords) const
+        {
+            const uint32_t* index = view_.indices + static_cast<size_t>(triangle) * 3;
+            const math::Vec3<float>* positions = view_.positions;
+            return ray.intersectsTriangleMT(positions[index[0]], positions[index[1]], positions[index[2]], tMin, tMax, tOut, barycentricCoords);
+        }
+
+    public:
+        /**
+         * \brief Конструктор по умолчанию
+         */
+        Mesh():Hittable(),view_(){}
+
+        /**
+         * \brief Основной конструктор
+         * \param materialPtr Материал
+         * \param data Данные сетки
+         * \param threads Кол-во потоков построения иерархии
+         * \param method Способ построения иерархии
+         */
+        Mesh(const std::shared_ptr<materials::Material>& materialPtr, const std::shared_ptr<const MeshData>& data,
+                unsigned threads = 1, BVHBuildMethod method = eBinnedSAH):
+        Hittable(materialPtr),view_()
+        {
+            auto storage = std::make_shared<Storage>();
+            storage->data = data;
+
+            // Описывающие параллелипипеды треугольников
+            std::vector<math::BBox<>> boxes(data->getTriangleCount());
+            for(size_t i = 0; i < boxes.size(); i++){
+                const uint32_t* index = data->indices.data() + i * 3;
+                math::BBox<> box = math::EmptyBBox();
+                for(unsigned j = 0; j < 3; j++) box = math::Union(box, data->positions[index[j]]);
+                boxes[i] = box;
+            }
+
+            storage->tree.build(boxes, threads, method);
+
+            view_.positions = data->positions.data();
+            view_.normals = data->normals.empty() ? nullptr : data->normals.data();
+            view_.indices = data->indices.data();
+            view_.nodes = storage->tree.getNodes().data();
+            view_.order = storage->tree.getIndices().data();
+            view_.vertexCount = static_cast<uint32_t>(data->positions.size());
+            view_.triangleCount = static_cast<uint32_t>(data->getTriangleCount());
+            view_.nodeCount = static_cast<uint32_t>(storage->tree.getNodes().size());
+            view_.owner = storage;
+        }
+
+        /**
+         * \brief Конструктор из готовых массивов (без построения иерархии и копирования)
+         * \param materialPtr Материал
+         * \param view Массивы сетки
+         */
+        Mesh(const std::shared_ptr<materials::Material>& materialPtr, const MeshView& view):
+        Hittable(materialPtr),view_(view){}
+
+        /**
+         * \brief Деструктор
+         */
+        ~Mesh() override = default;
+
+        /**
+         * \brief Получить массивы сетки
+         * \return Константная ссылка на представление
+         */
+        const MeshView& getView() const
+        {
+            return view_;
+        }
+
+        /**
+         * \brief Получить кол-во треугольников
+         * \return Кол-во треугольников
+         */
+        size_t getTriangleCount() const
+        {
+            return view_.triangleCount;
+        }
+
+        /**
+         * \brief Пересечение луча и сетки
+         * \param ray Луч
+         * \param tMin Минимальное расстояние
+         * \param tMax Максимальное расстояние
+         * \param hitInfo Информация о пересечении
+         * \return Было ли пересечение с объектом
+         */
+        bool intersectsRay(const math::Ray& ray, float tMin, float tMax, HitInfo* hitInfo) const override
+        {
+            if(view_.nodeCount == 0) return false;
+
+            // Ближайший треугольник, расстояние и барицентрические координаты точки пересечения
+            uint32_t closestTriangle = 0;
+            float closestT = tMax;
+            math::Vec2<float> closestCoords = {0.0f,0.0f};
+            const uint32_t* order = view_.order;
+
+            bool hit = BVHTree::traverse(view_.nodes, view_.nodeCount, ray, tMin, tMax, [&](uint32_t index, float tMinLeaf, float& tClosest){
+                float t = 0.0f;
+                math::Vec2<float> coords = {0.0f,0.0f};
+                if(this->intersectsTriangle(ray, order[index], tMinLeaf, tClosest, &t, &coords)){
+                    tClosest = t;
+                    closestT = t;
+                    closestTriangle = order[index];
+                    closestCoords = coords;
+                    return true;
+                }
+                return false;
+            });
+
+            // Если было пересечение и указатель на структуру информации о пересечении был передан
+            if(hit && hitInfo != nullptr)
+            {
+                const uint32_t* index = view_.indices + static_cast<size_t>(closestTriangle) * 3;
+                const auto& p0 = view_.positions[index[0]];
+                const auto& p1 = view_.positions[index[1]];
+                const auto& p2 = view_.positions[index[2]];
+
+                // Нормаль треугольника (лицевая сторона - обход вершин против часовой стрелки)
+                auto faceNormal = math::Normalize(math::Cross(p1 - p0, p2 - p0));
+
+                // Интерполированная нормаль вершин
+                math::Vec3<float> normal = faceNormal;
+                if(view_.normals != nullptr){
+                    float w0 = 1.0f - closestCoords.x - closestCoords.y;
+                    normal = math::Normalize(
+                            (view_.normals[index[0]] * w0) +
+                            (view_.normals[index[1]] * closestCoords.x) +
+                            (view_.normals[index[2]] * closestCoords.y));
+                }
+
+                // Запись значений
+                hitInfo->t = closestT;
+                hitInfo->point = ray.getOrigin() + (ray.getDirection() * closestT);
+                hitInfo->frontFaceSurface = true;
+                hitInfo->materialPtr = this->materialPtr_.get();
+                hitInfo->objectPtr = this;
+
+                // Если луч попал в обратную сторону треугольника, нормаль инвертируется
+                if(math::Dot(ray.getDirection(), faceNormal) > 0.0f){
+                    normal = -normal;
+                    hitInfo->frontFaceSurface = false;
+                }
+                hitInfo->normal = normal;
+            }
+
+            return hit;
+        }
+
+        /**
+         * \brief Перекрывает ли сетка луч на заданном отрезке
+         * \param ray Луч
+         * \param tMin Минимальное расстояние
+         * \param tMax Максимальное расстояние
+         * \return Было ли пересечение с каким-либо треугольником
+         */
+        bool occluded(const math::Ray& ray, float tMin, float tMax) const override
+        {
+            const uint32_t* order = view_.order;
+            return BVHTree::traverseAny(view_.nodes, view_.nodeCount, ray, tMin, tMax, [&](uint32_t index){
+                float t = 0.0f;
+                math::Vec2<float> coords = {0.0f,0.0f};
+                return this->intersectsTriangle(ray, order[index], tMin, tMax, &t, &coords);
+            });
+        }
+
+        /**
+         * \brief Описывающий параллелипипед сетки
+         * \param bboxOut Описывающий параллелипипед в мировых координатах
+         * \return Ограничен ли объект
+         */
+        bool boundingBox(math::BBox<>* bboxOut) const override
+        {
+            if(view_.nodeCount == 0) return false;
+            if(bboxOut != nullptr) *bboxOut = view_.nodes[0].bounds;
+            return true;
+        }
+    };
+}
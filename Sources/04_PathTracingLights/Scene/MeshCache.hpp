@@ -0,0 +1,424 @@
+#pragma once
+
+#include <cstdio>
+#include <fstream>
+#include <atomic>
+
+#include <MappedFile.hpp>
+
+#include "MeshLoader.hpp"
+
+// Выравнивание разделов файла кэша (размер страницы памяти)
+#ifndef MESH_CACHE_ALIGNMENT
+#define MESH_CACHE_ALIGNMENT 4096u
+#endif
+
+// Размер части исходного файла при параллельном вычислении хеша (от кол-ва потоков результат не зависит)
+#ifndef MESH_CACHE_HASH_CHUNK_SIZE
+#define MESH_CACHE_HASH_CHUNK_SIZE (16u << 20u)
+#endif
+
+namespace scene
+{
+    /**
+     * \brief Двоичный кэш треугольных сеток
+     *
+     * \details Файл кэша содержит массивы вершин, нормалей, индексов и узлов иерархии в том же виде, в котором
+     * они используются при трассировке. Все разделы выровнены по границе страницы, поэтому отображенный в память
+     * файл используется напрямую - без копирования и исправления указателей. Ключ кэша - хеш исходного файла
+     */
+    namespace cache
+    {
+        /// Версия формата (увеличивается при любом изменении структуры файла или узлов иерархии)
+        const uint32_t MESH_CACHE_VERSION = 3;
+
+        /// Метка для проверки порядка байт
+        const uint32_t MESH_CACHE_ENDIAN_MARK = 0x01020304u;
+
+        /**
+         * \brief Заголовок файла кэша (в начале файла)
+         */
+        struct MeshCacheHeader
+        {
+            /// Сигнатура формата
+            char magic[8];
+            /// Версия формата
+            uint32_t version;
+            /// Метка порядка байт
+            uint32_t endianMark;
+            /// Размер узла иерархии
+            uint32_t nodeSize;
+            /// Способ построения иерархии
+            uint32_t buildMethod;
+            /// Хеш исходного файла
+            uint64_t sourceHash;
+            /// Размер исходного файла
+            uint64_t sourceSize;
+            /// Хеш разделов файла кэша
+            uint64_t payloadHash;
+            /// Кол-во вершин
+            uint32_t vertexCount;
+            /// Кол-во треугольников
+            uint32_t triangleCount;
+            /// Кол-во узлов иерархии
+            uint32_t nodeCount;
+            /// Есть ли нормали вершин
+            uint32_t hasNormals;
+            /// Смещения разделов от начала файла (вершины, нормали, индексы, узлы, порядок треугольников)
+            uint64_t offsets[5];
+        };
+
+        static_assert(sizeof(math::Vec3<float>) == 12, "Vertex layout must be tightly packed to be mapped from file");
+        static_assert(sizeof(BVHNode) == 32, "BVH node layout must match the cache format version");
+
+        /**
+         * \brief Хеш FNV-1a (64 бита)
+         * \param data Данные
+         * \param size Размер данных
+         * \param hash Начальное значение
+         * \return Хеш
+         */
+        inline uint64_t Fnv1a(const char* data, size_t size, uint64_t hash = 14695981039346656037ull)
+        {
+            for(size_t i = 0; i < size; i++){
+                hash ^= static_cast<unsigned char>(data[i]);
+                hash *= 1099511628211ull;
+            }
+            return hash;
+        }
+
+        /**
+         * \brief Быстрый хеш по 8-байтовым словам (вариант FNV-1a)
+         * \param data Данные
+         * \param size Размер данных
+         * \return Хеш
+         *
+         * \details Слова обрабатываются в четырех независимых цепочках (умножения разных цепочек выполняются
+         * параллельно), которые затем объединяются. Остаток меньше слова хешируется побайтово
+         */
+        inline uint64_t HashWords(const char* data, size_t size)
+        {
+            const uint64_t prime = 1099511628211ull;
+            uint64_t lanes[4] = {14695981039346656037ull, 14695981039346656037ull ^ 1u, 14695981039346656037ull ^ 2u, 14695981039346656037ull ^ 3u};
+
+            size_t i = 0;
+            for(; i + 32 <= size; i += 32){
+                uint64_t words[4];
+                std::memcpy(words, data + i, sizeof(words));
+                for(unsigned j = 0; j < 4; j++){
+                    lanes[j] = (lanes[j] ^ words[j]) * prime;
+                    lanes[j] ^= lanes[j] >> 32u;
+                }
+            }
+
+            uint64_t hash = Fnv1a(reinterpret_cast<const char*>(lanes), sizeof(lanes));
+            return Fnv1a(data + i, size - i, hash);
+        }
+
+        /**
+         * \brief Хеш содержимого файла
+         * \param data Данные
+         * \param size Размер данных
+         * \param threads Кол-во потоков
+         * \return Хеш (FNV-1a от хешей частей фиксированного размера и размера данных, части - HashWords)
+         */
+        inline uint64_t HashData(const char* data, size_t size, unsigned threads = 1)
+        {
+            auto chunkCount = static_cast<uint32_t>((size + MESH_CACHE_HASH_CHUNK_SIZE - 1) / MESH_CACHE_HASH_CHUNK_SIZE);
+            std::vector<uint64_t> hashes(chunkCount);
+
+            BVHTree::parallelFor(chunkCount, std::max(1u, std::min(threads, chunkCount)), [&](uint32_t from, uint32_t to, unsigned){
+                for(uint32_t i = from; i < to; i++){
+                    size_t offset = static_cast<size_t>(i) * MESH_CACHE_HASH_CHUNK_SIZE;
+                    hashes[i] = HashWords(data + offset, std::min<size_t>(MESH_CACHE_HASH_CHUNK_SIZE, size - offset));
+                }
+            });
+
+            uint64_t hash = Fnv1a(reinterpret_cast<const char*>(&size), sizeof(size));
+            return Fnv1a(reinterpret_cast<const char*>(hashes.data()), hashes.size() * sizeof(uint64_t), hash);
+        }
+
+        /**
+         * \brief Хеш разделов файла кэша
+         * \param sections Указатели на данные разделов
+         * \param sizes Размеры разделов
+         * \param threads Кол-во потоков
+         * \return Хеш (FNV-1a от хешей разделов)
+         */
+        inline uint64_t HashSections(const void* const sections[5], const uint64_t sizes[5], unsigned threads = 1)
+        {
+            uint64_t hashes[5];
+            for(unsigned i = 0; i < 5; i++){
+                hashes[i] = HashData(static_cast<const char*>(sections[i]), static_cast<size_t>(sizes[i]), threads);
+            }
+            return Fnv1a(reinterpret_cast<const char*>(hashes), sizeof(hashes));
+        }
+
+        /**
+         * \brief Наибольшее значение массива индексов
+         * \param values Массив
+         * \param count Кол-во элементов
+         * \param threads Кол-во потоков
+         * \return Наибольшее значение (0 для пустого массива)
+         */
+        inline uint32_t MaxIndex(const uint32_t* values, uint64_t count, unsigned threads = 1)
+        {
+            auto chunkCount = static_cast<uint32_t>((count + MESH_CACHE_HASH_CHUNK_SIZE - 1) / MESH_CACHE_HASH_CHUNK_SIZE);
+            std::vector<uint32_t> maxima(chunkCount, 0);
+
+            BVHTree::parallelFor(chunkCount, std::max(1u, std::min(threads, chunkCount)), [&](uint32_t from, uint32_t to, unsigned){
+                for(uint32_t i = from; i < to; i++){
+                    uint64_t begin = static_cast<uint64_t>(i) * MESH_CACHE_HASH_CHUNK_SIZE;
+                    uint64_t end = std::min<uint64_t>(begin + MESH_CACHE_HASH_CHUNK_SIZE, count);
+                    uint32_t result = 0;
+                    for(uint64_t j = begin; j < end; j++) result = std::max(result, values[j]);
+                    maxima[i] = result;
+                }
+            });
+
+            uint32_t result = 0;
+            for(auto value : maxima) result = std::max(result, value);
+            return result;
+        }
+
+        /**
+         * \brief Проверка согласованности массивов сетки
+         * \param view Массивы сетки
+         * \param threads Кол-во потоков
+         * \return Все ли индексы находятся в пределах массивов, а глубина иерархии - в пределах стека обхода
+         *
+         * \details Потомки узла всегда следуют после него, поэтому глубина всех узлов считается за один проход
+         */
+        inline bool ValidateMeshView(const MeshView& view, unsigned threads = 1)
+        {
+            if(view.triangleCount > 0){
+                if(MaxIndex(view.indices, static_cast<uint64_t>(view.triangleCount) * 3, threads) >= view.vertexCount) return false;
+                if(MaxIndex(view.order, view.triangleCount, threads) >= view.triangleCount) return false;
+            }
+
+            static_assert(BVH_MAX_DEPTH < 255, "Node depths are stored as bytes");
+            std::vector<uint8_t> depths(view.nodeCount, 0);
+            for(uint32_t i = 0; i < view.nodeCount; i++)
+            {
+                const BVHNode& node = view.nodes[i];
+                if(depths[i] > BVH_MAX_DEPTH) return false;
+
+                if(node.primitiveCount > 0){
+                    if(static_cast<uint64_t>(node.offset) + node.primitiveCount > view.triangleCount) return false;
+                    continue;
+                }
+
+                if(i + 1 >= view.nodeCount || node.offset <= i || node.offset >= view.nodeCount) return false;
+                auto childDepth = static_cast<uint8_t>(depths[i] + 1);
+                depths[i + 1] = std::max(depths[i + 1], childDepth);
+                depths[node.offset] = std::max(depths[node.offset], childDepth);
+            }
+
+            return true;
+        }
+
+        /**
+         * \brief Уникальный путь временного файла для записи кэша
+         * \param path Путь к файлу кэша
+         * \return Путь с идентификатором процесса и номером записи в процессе
+         *
+         * \details Несколько процессов (или потоков), одновременно не нашедших кэш, пишут каждый в свой файл -
+         * иначе они перезаписывали бы один и тот же временный файл до переименования
+         */
+        inline std::string TemporaryPath(const std::string& path)
+        {
+            static std::atomic<uint32_t> counter{0};
+#ifdef _WIN32
+            auto processId = static_cast<unsigned long>(GetCurrentProcessId());
+#else
+            auto processId = static_cast<unsigned long>(getpid());
+#endif
+            return path + "." + std::to_string(processId) + "." + std::to_string(counter++) + ".tmp";
+        }
+
+        /**
+         * \brief Записать сетку в файл кэша
+         * \param path Путь к файлу кэша
+         * \param mesh Сетка
+         * \param sourceHash Хеш исходного файла
+         * \param sourceSize Размер исходного файла
+         * \param method Способ построения иерархии сетки
+         * \param threads Кол-во потоков (для вычисления хеша разделов)
+         * \return Удалось ли записать файл
+         *
+         * \details Запись выполняется в собственный временный файл, который затем переименовывается - другие
+         * процессы (в том числе одновременно записывающие тот же кэш) не увидят частично записанный кэш
+         */
+        inline bool WriteMeshCache(const std::string& path, const Mesh& mesh, uint64_t sourceHash, uint64_t sourceSize, BVHBuildMethod method, unsigned threads = 1)
+        {
+            const MeshView& view = mesh.getView();
+
+            // Размеры разделов
+            uint64_t sizes[5] = {
+                    static_cast<uint64_t>(view.vertexCount) * sizeof(math::Vec3<float>),
+                    view.normals != nullptr ? static_cast<uint64_t>(view.vertexCount) * sizeof(math::Vec3<float>) : 0,
+                    static_cast<uint64_t>(view.triangleCount) * 3 * sizeof(uint32_t),
+                    static_cast<uint64_t>(view.nodeCount) * sizeof(BVHNode),
+                    static_cast<uint64_t>(view.triangleCount) * sizeof(uint32_t)};
+            const void* sections[5] = {view.positions, view.normals, view.indices, view.nodes, view.order};
+
+            MeshCacheHeader header{};
+            std::memcpy(header.magic, "SRTMESH", 8);
+            header.version = MESH_CACHE_VERSION;
+            header.endianMark = MESH_CACHE_ENDIAN_MARK;
+            header.nodeSize = sizeof(BVHNode);
+            header.buildMethod = static_cast<uint32_t>(method);
+            header.sourceHash = sourceHash;
+            header.sourceSize = sourceSize;
+            header.payloadHash = HashSections(sections, sizes, threads);
+            header.vertexCount = view.vertexCount;
+            header.triangleCount = view.triangleCount;
+            header.nodeCount = view.nodeCount;
+            header.hasNormals = view.normals != nullptr ? 1 : 0;
+
+            auto align = [](uint64_t value){ return (value + MESH_CACHE_ALIGNMENT - 1) / MESH_CACHE_ALIGNMENT * MESH_CACHE_ALIGNMENT; };
+            uint64_t offset = align(sizeof(MeshCacheHeader));
+            for(unsigned i = 0; i < 5; i++){
+                header.offsets[i] = offset;
+                offset = align(offset + sizes[i]);
+            }
+
+            std::string temporaryPath = TemporaryPath(path);
+            {
+                std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+                if(!file) return false;
+
+                const std::vector<char> padding(MESH_CACHE_ALIGNMENT, 0);
+                file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+                uint64_t position = sizeof(header);
+                for(unsigned i = 0; i < 5; i++){
+                    file.write(padding.data(), static_cast<std::streamsize>(header.offsets[i] - position));
+                    if(sizes[i] > 0) file.write(static_cast<const char*>(sections[i]), static_cast<std::streamsize>(sizes[i]));
+                    position = header.offsets[i] + sizes[i];
+                }
+                file.write(padding.data(), static_cast<std::streamsize>(offset - position));
+
+                if(!file){
+                    file.close();
+                    std::remove(temporaryPath.c_str());
+                    return false;
+                }
+            }
+
+            // Переименование может не удаться, если другой процесс успел записать кэш первым (временный файл удаляется)
+            std::remove(path.c_str());
+            if(std::rename(temporaryPath.c_str(), path.c_str()) != 0){
+                std::remove(temporaryPath.c_str());
+                return false;
+            }
+            return true;
+        }
+
+        /**
+         * \brief Открыть файл кэша (без копирования данных)
+         * \param path Путь к файлу кэша
+         * \param sourceHash Ожидаемый хеш исходного файла
+         * \param sourceSize Ожидаемый размер исходного файла
+         * \param method Ожидаемый способ построения иерархии
+         * \param viewOut Массивы сетки (ссылаются на отображенный файл, который удерживается в owner)
+         * \param threads Кол-во потоков (для вычисления хеша разделов)
+         * \return Актуален ли кэш (false - файла нет, он устарел или поврежден)
+         *
+         * \details Помимо заголовка проверяются хеш разделов и согласованность индексов - поврежденный кэш
+         * с целым заголовком не должен приводить к выходу за пределы массивов при трассировке
+         */
+        inline bool OpenMeshCache(const std::string& path, uint64_t sourceHash, uint64_t sourceSize, BVHBuildMethod method, MeshView* viewOut, unsigned threads = 1)
+        {
+            std::shared_ptr<MappedFile> file;
+            try{
+                file = std::make_shared<MappedFile>(path);
+            }
+            catch(std::exception&){
+                return false;
+            }
+
+            if(file->getSize() < sizeof(MeshCacheHeader)) return false;
+            const char* data = file->getData();
+            MeshCacheHeader header{};
+            std::memcpy(&header, data, sizeof(header));
+
+            if(std::memcmp(header.magic, "SRTMESH", 8) != 0 ||
+               header.version != MESH_CACHE_VERSION ||
+               header.endianMark != MESH_CACHE_ENDIAN_MARK ||
+               header.nodeSize != sizeof(BVHNode) ||
+               header.buildMethod != static_cast<uint32_t>(method) ||
+               header.sourceHash != sourceHash ||
+               header.sourceSize != sourceSize){
+                return false;
+            }
+
+            // Разделы должны быть выровнены и находиться внутри файла
+            uint64_t sizes[5] = {
+                    static_cast<uint64_t>(header.vertexCount) * sizeof(math::Vec3<float>),
+                    header.hasNormals ? static_cast<uint64_t>(header.vertexCount) * sizeof(math::Vec3<float>) : 0,
+                    static_cast<uint64_t>(header.triangleCount) * 3 * sizeof(uint32_t),
+                    static_cast<uint64_t>(header.nodeCount) * sizeof(BVHNode),
+                    static_cast<uint64_t>(header.triangleCount) * sizeof(uint32_t)};
+            for(unsigned i = 0; i < 5; i++){
+                if(header.offsets[i] % MESH_CACHE_ALIGNMENT != 0 || header.offsets[i] + sizes[i] > file->getSize()) return false;
+            }
+
+            // Содержимое разделов должно совпадать с записанным
+            const void* sections[5];
+            for(unsigned i = 0; i < 5; i++) sections[i] = data + header.offsets[i];
+            if(HashSections(sections, sizes, threads) != header.payloadHash) return false;
+
+            MeshView view{};
+            view.positions = reinterpret_cast<const math::Vec3<float>*>(data + header.offsets[0]);
+            view.normals = header.hasNormals ? reinterpret_cast<const math::Vec3<float>*>(data + header.offsets[1]) : nullptr;
+            view.indices = reinterpret_cast<const uint32_t*>(data + header.offsets[2]);
+            view.nodes = reinterpret_cast<const BVHNode*>(data + header.offsets[3]);
+            view.order = reinterpret_cast<const uint32_t*>(data + header.offsets[4]);
+            view.vertexCount = header.vertexCount;
+            view.triangleCount = header.triangleCount;
+            view.nodeCount = header.nodeCount;
+            view.owner = file;
+            if(!ValidateMeshView(view, threads)) return false;
+
+            // Проверка прочитала файл последовательно, при трассировке узлы и треугольники читаются вразнобой
+            file->advise(MappedFileAccess::eRandom);
+
+            *viewOut = view;
+            return true;
+        }
+
+        /**
+         * \brief Загрузка сетки с использованием кэша
+         * \param path Путь к исходному файлу (.obj или .ply)
+         * \param materialPtr Материал
+         * \param threads Кол-во потоков
+         * \param method Способ построения иерархии
+         * \param cachePath Путь к файлу кэша (пустая строка - рядом с исходным файлом)
+         * \param cacheHit Был ли использован кэш
+         * \return Сетка
+         *
+         * \details Если кэш отсутствует или не соответствует исходному файлу (по хешу содержимого), сетка
+         * загружается из исходного файла, после чего кэш перезаписывается
+         */
+        inline std::shared_ptr<Mesh> LoadMeshCached(const std::string& path, const std::shared_ptr<materials::Material>& materialPtr,
+                unsigned threads = 1, BVHBuildMethod method = eBinnedSAH, const std::string& cachePath = "", bool* cacheHit = nullptr)
+        {
+            std::string cacheFile = cachePath.empty() ? path + ".meshcache" : cachePath;
+
+            MappedFile source(path);
+            uint64_t sourceHash = HashData(source.getData(), source.getSize(), threads);
+
+            MeshView view{};
+            if(OpenMeshCache(cacheFile, sourceHash, source.getSize(), method, &view, threads)){
+                if(cacheHit != nullptr) *cacheHit = true;
+                return std::make_shared<Mesh>(materialPtr, view);
+            }
+
+            // Разбор исходного файла (уже отображенного в память) и построение иерархии
+            auto mesh = std::make_shared<Mesh>(materialPtr, loaders::LoadMesh(source, path, threads), threads, method);
+            WriteMeshCache(cacheFile, *mesh, sourceHash, source.getSize(), method, threads);
+            if(cacheHit != nullptr) *cacheHit = false;
+            return mesh;
+        }
+    }
+}
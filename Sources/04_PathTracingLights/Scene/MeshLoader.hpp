@@ -0,0 +1,873 @@
+#pragma once
+
+#include <cctype>
+#include <cstring>
+#include <string>
+#include <algorithm>
+#include <unordered_map>
+
+#include <MappedFile.hpp>
+
+#include "Mesh.hpp"
+
+// Минимальный размер части файла, разбираемой одним потоком (в байтах)
+#ifndef MESH_LOADER_MIN_CHUNK_SIZE
+#define MESH_LOADER_MIN_CHUNK_SIZE (1u << 20u)
+#endif
+
+namespace scene
+{
+    /**
+     * \brief Загрузка треугольных сеток из файлов (OBJ, PLY)
+     *
+     * \details Файл отображается в память и разбивается на части по границам строк, которые разбираются
+     * параллельно. Числа разбираются собственными функциями без выделения памяти и без учета локали
+     * (аналог std::from_chars, отсутствующего в C++14)
+     */
+    namespace loaders
+    {
+        /**
+         * \brief Тип скалярного свойства элемента PLY
+         */
+        enum PlyType
+        {
+            ePlyInt8, ePlyUInt8, ePlyInt16, ePlyUInt16, ePlyInt32, ePlyUInt32, ePlyFloat32, ePlyFloat64
+        };
+
+        /**
+         * \brief Свойство элемента PLY
+         */
+        struct PlyProperty
+        {
+            /// Название
+            std::string name;
+            /// Тип значения (для списка - тип элементов)
+            PlyType type = ePlyFloat32;
+            /// Является ли свойство списком
+            bool isList = false;
+            /// Тип кол-ва элементов списка
+            PlyType countType = ePlyUInt8;
+        };
+
+        /**
+         * \brief Элемент PLY (вершины, грани и т.д.)
+         */
+        struct PlyElement
+        {
+            /// Название
+            std::string name;
+            /// Кол-во записей
+            size_t count = 0;
+            /// Свойства записи
+            std::vector<PlyProperty> properties;
+        };
+
+        /**
+         * \brief Пропустить пробелы (не включая перевод строки)
+         * \param p Текущая позиция
+         * \param end Конец данных
+         * \return Позиция первого не пробельного символа
+         */
+        inline const char* SkipSpaces(const char* p, const char* end)
+        {
+            while(p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+            return p;
+        }
+
+        /**
+         * \brief Перейти к следующей строке
+         * \param p Текущая позиция
+         * \param end Конец данных
+         * \return Позиция после ближайшего перевода строки (либо конец данных)
+         */
+        inline const char* NextLine(const char* p, const char* end)
+        {
+            if(p >= end) return end;
+            auto newLine = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+            return newLine != nullptr ? newLine + 1 : end;
+        }
+
+        /**
+         * \brief Степень десяти
+         * \param exponent Показатель (не отрицательный)
+         * \return 10 в степени exponent
+         */
+        inline double Pow10(int exponent)
+        {
+            static const double table[] = {
+                    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+            return exponent <= 22 ? table[exponent] : std::pow(10.0, exponent);
+        }
+
+        /**
+         * \brief Разбор целого числа
+         * \param p Текущая позиция (пробелы в начале пропускаются)
+         * \param end Конец данных
+         * \param out Результат
+         * \return Позиция после числа, либо nullptr если числа нет
+         */
+        inline const char* ParseInt(const char* p, const char* end, int64_t* out)
+        {
+            p = SkipSpaces(p, end);
+
+            bool negative = false;
+            if(p < end && (*p == '-' || *p == '+')){
+                negative = *p == '-';
+                p++;
+            }
+
+            const char* digitsBegin = p;
+            int64_t value = 0;
+            while(p < end && *p >= '0' && *p <= '9'){
+                value = value * 10 + (*p - '0');
+                p++;
+            }
+            if(p == digitsBegin) return nullptr;
+
+            *out = negative ? -value : value;
+            return p;
+        }
+
+        /**
+         * \brief Разбор числа с плавающей точкой
+         * \param p Текущая позиция (пробелы в начале пропускаются)
+         * \param end Конец данных
+         * \param out Результат
+         * \return Позиция после числа, либо nullptr если числа нет
+         *
+         * \details Учитываются первые 19 значащих цифр, чего достаточно для точности float
+         */
+        inline const char* ParseFloat(const char* p, const char* end, float* out)
+        {
+            p = SkipSpaces(p, end);
+
+            bool negative = false;
+            if(p < end && (*p == '-' || *p == '+')){
+                negative = *p == '-';
+                p++;
+            }
+
+            uint64_t mantissa = 0;
+            int significant = 0;
+            int exponent = 0;
+            bool anyDigits = false;
+
+            // Целая часть
+            for(; p < end && *p >= '0' && *p <= '9'; p++){
+                anyDigits = true;
+                if(significant < 19){
+                    mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+                    if(mantissa > 0) significant++;
+                } else {
+                    exponent++;
+                }
+            }
+
+            // Дробная часть
+            if(p < end && *p == '.'){
+                for(p++; p < end && *p >= '0' && *p <= '9'; p++){
+                    anyDigits = true;
+                    if(significant < 19){
+                        mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+                        if(mantissa > 0) significant++;
+                        exponent--;
+                    }
+                }
+            }
+
+            if(!anyDigits) return nullptr;
+
+            // Показатель степени
+            if(p < end && (*p == 'e' || *p == 'E')){
+                int64_t e = 0;
+                const char* next = ParseInt(p + 1, end, &e);
+                if(next == nullptr) return nullptr;
+                exponent += static_cast<int>(std::max<int64_t>(std::min<int64_t>(e, 1000), -1000));
+                p = next;
+            }
+
+            auto value = static_cast<double>(mantissa);
+            value = exponent < 0 ? value / Pow10(-exponent) : value * Pow10(exponent);
+            *out = static_cast<float>(negative ? -value : value);
+            return p;
+        }
+
+        /**
+         * \brief Задать компоненту вектора по номеру
+         * \param v Вектор
+         * \param component Номер компоненты (0 - x, 1 - y, 2 - z)
+         * \param value Значение
+         */
+        inline void SetComponent(math::Vec3<float>* v, unsigned component, float value)
+        {
+            if(component == 0) v->x = value;
+            else if(component == 1) v->y = value;
+            else v->z = value;
+        }
+
+        /**
+         * \brief Разбить данные на части по границам строк
+         * \param begin Начало данных
+         * \param end Конец данных
+         * \param threads Кол-во потоков
+         * \return Границы частей (кол-во частей + 1 указателей)
+         */
+        inline std::vector<const char*> SplitLines(const char* begin, const char* end, unsigned threads)
+        {
+            auto size = static_cast<size_t>(end - begin);
+            size_t parts = std::max<size_t>(1, std::min<size_t>(std::max(threads, 1u), size / MESH_LOADER_MIN_CHUNK_SIZE));
+
+            std::vector<const char*> bounds{begin};
+            for(size_t i = 1; i < parts; i++){
+                const char* split = NextLine(begin + (size * i) / parts, end);
+                if(split > bounds.back() && split < end) bounds.push_back(split);
+            }
+            bounds.push_back(end);
+            return bounds;
+        }
+
+        /**
+         * \brief Начинается ли строка с ключевого слова (за которым следует пробел)
+         * \param p Начало строки
+         * \param end Конец данных
+         * \param keyword Ключевое слово
+         * \return Совпадает ли
+         */
+        inline bool StartsWith(const char* p, const char* end, const char* keyword)
+        {
+            size_t length = std::strlen(keyword);
+            if(static_cast<size_t>(end - p) <= length || std::memcmp(p, keyword, length) != 0) return false;
+            return p[length] == ' ' || p[length] == '\t';
+        }
+
+        /**
+         * \brief Сформировать итоговые массивы сетки из индексов вершин и нормалей
+         * \param positions Положения вершин
+         * \param normals Нормали (из файла)
+         * \param positionIndices Индексы положений (по три на треугольник)
+         * \param normalIndices Индексы нормалей (пустой массив, если нормали заданы не для всех вершин)
+         * \return Данные сетки
+         *
+         * \details Если индексы нормалей совпадают с индексами положений, массивы используются как есть. Иначе
+         * вершины с разными нормалями разделяются
+         */
+        inline std::shared_ptr<MeshData> MakeMeshData(std::vector<math::Vec3<float>>&& positions, std::vector<math::Vec3<float>>&& normals,
+                std::vector<uint32_t>&& positionIndices, const std::vector<uint32_t>& normalIndices)
+        {
+            auto data = std::make_shared<MeshData>();
+
+            bool sameIndices = !normalIndices.empty() && normals.size() == positions.size() && normalIndices == positionIndices;
+            if(normalIndices.empty() || sameIndices){
+                data->positions = std::move(positions);
+                if(sameIndices) data->normals = std::move(normals);
+                data->indices = std::move(positionIndices);
+                return data;
+            }
+
+            // Разделение вершин по уникальным парам (положение, нормаль)
+            std::unordered_map<uint64_t, uint32_t> vertices{};
+            vertices.reserve(positions.size());
+            data->indices.resize(positionIndices.size());
+            for(size_t i = 0; i < positionIndices.size(); i++)
+            {
+                uint64_t key = (static_cast<uint64_t>(positionIndices[i]) << 32u) | normalIndices[i];
+                auto inserted = vertices.emplace(key, static_cast<uint32_t>(data->positions.size()));
+                if(inserted.second){
+                    data->positions.push_back(positions[positionIndices[i]]);
+                    data->normals.push_back(normals[normalIndices[i]]);
+                }
+                data->indices[i] = inserted.first->second;
+            }
+
+            return data;
+        }
+
+        /**
+         * \brief Загрузка сетки в формате OBJ
+         * \param begin Начало данных файла
+         * \param end Конец данных файла
+         * \param threads Кол-во потоков
+         * \return Данные сетки
+         *
+         * \details Учитываются только положения вершин (v), нормали (vn) и грани (f). Многоугольники разбиваются
+         * на треугольники веером. Поддерживаются отрицательные (относительные) индексы
+         */
+        inline std::shared_ptr<MeshData> LoadObj(const char* begin, const char* end, unsigned threads = 1)
+        {
+            auto chunks = SplitLines(begin, end, threads);
+            auto chunkCount = static_cast<uint32_t>(chunks.size() - 1);
+
+            // Первый проход - подсчет вершин и нормалей в каждой части (чтобы знать куда их записывать)
+            std::vector<size_t> positionOffsets(chunkCount + 1, 0);
+            std::vector<size_t> normalOffsets(chunkCount + 1, 0);
+            BVHTree::parallelFor(chunkCount, chunkCount, [&](uint32_t from, uint32_t to, unsigned){
+                for(uint32_t c = from; c < to; c++){
+                    for(const char* p = chunks[c]; p < chunks[c + 1]; p = NextLine(p, chunks[c + 1])){
+                        if(StartsWith(p, chunks[c + 1], "v")) positionOffsets[c + 1]++;
+                        else if(StartsWith(p, chunks[c + 1], "vn")) normalOffsets[c + 1]++;
+                    }
+                }
+            });
+            for(uint32_t c = 0; c < chunkCount; c++){
+                positionOffsets[c + 1] += positionOffsets[c];
+                normalOffsets[c + 1] += normalOffsets[c];
+            }
+
+            std::vector<math::Vec3<float>> positions(positionOffsets.back());
+            std::vector<math::Vec3<float>> normals(normalOffsets.back());
+            std::vector<std::vector<uint32_t>> chunkPositionIndices(chunkCount);
+            std::vector<std::vector<uint32_t>> chunkNormalIndices(chunkCount);
+            std::vector<size_t> errorLines(chunkCount, 0);
+            std::vector<char> missingNormals(chunkCount, 0);
+
+            // Второй проход - разбор строк
+            BVHTree::parallelFor(chunkCount, chunkCount, [&](uint32_t from, uint32_t to, unsigned){
+                for(uint32_t c = from; c < to; c++)
+                {
+                    const char* chunkEnd = chunks[c + 1];
+                    size_t positionCount = positionOffsets[c];
+                    size_t normalCount = normalOffsets[c];
+                    size_t line = 0;
+                    auto& positionIndices = chunkPositionIndices[c];
+                    auto& normalIndices = chunkNormalIndices[c];
+
+                    // Индексы вершин текущего многоугольника
+                    std::vector<int64_t> polygonPositions{};
+                    std::vector<int64_t> polygonNormals{};
+
+                    // Перевод индекса OBJ (с единицы, либо отрицательного) в индекс массива
+                    auto resolve = [](int64_t index, size_t count) -> int64_t {
+                        return index > 0 ? index - 1 : static_cast<int64_t>(count) + index;
+                    };
+
+                    for(const char* p = chunks[c]; p < chunkEnd && errorLines[c] == 0; p = NextLine(p, chunkEnd))
+                    {
+                        line++;
+                        if(StartsWith(p, chunkEnd, "v") || StartsWith(p, chunkEnd, "vn"))
+                        {
+                            bool isNormal = p[1] == 'n';
+                            math::Vec3<float> v{};
+                            const char* q = p + (isNormal ? 2 : 1);
+                            if((q = ParseFloat(q, chunkEnd, &v.x)) == nullptr ||
+                               (q = ParseFloat(q, chunkEnd, &v.y)) == nullptr ||
+                               (q = ParseFloat(q, chunkEnd, &v.z)) == nullptr){
+                                errorLines[c] = line;
+                                break;
+                            }
+                            if(isNormal) normals[normalCount++] = v;
+                            else positions[positionCount++] = v;
+                        }
+                        else if(StartsWith(p, chunkEnd, "f"))
+                        {
+                            polygonPositions.clear();
+                            polygonNormals.clear();
+
+                            // Вершины грани вида v, v/vt, v//vn, v/vt/vn
+                            const char* lineEnd = NextLine(p, chunkEnd);
+                            const char* q = SkipSpaces(p + 1, lineEnd);
+                            while(q < lineEnd && *q != '\n' && *q != '#')
+                            {
+                                int64_t index = 0, normal = 0;
+                                if((q = ParseInt(q, lineEnd, &index)) == nullptr) break;
+                                if(index == 0){ q = nullptr; break; }
+                                if(q < lineEnd && *q == '/'){
+                                    q++;
+                                    int64_t texCoord = 0;
+                                    if(q < lineEnd && *q != '/') q = ParseInt(q, lineEnd, &texCoord);
+                                    if(q != nullptr && q < lineEnd && *q == '/') q = ParseInt(q + 1, lineEnd, &normal);
+                                    if(q == nullptr) break;
+                                }
+
+                                polygonPositions.push_back(resolve(index, positionCount));
+                                polygonNormals.push_back(normal != 0 ? resolve(normal, normalCount) : -1);
+                                q = SkipSpaces(q, lineEnd);
+                            }
+
+                            if(q == nullptr || polygonPositions.size() < 3){
+                                errorLines[c] = line;
+                                break;
+                            }
+
+                            // Разбиение веером
+                            for(size_t i = 1; i + 1 < polygonPositions.size(); i++){
+                                for(size_t k : {size_t(0), i, i + 1}){
+                                    positionIndices.push_back(static_cast<uint32_t>(polygonPositions[k]));
+                                    normalIndices.push_back(static_cast<uint32_t>(polygonNormals[k]));
+                                    if(polygonNormals[k] < 0) missingNormals[c] = 1;
+                                }
+                            }
+                        }
+                    }
+                }
+            });
+
+            for(uint32_t c = 0; c < chunkCount; c++){
+                if(errorLines[c] != 0) throw std::runtime_error("ERROR: Can't parse OBJ data (line " + std::to_string(errorLines[c]) + " of chunk " + std::to_string(c) + ")");
+            }
+
+            // Объединение индексов всех частей
+            std::vector<size_t> indexOffsets(chunkCount + 1, 0);
+            for(uint32_t c = 0; c < chunkCount; c++) indexOffsets[c + 1] = indexOffsets[c] + chunkPositionIndices[c].size();
+
+            bool useNormals = !normals.empty() && std::find(missingNormals.begin(), missingNormals.end(), 1) == missingNormals.end();
+            std::vector<uint32_t> positionIndices(indexOffsets.back());
+            std::vector<uint32_t> normalIndices(useNormals ? indexOffsets.back() : 0);
+            std::vector<char> outOfRange(chunkCount, 0);
+
+            BVHTree::parallelFor(chunkCount, chunkCount, [&](uint32_t from, uint32_t to, unsigned){
+                for(uint32_t c = from; c < to; c++){
+                    for(size_t i = 0; i < chunkPositionIndices[c].size(); i++){
+                        uint32_t index = chunkPositionIndices[c][i];
+                        if(index >= positions.size()) outOfRange[c] = 1;
+                        positionIndices[indexOffsets[c] + i] = index;
+                        if(useNormals){
+                            uint32_t normal = chunkNormalIndices[c][i];
+                            if(normal >= normals.size()) outOfRange[c] = 1;
+                            normalIndices[indexOffsets[c] + i] = normal;
+                        }
+                    }
+                    std::vector<uint32_t>().swap(chunkPositionIndices[c]);
+                    std::vector<uint32_t>().swap(chunkNormalIndices[c]);
+                }
+            });
+
+            if(std::find(outOfRange.begin(), outOfRange.end(), 1) != outOfRange.end()){
+                throw std::runtime_error("ERROR: OBJ face references a missing vertex");
+            }
+
+            return MakeMeshData(std::move(positions), std::move(normals), std::move(positionIndices), normalIndices);
+        }
+
+        /**
+         * \brief Размер скалярного типа PLY
+         * \param type Тип
+         * \return Размер в байтах
+         */
+        inline size_t PlyTypeSize(PlyType type)
+        {
+            switch(type)
+            {
+                case ePlyInt8: case ePlyUInt8: return 1;
+                case ePlyInt16: case ePlyUInt16: return 2;
+                case ePlyInt32: case ePlyUInt32: case ePlyFloat32: return 4;
+                default: return 8;
+            }
+        }
+
+        /**
+         * \brief Тип PLY по названию
+         * \param name Название (в т.ч. альтернативное - int8, float32 и т.д.)
+         * \return Тип
+         */
+        inline PlyType PlyTypeFromName(const std::string& name)
+        {
+            if(name == "char" || name == "int8") return ePlyInt8;
+            if(name == "uchar" || name == "uint8") return ePlyUInt8;
+            if(name == "short" || name == "int16") return ePlyInt16;
+            if(name == "ushort" || name == "uint16") return ePlyUInt16;
+            if(name == "int" || name == "int32") return ePlyInt32;
+            if(name == "uint" || name == "uint32") return ePlyUInt32;
+            if(name == "float" || name == "float32") return ePlyFloat32;
+            if(name == "double" || name == "float64") return ePlyFloat64;
+            throw std::runtime_error("ERROR: Unknown PLY property type " + name);
+        }
+
+        /**
+         * \brief Чтение скалярного значения из двоичных данных PLY
+         * \param p Указатель на значение
+         * \param type Тип значения
+         * \param swap Требуется ли смена порядка байт
+         * \return Значение
+         */
+        inline double PlyRead(const char* p, PlyType type, bool swap)
+        {
+            char bytes[8];
+            size_t size = PlyTypeSize(type);
+            std::memcpy(bytes, p, size);
+            if(swap) std::reverse(bytes, bytes + size);
+
+            switch(type)
+            {
+                case ePlyInt8: { int8_t v; std::memcpy(&v, bytes, 1); return v; }
+                case ePlyUInt8: { uint8_t v; std::memcpy(&v, bytes, 1); return v; }
+                case ePlyInt16: { int16_t v; std::memcpy(&v, bytes, 2); return v; }
+                case ePlyUInt16: { uint16_t v; std::memcpy(&v, bytes, 2); return v; }
+                case ePlyInt32: { int32_t v; std::memcpy(&v, bytes, 4); return v; }
+                case ePlyUInt32: { uint32_t v; std::memcpy(&v, bytes, 4); return v; }
+                case ePlyFloat32: { float v; std::memcpy(&v, bytes, 4); return v; }
+                default: { double v; std::memcpy(&v, bytes, 8); return v; }
+            }
+        }
+
+        /**
+         * \brief Загрузка сетки в формате PLY (ascii, binary_little_endian, binary_big_endian)
+         * \param begin Начало данных файла
+         * \param end Конец данных файла
+         * \param threads Кол-во потоков
+         * \return Данные сетки
+         *
+         * \details Учитываются свойства x, y, z, nx, ny, nz элемента vertex и список vertex_indices (vertex_index)
+         * элемента face. Остальные элементы и свойства пропускаются
+         */
+        inline std::shared_ptr<MeshData> LoadPly(const char* begin, const char* end, unsigned threads = 1)
+        {
+            // Заголовок
+            if(end - begin < 4 || std::memcmp(begin, "ply", 3) != 0){
+                throw std::runtime_error("ERROR: Not a PLY file");
+            }
+
+            std::vector<PlyElement> elements{};
+            std::string format{};
+            const char* p = NextLine(begin, end);
+            for(;; p = NextLine(p, end))
+            {
+                if(p >= end) throw std::runtime_error("ERROR: Unexpected end of PLY header");
+
+                const char* lineEnd = NextLine(p, end);
+                std::string line(p, lineEnd);
+                while(!line.empty() && (line.back() == '\n' || line.back() == '\r')) line.pop_back();
+
+                std::vector<std::string> words{};
+                for(size_t i = 0; i < line.size();){
+                    size_t next = line.find(' ', i);
+                    if(next == std::string::npos) next = line.size();
+                    if(next > i) words.push_back(line.substr(i, next - i));
+                    i = next + 1;
+                }
+
+                if(words.empty() || words[0] == "comment" || words[0] == "obj_info") continue;
+                if(words[0] == "end_header"){
+                    p = lineEnd;
+                    break;
+                }
+
+                if(words[0] == "format" && words.size() >= 2){
+                    format = words[1];
+                } else if(words[0] == "element" && words.size() >= 3){
+                    PlyElement element{};
+                    element.name = words[1];
+                    element.count = static_cast<size_t>(std::stoull(words[2]));
+                    elements.push_back(element);
+                } else if(words[0] == "property" && !elements.empty()){
+                    PlyProperty property{};
+                    if(words.size() >= 5 && words[1] == "list"){
+                        property.isList = true;
+                        property.countType = PlyTypeFromName(words[2]);
+                        property.type = PlyTypeFromName(words[3]);
+                        property.name = words[4];
+                    } else if(words.size() >= 3){
+                        property.type = PlyTypeFromName(words[1]);
+                        property.name = words[2];
+                    }
+                    elements.back().properties.push_back(property);
+                } else {
+                    throw std::runtime_error("ERROR: Unexpected PLY header line: " + line);
+                }
+            }
+
+            bool ascii = format == "ascii";
+            bool swap = format == "binary_big_endian";
+            if(!ascii && !swap && format != "binary_little_endian"){
+                throw std::runtime_error("ERROR: Unknown PLY format " + format);
+            }
+
+            // Индексы используемых свойств вершин (x, y, z, nx, ny, nz) и списка индексов граней
+            const PlyElement* vertexElement = nullptr;
+            const PlyElement* faceElement = nullptr;
+            int vertexProperties[6] = {-1, -1, -1, -1, -1, -1};
+            int faceProperty = -1;
+            for(const auto& element : elements)
+            {
+                if(element.name == "vertex"){
+                    vertexElement = &element;
+                    const char* names[6] = {"x", "y", "z", "nx", "ny", "nz"};
+                    for(size_t i = 0; i < element.properties.size(); i++){
+                        for(unsigned k = 0; k < 6; k++){
+                            if(!element.properties[i].isList && element.properties[i].name == names[k]) vertexProperties[k] = static_cast<int>(i);
+                        }
+                    }
+                } else if(element.name == "face"){
+                    faceElement = &element;
+                    for(size_t i = 0; i < element.properties.size(); i++){
+                        const auto& name = element.properties[i].name;
+                        if(element.properties[i].isList && (name == "vertex_indices" || name == "vertex_index")) faceProperty = static_cast<int>(i);
+                    }
+                }
+            }
+
+            if(vertexElement == nullptr || vertexProperties[0] < 0 || vertexProperties[1] < 0 || vertexProperties[2] < 0 || faceElement == nullptr || faceProperty < 0){
+                throw std::runtime_error("ERROR: PLY file has no vertex positions or face indices");
+            }
+
+            bool hasNormals = vertexProperties[3] >= 0 && vertexProperties[4] >= 0 && vertexProperties[5] >= 0;
+            std::vector<math::Vec3<float>> positions(vertexElement->count);
+            std::vector<math::Vec3<float>> normals(hasNormals ? vertexElement->count : 0);
+            std::vector<uint32_t> indices{};
+            size_t faceCount = faceElement->count;
+            auto parts = std::max(threads, 1u);
+
+            if(ascii)
+            {
+                // Подсчет строк в каждой части, чтобы определить к какому элементу относится строка
+                auto chunks = SplitLines(p, end, threads);
+                auto chunkCount = static_cast<uint32_t>(chunks.size() - 1);
+                std::vector<size_t> lineOffsets(chunkCount + 1, 0);
+                BVHTree::parallelFor(chunkCount, chunkCount, [&](uint32_t from, uint32_t to, unsigned){
+                    for(uint32_t c = from; c < to; c++){
+                        for(const char* q = chunks[c]; q < chunks[c + 1]; q = NextLine(q, chunks[c + 1])) lineOffsets[c + 1]++;
+                    }
+                });
+                for(uint32_t c = 0; c < chunkCount; c++) lineOffsets[c + 1] += lineOffsets[c];
+
+                std::vector<std::vector<uint32_t>> chunkIndices(chunkCount);
+                std::vector<size_t> errorLines(chunkCount, 0);
+
+                BVHTree::parallelFor(chunkCount, chunkCount, [&](uint32_t from, uint32_t to, unsigned){
+                    std::vector<int64_t> polygon{};
+                    for(uint32_t c = from; c < to; c++)
+                    {
+                        size_t line = lineOffsets[c];
+                        for(const char* q = chunks[c]; q < chunks[c + 1] && errorLines[c] == 0; q = NextLine(q, chunks[c + 1]), line++)
+                        {
+                            // Элемент, к которому относится строка
+                            size_t first = 0;
+                            const PlyElement* element = nullptr;
+                            for(const auto& e : elements){
+                                if(line < first + e.count){ element = &e; break; }
+                                first += e.count;
+                            }
+
+                            if(element != vertexElement && element != faceElement) continue;
+
+                            const char* lineEnd = NextLine(q, chunks[c + 1]);
+                            size_t record = line - first;
+                            polygon.clear();
+
+                            for(size_t i = 0; i < element->properties.size() && q != nullptr; i++)
+                            {
+                                const auto& property = element->properties[i];
+                                if(property.isList){
+                                    int64_t count = 0;
+                                    q = ParseInt(q, lineEnd, &count);
+                                    for(int64_t k = 0; k < count && q != nullptr; k++){
+                                        int64_t index = 0;
+                                        q = ParseInt(q, lineEnd, &index);
+                                        if(element == faceElement && static_cast<int>(i) == faceProperty) polygon.push_back(index);
+                                    }
+                                } else {
+                                    float value = 0.0f;
+                                    q = ParseFloat(q, lineEnd, &value);
+                                    if(element == vertexElement){
+                                        for(unsigned k = 0; k < 6; k++){
+                                            if(vertexProperties[k] != static_cast<int>(i)) continue;
+                                            if(k < 3) SetComponent(&positions[record], k, value);
+                                            else if(hasNormals) SetComponent(&normals[record], k - 3, value);
+                                        }
+                                    }
+                                }
+                            }
+
+                            if(q == nullptr){
+                                errorLines[c] = line + 1;
+                                break;
+                            }
+
+                            for(size_t i = 1; i + 1 < polygon.size(); i++){
+                                for(size_t k : {size_t(0), i, i + 1}) chunkIndices[c].push_back(static_cast<uint32_t>(polygon[k]));
+                            }
+                        }
+                    }
+                });
+
+                for(uint32_t c = 0; c < chunkCount; c++){
+                    if(errorLines[c] != 0) throw std::runtime_error("ERROR: Can't parse PLY data (line " + std::to_string(errorLines[c]) + " after header)");
+                }
+                for(auto& chunk : chunkIndices){
+                    indices.insert(indices.end(), chunk.begin(), chunk.end());
+                    std::vector<uint32_t>().swap(chunk);
+                }
+            }
+            else
+            {
+                // Размер записи элемента из одних скалярных свойств (0 - если есть списки)
+                auto fixedRecordSize = [](const PlyElement& element) -> size_t {
+                    size_t size = 0;
+                    for(const auto& property : element.properties){
+                        if(property.isList) return 0;
+                        size += PlyTypeSize(property.type);
+                    }
+                    return size;
+                };
+
+                // Пропуск записи элемента в двоичных данных
+                auto skipRecord = [&](const PlyElement& element, const char* q) -> const char* {
+                    for(const auto& property : element.properties){
+                        if(q == nullptr || q >= end) return nullptr;
+                        if(property.isList){
+                            auto count = static_cast<size_t>(PlyRead(q, property.countType, swap));
+                            q += PlyTypeSize(property.countType) + count * PlyTypeSize(property.type);
+                        } else {
+                            q += PlyTypeSize(property.type);
+                        }
+                    }
+                    return q <= end ? q : nullptr;
+                };
+
+                for(const auto& element : elements)
+                {
+                    size_t recordSize = fixedRecordSize(element);
+
+                    if(&element == vertexElement)
+                    {
+                        if(recordSize == 0 || static_cast<size_t>(end - p) < recordSize * element.count){
+                            throw std::runtime_error("ERROR: Unexpected PLY vertex data");
+                        }
+
+                        // Смещения свойств в записи
+                        size_t offsets[6] = {};
+                        for(unsigned k = 0; k < 6; k++){
+                            if(vertexProperties[k] < 0) continue;
+                            for(int i = 0; i < vertexProperties[k]; i++) offsets[k] += PlyTypeSize(element.properties[static_cast<size_t>(i)].type);
+                        }
+
+                        const char* data = p;
+                        BVHTree::parallelFor(static_cast<uint32_t>(element.count), parts, [&](uint32_t from, uint32_t to, unsigned){
+                            for(uint32_t i = from; i < to; i++){
+                                const char* record = data + static_cast<size_t>(i) * recordSize;
+                                for(unsigned k = 0; k < (hasNormals ? 6u : 3u); k++){
+                                    auto value = static_cast<float>(PlyRead(record + offsets[k], element.properties[static_cast<size_t>(vertexProperties[k])].type, swap));
+                                    if(k < 3) SetComponent(&positions[i], k, value);
+                                    else SetComponent(&normals[i], k - 3, value);
+                                }
+                            }
+                        });
+                        p += recordSize * element.count;
+                    }
+                    else if(&element == faceElement)
+                    {
+                        // Размеры свойств до и после списка индексов (должны быть скалярными)
+                        size_t before = 0, after = 0;
+                        bool scalarOthers = true;
+                        for(size_t i = 0; i < element.properties.size(); i++){
+                            if(static_cast<int>(i) == faceProperty) continue;
+                            if(element.properties[i].isList) scalarOthers = false;
+                            (static_cast<int>(i) < faceProperty ? before : after) += PlyTypeSize(element.properties[i].type);
+                        }
+
+                        const PlyProperty& list = element.properties[static_cast<size_t>(faceProperty)];
+                        size_t countSize = PlyTypeSize(list.countType);
+                        size_t indexSize = PlyTypeSize(list.type);
+                        size_t triangleSize = before + countSize + 3 * indexSize + after;
+
+                        // Если все грани - треугольники, записи имеют одинаковый размер и разбираются параллельно
+                        bool allTriangles = scalarOthers && static_cast<size_t>(end - p) >= triangleSize * faceCount;
+                        if(allTriangles){
+                            std::vector<char> triangles(parts, 1);
+                            const char* data = p;
+                            BVHTree::parallelFor(static_cast<uint32_t>(faceCount), parts, [&](uint32_t from, uint32_t to, unsigned part){
+                                for(uint32_t i = from; i < to && triangles[part]; i++){
+                                    if(PlyRead(data + static_cast<size_t>(i) * triangleSize + before, list.countType, swap) != 3.0) triangles[part] = 0;
+                                }
+                            });
+                            allTriangles = std::find(triangles.begin(), triangles.end(), 0) == triangles.end();
+                        }
+
+                        if(allTriangles){
+                            indices.resize(faceCount * 3);
+                            const char* data = p;
+                            BVHTree::parallelFor(static_cast<uint32_t>(faceCount), parts, [&](uint32_t from, uint32_t to, unsigned){
+                                for(uint32_t i = from; i < to; i++){
+                                    const char* record = data + static_cast<size_t>(i) * triangleSize + before + countSize;
+                                    for(unsigned k = 0; k < 3; k++) indices[i * 3 + k] = static_cast<uint32_t>(PlyRead(record + k * indexSize, list.type, swap));
+                                }
+                            });
+                            p += triangleSize * faceCount;
+                        } else {
+                            // Произвольные многоугольники - последовательный разбор
+                            std::vector<uint32_t> polygon{};
+                            for(size_t f = 0; f < faceCount; f++)
+                            {
+                                const char* q = p;
+                                polygon.clear();
+                                for(size_t i = 0; i < element.properties.size() && q != nullptr; i++)
+                                {
+                                    const auto& property = element.properties[i];
+                                    if(q + PlyTypeSize(property.isList ? property.countType : property.type) > end){ q = nullptr; break; }
+                                    if(!property.isList){ q += PlyTypeSize(property.type); continue; }
+
+                                    auto count = static_cast<size_t>(PlyRead(q, property.countType, swap));
+                                    q += PlyTypeSize(property.countType);
+                                    if(q + count * PlyTypeSize(property.type) > end){ q = nullptr; break; }
+                                    for(size_t k = 0; k < count && static_cast<int>(i) == faceProperty; k++){
+                                        polygon.push_back(static_cast<uint32_t>(PlyRead(q + k * PlyTypeSize(property.type), property.type, swap)));
+                                    }
+                                    q += count * PlyTypeSize(property.type);
+                                }
+
+                                if(q == nullptr) throw std::runtime_error("ERROR: Unexpected end of PLY face data");
+                                for(size_t i = 1; i + 1 < polygon.size(); i++){
+                                    indices.push_back(polygon[0]);
+                                    indices.push_back(polygon[i]);
+                                    indices.push_back(polygon[i + 1]);
+                                }
+                                p = q;
+                            }
+                        }
+                    }
+                    else
+                    {
+                        // Прочие элементы пропускаются
+                        if(recordSize != 0){
+                            p += recordSize * element.count;
+                        } else {
+                            for(size_t i = 0; i < element.count && p != nullptr; i++) p = skipRecord(element, p);
+                        }
+                        if(p == nullptr || p > end) throw std::runtime_error("ERROR: Unexpected end of PLY data");
+                    }
+                }
+            }
+
+            for(auto index : indices){
+                if(index >= positions.size()) throw std::runtime_error("ERROR: PLY face references a missing vertex");
+            }
+
+            auto data = std::make_shared<MeshData>();
+            data->positions = std::move(positions);
+            data->normals = std::move(normals);
+            data->indices = std::move(indices);
+            return data;
+        }
+
+        /**
+         * \brief Загрузка сетки из уже отображенного в память файла (формат определяется по расширению)
+         * \param file Отображенный файл
+         * \param path Путь к файлу (.obj или .ply)
+         * \param threads Кол-во потоков разбора
+         * \return Данные сетки
+         */
+        inline std::shared_ptr<MeshData> LoadMesh(const MappedFile& file, const std::string& path, unsigned threads = 1)
+        {
+            std::string extension = path.substr(path.find_last_of('.') == std::string::npos ? path.size() : path.find_last_of('.'));
+            std::transform(extension.begin(), extension.end(), extension.begin(), [](char c){ return static_cast<char>(std::tolower(c)); });
+
+            const char* begin = file.getData();
+            const char* end = begin + file.getSize();
+
+            if(extension == ".obj") return LoadObj(begin, end, threads);
+            if(extension == ".ply") return LoadPly(begin, end, threads);
+            throw std::runtime_error("ERROR: Unsupported mesh format " + path);
+        }
+
+        /**
+         * \brief Загрузка сетки из файла (формат определяется по расширению)
+         * \param path Путь к файлу (.obj или .ply)
+         * \param threads Кол-во потоков разбора
+         * \return Данные сетки
+         */
+        inline std::shared_ptr<MeshData> LoadMesh(const std::string& path, unsigned threads = 1)
+        {
+            return LoadMesh(MappedFile(path), path, threads);
+        }
+    }
+}
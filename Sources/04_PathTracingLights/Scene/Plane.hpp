@@ -57,7 +57,8 @@ namespace scene
                     hitInfo->point = ray.getOrigin() + (ray.getDirection() * t);
                     hitInfo->normal = normal_;
                     hitInfo->frontFaceSurface = true;
-                    hitInfo->materialPtr = this->materialPtr_;
+                    hitInfo->materialPtr = this->materialPtr_.get();
+                    hitInfo->objectPtr = this;
 
                     // Если нормаль не направлена против луча, считать что это обратная сторона (и инвертировать нормаль)
                     if(math::Dot(-ray.getDirection(),hitInfo->normal) < 0.0f){
@@ -69,5 +70,16 @@ namespace scene
             }
             return false;
         }
+
+        /**
+         * \brief Описывающий параллелипипед плоскости
+         * \param bboxOut Не используется (плоскость бесконечна)
+         * \return Всегда false - плоскость не ограничена и не может быть помещена в иерархию объемов
+         */
+        bool boundingBox(math::BBox<>* bboxOut) const override
+        {
+            (void) bboxOut;
+            return false;
+        }
     };
 }
\ No newline at end of file
@@ -11,6 +11,10 @@ namespace scene
         math::Vec3<float> position_;
         /// Ориентация в пространстве
         math::Vec3<float> orientation_;
+        /// Матрица поворота из мирового пространства в пространство объекта (применяется к лучу)
+        math::Mat3<float> toObject_;
+        /// Матрица поворота из пространства объекта в мировое (обратная к toObject_)
+        math::Mat3<float> toWorld_;
         /// Размеры прямоугольника
         math::Vec2<float> sizes_;
 
@@ -19,7 +23,7 @@ namespace scene
          * \brief Конструктор по умолчанию
          */
         Rectangle():
-        Hittable(),position_({0.0f,0.0f,0.0f}),orientation_({0.0f,0.0f,0.0f}),sizes_({1.0f,1.0f}){}
+        Hittable(),position_({0.0f,0.0f,0.0f}),orientation_({0.0f,0.0f,0.0f}),toObject_(1.0f),toWorld_(1.0f),sizes_({1.0f,1.0f}){}
 
         /**
          * \brief Основной конструктор
@@ -33,13 +37,32 @@ namespace scene
                 const math::Vec3<float>& position,
                 const math::Vec2<float>& sizes = {1.0f,1.0f},
                 const math::Vec3<float>& orientation = {0.0f,0.0f,0.0f}):
-        Hittable(materialPtr),position_(position),orientation_(orientation),sizes_(sizes){}
+        Hittable(materialPtr),position_(position),orientation_(orientation),toObject_(math::GetRotationMat(-orientation)),toWorld_(math::Transpose(toObject_)),sizes_(sizes){}
 
         /**
          * \brief Деструктор
          */
         ~Rectangle() override = default;
 
+        /**
+         * \brief Получить положение центра прямоугольника
+         * \return Положение
+         */
+        const math::Vec3<float>& getPosition() const
+        {
+            return position_;
+        }
+
+        /**
+         * \brief Задать положение центра прямоугольника
+         * \param position Положение
+         * \details После перемещения содержащая объект иерархия должна быть обновлена (BVH::refit)
+         */
+        void setPosition(const math::Vec3<float>& position)
+        {
+            position_ = position;
+        }
+
         /**
          * \brief Пересечение луча и прямоугольника
          * \param ray Луч
@@ -55,12 +78,12 @@ namespace scene
 
             // Для того чтобы трансформировать объект (положение, ориентацию) нужно применить обратную трансформацию к лучу
             // T.е сдвигается не сам объект, а луч относительно объекта.
-            auto inverseRotation = math::GetRotationMat(-orientation_);
+            // Матрица обратного поворота (toObject_) вычисляется один раз в конструкторе
 
             // Траснформированный луч
             math::Ray transformedRay(
-                    inverseRotation * (ray.getOrigin() - position_),
-                    inverseRotation * ray.getDirection());
+                    toObject_ * (ray.getOrigin() - position_),
+                    toObject_ * ray.getDirection());
 
             // Половинные ширина и высота
             float halfWidth = this->sizes_.x / 2.0f;
@@ -80,7 +103,8 @@ namespace scene
                     hitInfo->point = ray.getOrigin() + (ray.getDirection() * t);
                     hitInfo->normal = normal;
                     hitInfo->frontFaceSurface = true;
-                    hitInfo->materialPtr = this->materialPtr_;
+                    hitInfo->materialPtr = this->materialPtr_.get();
+                    hitInfo->objectPtr = this;
 
                     // Если нормаль не направлена против луча, считать что это обратная сторона (и инвертировать нормаль)
                     if(math::Dot(-transformedRay.getDirection(),hitInfo->normal) < 0.0f){
@@ -89,11 +113,60 @@ namespace scene
                     }
 
                     // Поскольку нормаль считалась в пространстве объекта ее нужно перевести в глобальное пространство
-                    hitInfo->normal = math::GetRotationMat(orientation_) * hitInfo->normal;
+                    hitInfo->normal = toWorld_ * hitInfo->normal;
                 }
                 return true;
             }
             return false;
         }
+
+        /**
+         * \brief Описывающий параллелипипед прямоугольника
+         * \param bboxOut Описывающий параллелипипед в мировых координатах
+         * \return Ограничен ли объект
+         */
+        bool boundingBox(math::BBox<>* bboxOut) const override
+        {
+            if(bboxOut != nullptr)
+            {
+                // Половинные ширина и высота
+                float halfWidth = this->sizes_.x / 2.0f;
+                float halfHeight = this->sizes_.y / 2.0f;
+
+                // Объединить все углы прямоугольника в мировых координатах
+                math::BBox<> result = math::EmptyBBox();
+                for(unsigned i = 0; i < 4; i++){
+                    math::Vec3<float> corner = {(i & 1u) ? halfWidth : -halfWidth, (i & 2u) ? halfHeight : -halfHeight, 0.0f};
+                    result = math::Union(result, position_ + (toWorld_ * corner));
+                }
+
+                // Небольшой отступ, чтобы плоский параллелипипед не был вырожденным
+                const math::Vec3<float> padding = {0.0001f,0.0001f,0.0001f};
+                *bboxOut = {result.min - padding, result.max + padding};
+            }
+            return true;
+        }
+
+        /**
+         * \brief Площадь прямоугольника
+         * \return Площадь
+         */
+        float area() const override
+        {
+            return sizes_.x * sizes_.y;
+        }
+
+        /**
+         * \brief Точка на прямоугольнике (равномерно распределенная по площади)
+         * \param u Пара значений в пределах [0, 1)
+         * \param pointOut Точка в мировых координатах
+         * \param normalOut Нормаль лицевой стороны (положительная ось Z в пространстве объекта)
+         */
+        void samplePoint(const math::Vec2<float>& u, math::Vec3<float>* pointOut, math::Vec3<float>* normalOut) const override
+        {
+            math::Vec3<float> local = {(u.x - 0.5f) * sizes_.x, (u.y - 0.5f) * sizes_.y, 0.0f};
+            *pointOut = position_ + (toWorld_ * local);
+            *normalOut = toWorld_ * math::Vec3<float>(0.0f,0.0f,1.0f);
+        }
     };
 }
\ No newline at end of file
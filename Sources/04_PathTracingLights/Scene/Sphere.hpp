@@ -36,6 +36,25 @@ namespace scene
          */
         ~Sphere() override = default;
 
+        /**
+         * \brief Получить положение центра сферы
+         * \return Положение
+         */
+        const math::Vec3<float>& getPosition() const
+        {
+            return position_;
+        }
+
+        /**
+         * \brief Задать положение центра сферы
+         * \param position Положение
+         * \details После перемещения содержащая объект иерархия должна быть обновлена (BVH::refit)
+         */
+        void setPosition(const math::Vec3<float>& position)
+        {
+            position_ = position;
+        }
+
         /**
          * \brief Пересечение луча и сферы
          * \param ray Луч
@@ -60,7 +79,8 @@ namespace scene
                     hitInfo->point = ray.getOrigin() + (ray.getDirection() * t);
                     hitInfo->normal = math::Normalize(hitInfo->point - position_);
                     hitInfo->frontFaceSurface = true;
-                    hitInfo->materialPtr = this->materialPtr_;
+                    hitInfo->materialPtr = this->materialPtr_.get();
+                    hitInfo->objectPtr = this;
 
                     // Если нужно инвертировать нормали
                     if(flipNormals_){
@@ -77,5 +97,46 @@ namespace scene
             }
             return false;
         }
+
+        /**
+         * \brief Описывающий параллелипипед сферы
+         * \param bboxOut Описывающий параллелипипед в мировых координатах
+         * \return Ограничен ли объект
+         */
+        bool boundingBox(math::BBox<>* bboxOut) const override
+        {
+            if(bboxOut != nullptr){
+                math::Vec3<float> r = {radius_,radius_,radius_};
+                *bboxOut = {position_ - r, position_ + r};
+            }
+            return true;
+        }
+
+        /**
+         * \brief Площадь сферы
+         * \return Площадь
+         */
+        float area() const override
+        {
+            return 4.0f * static_cast<float>(M_PI) * radius_ * radius_;
+        }
+
+        /**
+         * \brief Точка на сфере (равномерно распределенная по площади)
+         * \param u Пара значений в пределах [0, 1)
+         * \param pointOut Точка в мировых координатах
+         * \param normalOut Нормаль лицевой стороны (внутрь для вывернутой сферы)
+         */
+        void samplePoint(const math::Vec2<float>& u, math::Vec3<float>* pointOut, math::Vec3<float>* normalOut) const override
+        {
+            // Высота равномерна на отрезке [-1, 1], азимут - на окружности (по теореме Архимеда это равномерно по площади)
+            float z = 1.0f - 2.0f * u.x;
+            float r = sqrtf(std::max(0.0f, 1.0f - z * z));
+            float phi = 2.0f * static_cast<float>(M_PI) * u.y;
+            math::Vec3<float> direction = {r * cosf(phi), r * sinf(phi), z};
+
+            *pointOut = position_ + (direction * radius_);
+            *normalOut = flipNormals_ ? -direction : direction;
+        }
     };
 }
\ No newline at end of file
@@ -0,0 +1,492 @@
+#pragma once
+
+#include <cstdint>
+
+#include "BVH.hpp"
+
+// Использовать SSE для 4-широких узлов
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define WIDE_BVH_SSE
+#include <xmmintrin.h>
+#endif
+
+// Использовать AVX2 для 8-широких узлов (сборка с опцией WIDE_BVH_AVX2, иначе 8-широкие узлы проверяются скалярно
+// и медленнее 4-широких)
+#if defined(__AVX2__)
+#define WIDE_BVH_AVX2
+#include <immintrin.h>
+#endif
+
+namespace scene
+{
+    /**
+     * \brief Узел широкой иерархии (N потомков в одном узле)
+     * \tparam N Кол-во потомков (4 или 8)
+     *
+     * \details Параллелипипеды потомков хранятся покомпонентно (SoA), что позволяет проверить пересечение луча
+     * со всеми потомками узла одной SIMD-операцией. Выравнивание не задается (std::vector в C++14 не учитывает
+     * расширенное выравнивание), поэтому данные загружаются невыровненными операциями
+     */
+    template <unsigned N>
+    struct WideBVHNode
+    {
+        /// Минимальные координаты параллелипипедов потомков
+        float minX[N], minY[N], minZ[N];
+        /// Максимальные координаты параллелипипедов потомков
+        float maxX[N], maxY[N], maxZ[N];
+        /// Индекс узла-потомка, либо индекс первого примитива (для листа)
+        uint32_t children[N];
+        /// Кол-во примитивов листа (0 для внутреннего узла)
+        uint32_t primitiveCounts[N];
+        /// Кол-во используемых потомков
+        uint32_t childCount;
+    };
+
+    /**
+     * \brief Широкая иерархия ограничивающих объемов (QBVH при N = 4, OBVH при N = 8)
+     * \tparam N Кол-во потомков в узле
+     *
+     * \details Строится "схлопыванием" бинарной иерархии - у каждого узла потомки с наибольшей площадью
+     * поверхности заменяются их собственными потомками, пока их не станет N. Листья (и порядок примитивов)
+     * остаются теми же, что и в бинарной иерархии
+     */
+    template <unsigned N>
+    class WideBVHTree
+    {
+    private:
+        /**
+         * \brief Элемент стека обхода
+         */
+        struct StackEntry
+        {
+            /// Индекс узла, либо индекс первого примитива
+            uint32_t child;
+            /// Кол-во примитивов (0 - внутренний узел)
+            uint32_t primitiveCount;
+            /// Расстояние до входа в параллелипипед
+            float distance;
+        };
+
+        /// Узлы иерархии (корень - нулевой узел)
+        std::vector<WideBVHNode<N>> nodes_;
+
+        /**
+         * \brief Рекурсивное схлопывание поддерева бинарной иерархии
+         * \param binaryNodes Узлы бинарной иерархии
+         * \param children Потомки (узлы бинарной иерархии) которые должны стать потомками нового узла
+         * \return Индекс созданного узла
+         */
+        uint32_t collapse(const std::vector<BVHNode>& binaryNodes, std::vector<uint32_t> children)
+        {
+            // Раскрывать внутренние узлы с наибольшей площадью, пока потомков меньше N
+            while(children.size() < N)
+            {
+                int best = -1;
+                float bestArea = -1.0f;
+                for(size_t i = 0; i < children.size(); i++){
+                    const BVHNode& node = binaryNodes[children[i]];
+                    float area = math::SurfaceArea(node.bounds);
+                    if(node.primitiveCount == 0 && area > bestArea){
+                        bestArea = area;
+                        best = static_cast<int>(i);
+                    }
+                }
+
+                if(best < 0) break;
+
+                uint32_t index = children[static_cast<size_t>(best)];
+                children[static_cast<size_t>(best)] = index + 1;
+                children.push_back(binaryNodes[index].offset);
+            }
+
+            auto nodeIndex = static_cast<uint32_t>(nodes_.size());
+            nodes_.emplace_back();
+
+            // Пустые слоты заполняются вырожденными параллелипипедами, луч их не пересекает
+            WideBVHNode<N> wide{};
+            for(unsigned i = 0; i < N; i++){
+                wide.minX[i] = wide.minY[i] = wide.minZ[i] = std::numeric_limits<float>::max();
+                wide.maxX[i] = wide.maxY[i] = wide.maxZ[i] = -std::numeric_limits<float>::max();
+                wide.children[i] = 0;
+                wide.primitiveCounts[i] = 0;
+            }
+            wide.childCount = static_cast<uint32_t>(children.size());
+
+            for(unsigned i = 0; i < children.size(); i++)
+            {
+                const BVHNode& child = binaryNodes[children[i]];
+                wide.minX[i] = child.bounds.min.x; wide.minY[i] = child.bounds.min.y; wide.minZ[i] = child.bounds.min.z;
+                wide.maxX[i] = child.bounds.max.x; wide.maxY[i] = child.bounds.max.y; wide.maxZ[i] = child.bounds.max.z;
+
+                if(child.primitiveCount > 0){
+                    wide.children[i] = child.offset;
+                    wide.primitiveCounts[i] = child.primitiveCount;
+                } else {
+                    wide.children[i] = collapse(binaryNodes, {children[i] + 1, child.offset});
+                    wide.primitiveCounts[i] = 0;
+                }
+            }
+
+            nodes_[nodeIndex] = wide;
+            return nodeIndex;
+        }
+
+        /**
+         * \brief Пересечение луча со всеми параллелипипедами потомков узла
+         * \param node Узел
+         * \param origin Начало луча
+         * \param inverse Обратное направление луча
+         * \param tMin Минимальное расстояние
+         * \param tMax Максимальное расстояние
+         * \param distances Расстояния до входа в параллелипипеды (заполняются для всех потомков)
+         * \return Битовая маска потомков, пересеченных лучом
+         */
+        static unsigned intersectChildren(const WideBVHNode<N>& node, const math::Vec3<float>& origin, const math::Vec3<float>& inverse,
+                float tMin, float tMax, float* distances)
+        {
+            unsigned mask = 0;
+            for(unsigned i = 0; i < N; i++)
+            {
+                float tx1 = (node.minX[i] - origin.x) * inverse.x, tx2 = (node.maxX[i] - origin.x) * inverse.x;
+                float ty1 = (node.minY[i] - origin.y) * inverse.y, ty2 = (node.maxY[i] - origin.y) * inverse.y;
+                float tz1 = (node.minZ[i] - origin.z) * inverse.z, tz2 = (node.maxZ[i] - origin.z) * inverse.z;
+                float tEnter = std::max(std::max(std::min(tx1,tx2),std::min(ty1,ty2)),std::max(std::min(tz1,tz2),tMin));
+                float tExit = std::min(std::min(std::max(tx1,tx2),std::max(ty1,ty2)),std::min(std::max(tz1,tz2),tMax));
+                distances[i] = tEnter;
+                if(tEnter <= tExit) mask |= (1u << i);
+            }
+            return mask & ((1u << node.childCount) - 1u);
+        }
+
+    public:
+        /**
+         * \brief Конструктор по умолчанию (пустая иерархия)
+         */
+        WideBVHTree() = default;
+
+        /**
+         * \brief Построение из бинарной иерархии
+         * \param binaryNodes Узлы бинарной иерархии (в формате BVHTree)
+         */
+        void build(const std::vector<BVHNode>& binaryNodes)
+        {
+            nodes_.clear();
+            if(binaryNodes.empty()) return;
+            nodes_.reserve(binaryNodes.size() / 2 + 1);
+
+            // Если корень бинарной иерархии - лист, он становится единственным потомком корня
+            if(binaryNodes[0].primitiveCount > 0) collapse(binaryNodes, {0});
+            else collapse(binaryNodes, {1, binaryNodes[0].offset});
+        }
+
+        /**
+         * \brief Получить узлы иерархии
+         * \return Константная ссылка на массив узлов
+         */
+        const std::vector<WideBVHNode<N>>& getNodes() const
+        {
+            return nodes_;
+        }
+
+        /**
+         * \brief Поиск ближайшего пересечения луча с примитивами иерархии
+         * \tparam F Тип функтора пересечения с примитивом
+         * \param ray Луч
+         * \param tMin Минимальное расстояние
+         * \param tMax Максимальное расстояние
+         * \param intersect Функтор вида bool(uint32_t leafIndex, float tMin, float& closest) (как в BVHTree::traverse)
+         * \return Было ли пересечение с каким-либо примитивом
+         */
+        template <typename F>
+        bool traverse(const math::Ray& ray, float tMin, float tMax, F&& intersect) const
+        {
+            if(nodes_.empty()) return false;
+
+            float closest = tMax;
+            bool hitAnything = false;
+
+            // Стек отложенных потомков (глубина не больше, чем у бинарной иерархии - BVH_MAX_DEPTH, а каждый уровень
+            // добавляет в стек не более N потомков)
+            StackEntry stack[BVH_STACK_SIZE * N];
+            unsigned stackSize = 0;
+            stack[stackSize++] = {0, 0, tMin};
+
+            const math::Vec3<float>& origin = ray.getOrigin();
+            const math::Vec3<float>& inverse = ray.getDirectionInverse();
+
+            while(stackSize > 0)
+            {
+                StackEntry entry = stack[--stackSize];
+
+                // Потомок дальше уже найденного пересечения
+                if(entry.distance > closest) continue;
+
+                // Лист - проверка пересечения со всеми примитивами
+                if(entry.primitiveCount > 0){
+                    for(uint32_t i = entry.child; i < entry.child + entry.primitiveCount; i++){
+                        if(intersect(i, tMin, closest)) hitAnything = true;
+                    }
+                    continue;
+                }
+
+                // Пересечение со всеми потомками узла
+                const WideBVHNode<N>& node = nodes_[entry.child];
+                alignas(32) float distances[N];
+                unsigned mask = intersectChildren(node, origin, inverse, tMin, closest, distances);
+
+                // Пересеченные потомки помещаются в стек от дальнего к ближнему (ближний извлекается первым)
+                unsigned first = stackSize;
+                while(mask != 0)
+                {
+                    unsigned i = 0;
+                    while(((mask >> i) & 1u) == 0) i++;
+                    mask &= ~(1u << i);
+
+                    StackEntry child = {node.children[i], node.primitiveCounts[i], distances[i]};
+                    unsigned j = stackSize++;
+                    while(j > first && stack[j - 1].distance < child.distance){
+                        stack[j] = stack[j - 1];
+                        j--;
+                    }
+                    stack[j] = child;
+                }
+            }
+
+            return hitAnything;
+        }
+
+        /**
+         * \brief Поиск любого пересечения луча с примитивами иерархии (завершается на первом найденном)
+         * \tparam F Тип функтора пересечения с примитивом
+         * \param ray Луч
+         * \param tMin Минимальное расстояние
+         * \param tMax Максимальное расстояние
+         * \param intersect Функтор вида bool(uint32_t leafIndex) (как в BVHTree::traverseAny)
+         * \return Было ли пересечение с каким-либо примитивом
+         */
+        template <typename F>
+        bool traverseAny(const math::Ray& ray, float tMin, float tMax, F&& intersect) const
+        {
+            if(nodes_.empty()) return false;
+
+            // Стек отложенных потомков (сортировка по расстоянию не нужна)
+            StackEntry stack[BVH_STACK_SIZE * N];
+            unsigned stackSize = 0;
+            stack[stackSize++] = {0, 0, tMin};
+
+            const math::Vec3<float>& origin = ray.getOrigin();
+            const math::Vec3<float>& inverse = ray.getDirectionInverse();
+
+            while(stackSize > 0)
+            {
+                StackEntry entry = stack[--stackSize];
+
+                // Лист - первое же пересечение завершает поиск
+                if(entry.primitiveCount > 0){
+                    for(uint32_t i = entry.child; i < entry.child + entry.primitiveCount; i++){
+                        if(intersect(i)) return true;
+                    }
+                    continue;
+                }
+
+                // Пересеченные потомки помещаются в стек
+                const WideBVHNode<N>& node = nodes_[entry.child];
+                alignas(32) float distances[N];
+                unsigned mask = intersectChildren(node, origin, inverse, tMin, tMax, distances);
+                while(mask != 0)
+                {
+                    unsigned i = 0;
+                    while(((mask >> i) & 1u) == 0) i++;
+                    mask &= ~(1u << i);
+                    stack[stackSize++] = {node.children[i], node.primitiveCounts[i], distances[i]};
+                }
+            }
+
+            return false;
+        }
+    };
+
+#ifdef WIDE_BVH_SSE
+    /**
+     * \brief Пересечение луча с 4 параллелипипедами потомков (SSE)
+     */
+    template <>
+    inline unsigned WideBVHTree<4>::intersectChildren(const WideBVHNode<4>& node, const math::Vec3<float>& origin, const math::Vec3<float>& inverse,
+            float tMin, float tMax, float* distances)
+    {
+        const __m128 ox = _mm_set1_ps(origin.x), oy = _mm_set1_ps(origin.y), oz = _mm_set1_ps(origin.z);
+        const __m128 ix = _mm_set1_ps(inverse.x), iy = _mm_set1_ps(inverse.y), iz = _mm_set1_ps(inverse.z);
+
+        __m128 tx1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minX), ox), ix);
+        __m128 tx2 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxX), ox), ix);
+        __m128 ty1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minY), oy), iy);
+        __m128 ty2 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxY), oy), iy);
+        __m128 tz1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minZ), oz), iz);
+        __m128 tz2 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxZ), oz), iz);
+
+        __m128 tEnter = _mm_max_ps(_mm_max_ps(_mm_min_ps(tx1,tx2),_mm_min_ps(ty1,ty2)),_mm_max_ps(_mm_min_ps(tz1,tz2),_mm_set1_ps(tMin)));
+        __m128 tExit = _mm_min_ps(_mm_min_ps(_mm_max_ps(tx1,tx2),_mm_max_ps(ty1,ty2)),_mm_min_ps(_mm_max_ps(tz1,tz2),_mm_set1_ps(tMax)));
+
+        _mm_store_ps(distances, tEnter);
+        auto mask = static_cast<unsigned>(_mm_movemask_ps(_mm_cmple_ps(tEnter, tExit)));
+        return mask & ((1u << node.childCount) - 1u);
+    }
+#endif
+
+#ifdef WIDE_BVH_AVX2
+    /**
+     * \brief Пересечение луча с 8 параллелипипедами потомков (AVX2)
+     */
+    template <>
+    inline unsigned WideBVHTree<8>::intersectChildren(const WideBVHNode<8>& node, const math::Vec3<float>& origin, const math::Vec3<float>& inverse,
+            float tMin, float tMax, float* distances)
+    {
+        const __m256 ox = _mm256_set1_ps(origin.x), oy = _mm256_set1_ps(origin.y), oz = _mm256_set1_ps(origin.z);
+        const __m256 ix = _mm256_set1_ps(inverse.x), iy = _mm256_set1_ps(inverse.y), iz = _mm256_set1_ps(inverse.z);
+
+        __m256 tx1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.minX), ox), ix);
+        __m256 tx2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.maxX), ox), ix);
+        __m256 ty1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.minY), oy), iy);
+        __m256 ty2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.maxY), oy), iy);
+        __m256 tz1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.minZ), oz), iz);
+        __m256 tz2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.maxZ), oz), iz);
+
+        __m256 tEnter = _mm256_max_ps(_mm256_max_ps(_mm256_min_ps(tx1,tx2),_mm256_min_ps(ty1,ty2)),_mm256_max_ps(_mm256_min_ps(tz1,tz2),_mm256_set1_ps(tMin)));
+        __m256 tExit = _mm256_min_ps(_mm256_min_ps(_mm256_max_ps(tx1,tx2),_mm256_max_ps(ty1,ty2)),_mm256_min_ps(_mm256_max_ps(tz1,tz2),_mm256_set1_ps(tMax)));
+
+        _mm256_store_ps(distances, tEnter);
+        auto mask = static_cast<unsigned>(_mm256_movemask_ps(_mm256_cmp_ps(tEnter, tExit, _CMP_LE_OQ)));
+        return mask & ((1u << node.childCount) - 1u);
+    }
+#endif
+
+    /**
+     * \brief Иерархия ограничивающих объемов над элементами сцены с широкими узлами
+     * \tparam N Кол-во потомков в узле (4 или 8)
+     *
+     * \details Строится так же как и BVH (бинарная иерархия сохраняется), но обход выполняется по схлопнутой
+     * широкой иерархии - за одно посещение узла проверяется сразу N параллелипипедов
+     */
+    template <unsigned N>
+    class WideBVH : public BVH
+    {
+    private:
+        /// Широкая иерархия
+        WideBVHTree<N> wideTree_;
+
+    public:
+        /**
+         * \brief Конструктор по умолчанию
+         */
+        WideBVH():BVH(){}
+
+        /**
+         * \brief Основной конструктор
+         * \param elements Элементы сцены
+         * \param threads Кол-во потоков построения
+         * \param method Способ построения бинарной иерархии
+         */
+        explicit WideBVH(const std::vector<std::shared_ptr<Hittable>>& elements, unsigned threads = 1, BVHBuildMethod method = eBinnedSAH):BVH()
+        {
+            this->build(elements, threads, method);
+        }
+
+        /**
+         * \brief Деструктор
+         */
+        ~WideBVH() override = default;
+
+        /**
+         * \brief Построение иерархии
+         * \param elements Элементы сцены
+         * \param threads Кол-во потоков построения
+         * \param method Способ построения бинарной иерархии
+         */
+        void build(const std::vector<std::shared_ptr<Hittable>>& elements, unsigned threads = 1, BVHBuildMethod method = eBinnedSAH) override
+        {
+            BVH::build(elements, threads, method);
+            wideTree_.build(tree_.getNodes());
+        }
+
+        /**
+         * \brief Обновление иерархии после перемещения элементов
+         * \param threads Кол-во потоков
+         * \return Была ли иерархия перестроена полностью
+         *
+         * \details Широкая иерархия заново схлопывается из обновленной бинарной (это линейная по времени операция)
+         */
+        bool refit(unsigned threads = 1) override
+        {
+            if(BVH::refit(threads)) return true;
+            wideTree_.build(tree_.getNodes());
+            return false;
+        }
+
+        /**
+         * \brief Получить кол-во узлов широкой иерархии
+         * \return Кол-во узлов
+         */
+        size_t getWideNodeCount() const
+        {
+            return wideTree_.getNodes().size();
+        }
+
+        /**
+         * \brief Пересечение всех объектов сцены и луча
+         * \param ray Луч
+         * \param tMin Минимальное расстояние
+         * \param tMax Максимальное расстояние
+         * \param hitInfo Информация о пересечении
+         * \return Было ли пересечение с объектом
+         */
+        bool intersectsRay(const math::Ray& ray, float tMin, float tMax, HitInfo* hitInfo) const override
+        {
+            // Информация о пересечении
+            HitInfo hit{};
+            // Было ли пересечение с каким-либо объектом
+            bool hitAnything = false;
+            // Расстояние до ближ. пересечения
+            float closest = tMax;
+
+            // Неограниченные элементы проверяются первыми
+            for(const auto& element : unbounded_)
+            {
+                if(element->intersectsRay(ray,tMin,closest,&hit)){
+                    hitAnything = true;
+                    closest = hit.t;
+                    if(hitInfo != nullptr) *hitInfo = hit;
+                }
+            }
+
+            // Обход широкой иерархии
+            bool hitTree = wideTree_.traverse(ray, tMin, closest, [&](uint32_t index, float tMinLeaf, float& tClosest){
+                if(elements_[index]->intersectsRay(ray,tMinLeaf,tClosest,&hit)){
+                    tClosest = hit.t;
+                    if(hitInfo != nullptr) *hitInfo = hit;
+                    return true;
+                }
+                return false;
+            });
+
+            return hitAnything || hitTree;
+        }
+
+        /**
+         * \brief Перекрывает ли какой-либо элемент луч на заданном отрезке
+         * \param ray Луч
+         * \param tMin Минимальное расстояние
+         * \param tMax Максимальное расстояние
+         * \return Было ли пересечение с каким-либо элементом
+         */
+        bool occluded(const math::Ray& ray, float tMin, float tMax) const override
+        {
+            for(const auto& element : unbounded_){
+                if(element->occluded(ray,tMin,tMax)) return true;
+            }
+
+            return wideTree_.traverseAny(ray, tMin, tMax, [&](uint32_t index){
+                return elements_[index]->occluded(ray,tMin,tMax);
+            });
+        }
+    };
+}
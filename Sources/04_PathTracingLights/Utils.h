@@ -1,52 +1,119 @@
 #pragma once
 
-#include <ctime>
 #include <chrono>
-#include <random>
 #include <memory>
+#include <cstdint>
 
 #include <Math.hpp>
 #include <Ray.hpp>
 
+/**
+ * \brief Генератор псевдослучайных чисел PCG32 (XSH-RR)
+ *
+ * \details Состояние занимает 16 байт, поэтому генератор создается на стеке для каждого семпла пикселя
+ * и передается по ссылке во все функции, которым нужны случайные числа. Общего состояния между потоками
+ * нет, а одинаковое зерно (пиксель, семпл, кадр) всегда дает одинаковую последовательность
+ */
+class Pcg32
+{
+private:
+    /// Состояние
+    uint64_t state_;
+    /// Приращение (номер последовательности, всегда нечетное)
+    uint64_t increment_;
+
+public:
+    /**
+     * \brief Основной конструктор
+     * \param seed Зерно (начальное состояние)
+     * \param sequence Номер последовательности
+     */
+    explicit Pcg32(uint64_t seed = 0x853c49e6748fea9bull, uint64_t sequence = 0xda3e39cb94b95bdbull):
+    state_(0),increment_((sequence << 1u) | 1u)
+    {
+        this->next();
+        state_ += seed;
+        this->next();
+    }
+
+    /**
+     * \brief Зерно по набору целых значений (например, пиксель, семпл и кадр)
+     * \param a Первое значение
+     * \param b Второе значение
+     * \param c Третье значение
+     * \return Зерно
+     *
+     * \details Значения перемешиваются функцией SplitMix64, поэтому соседние пиксели и семплы получают
+     * независимые на вид последовательности
+     */
+    static uint64_t seedFrom(uint64_t a, uint64_t b = 0, uint64_t c = 0)
+    {
+        auto mix = [](uint64_t x){
+            x += 0x9e3779b97f4a7c15ull;
+            x = (x ^ (x >> 30u)) * 0xbf58476d1ce4e5b9ull;
+            x = (x ^ (x >> 27u)) * 0x94d049bb133111ebull;
+            return x ^ (x >> 31u);
+        };
+        return mix(mix(mix(a) ^ b) ^ c);
+    }
+
+    /**
+     * \brief Следующее 32-битное значение
+     * \return Случайное значение
+     */
+    uint32_t next()
+    {
+        uint64_t old = state_;
+        state_ = old * 6364136223846793005ull + increment_;
+        auto xorShifted = static_cast<uint32_t>(((old >> 18u) ^ old) >> 27u);
+        auto rotation = static_cast<uint32_t>(old >> 59u);
+        return (xorShifted >> rotation) | (xorShifted << ((32u - rotation) & 31u));
+    }
+
+    /**
+     * \brief Следующее значение с плавающей точкой
+     * \return Случайное значение в пределах [0, 1)
+     */
+    float nextFloat()
+    {
+        // Старшие 24 бита - ровно столько помещается в мантиссу float
+        return static_cast<float>(this->next() >> 8u) * (1.0f / 16777216.0f);
+    }
+};
+
 /**
  * \brief Случайное float значение
+ * \param rng Генератор случайных чисел
  * \param min Минимальная граница
  * \param max Максимальная границе
  * \return Случайное значение
  */
-inline float RndFloat(float min = 0.0f, float max = 1.0f){
-    static std::chrono::milliseconds ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch());
-    static std::default_random_engine generator(static_cast<size_t>(ms.count()));
-    std::uniform_real_distribution<float> distribution(min, max);
-
-    return distribution(generator);
+inline float RndFloat(Pcg32& rng, float min = 0.0f, float max = 1.0f){
+    return min + (max - min) * rng.nextFloat();
 }
 
 /**
  * \brief Случайный вектор в заданых пределах
+ * \param rng Генератор случайных чисел
  * \param min Минимальное значение всех координат
  * \param max Максимальное значение всех координат
  * \return Вектор
  */
-inline math::Vec3<float> RndVec(float min = -1.0f, float max = 1.0f){
-    static std::chrono::milliseconds ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch());
-    static std::default_random_engine generator(static_cast<size_t>(ms.count()));
-    std::uniform_real_distribution<float> distribution(min, max);
-
-    return {
-            distribution(generator),
-            distribution(generator),
-            distribution(generator)
-    };
+inline math::Vec3<float> RndVec(Pcg32& rng, float min = -1.0f, float max = 1.0f){
+    float x = RndFloat(rng, min, max);
+    float y = RndFloat(rng, min, max);
+    float z = RndFloat(rng, min, max);
+    return {x, y, z};
 }
 
 /**
  * \brief Случайная точка в пределах единичной сферы
+ * \param rng Генератор случайных чисел
  * \return Вектор
  */
-inline math::Vec3<float> RndUnitSpherePoint(){
+inline math::Vec3<float> RndUnitSpherePoint(Pcg32& rng){
     while (true){
-        auto p = RndVec();
+        auto p = RndVec(rng);
         if(math::LengthSquared(p) >= 1) continue;
         return p;
     }
@@ -54,20 +121,13 @@ inline math::Vec3<float> RndUnitSpherePoint(){
 
 /**
  * \brief Случайный вектор в пределах полусферы в направлении dir
+ * \param rng Генератор случайных чисел
  * \param dir Направление (ориентация) полусферы
  * \param thetaMax Максимальное отклонение направления (90 для полной полусферы)
  * \return Вектор
  */
-inline math::Vec3<float> RndHemisphereVec(const math::Vec3<float>& dir, const float& thetaMax = 90.0f)
+inline math::Vec3<float> RndHemisphereVec(Pcg32& rng, const math::Vec3<float>& dir, const float& thetaMax = 90.0f)
 {
-    // Генератор случайных чисел
-    static std::chrono::milliseconds ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch());
-    static std::default_random_engine generator(static_cast<size_t>(ms.count()));
-
-    // Коэффициенты распределения для двух уголов
-    std::uniform_real_distribution<float> fiDist(0.0f,1.0f);
-    std::uniform_real_distribution<float> thetaDist(0.0f, 1.0f);
-
     // Вектор перпендикулярный вектору направления
     auto b = math::Normalize(math::Cross(dir, dir + math::Vec3<float>(0.01f, 0.01f, 0.01f)));
 
@@ -75,8 +135,8 @@ inline math::Vec3<float> RndHemisphereVec(const math::Vec3<float>& dir, const fl
     auto c = math::Normalize(math::Cross(dir, b));
 
     // Случайные углы (fi - для вектора вращяющегося вокруг направления dir, theta - угол между итоговым вектором и направлением dir)
-    float fi = (fiDist(generator) * 360.0f) / 57.2958f; // [0 - 360]
-    float theta = (thetaDist(generator) * thetaMax) / 57.2958f; // [0 - 90]
+    float fi = (rng.nextFloat() * 360.0f) / 57.2958f; // [0 - 360]
+    float theta = (rng.nextFloat() * thetaMax) / 57.2958f; // [0 - 90]
 
     // Вектор описывающий круг вокруг направления dir
     math::Vec3<float> d = (b * std::cos(fi)) + (c * std::sin(fi));
@@ -86,11 +146,12 @@ inline math::Vec3<float> RndHemisphereVec(const math::Vec3<float>& dir, const fl
 
 /**
  * \brief Случайный вектор в пределах полусферы в направлении dir (реализация через сферические координаты)
+ * \param rng Генератор случайных чисел
  * \param dir Направление (ориентация) полусферы
  * \param thetaMax Максимальное отклонение направления (90 для полной полусферы)
  * \return Вектор
  */
-inline math::Vec3<float> RndHemisphereVec2(const math::Vec3<float>& dir, const float& thetaMax = 90.0f)
+inline math::Vec3<float> RndHemisphereVec2(Pcg32& rng, const math::Vec3<float>& dir, const float& thetaMax = 90.0f)
 {
     // Вектор перпендикулярный вектору направления
     auto b = math::Normalize(math::Cross(dir, dir + math::Vec3<float>(0.01f, 0.01f, 0.01f)));
@@ -100,17 +161,9 @@ inline math::Vec3<float> RndHemisphereVec2(const math::Vec3<float>& dir, const f
     // В локальном пространстве вектор направления является вектором вверх, и ссответствует оси Y
     auto dirSpaceToWorldSpace = math::Mat3<float>(b,dir,c);
 
-    // Коэффициенты распределения для двух уголов
-    std::uniform_real_distribution<float> fiDist(0.0f,1.0f);
-    std::uniform_real_distribution<float> thetaDist(0.0f, 1.0f);
-
-    // Генератор случайных чисел
-    static std::chrono::milliseconds ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch());
-    static std::default_random_engine generator(static_cast<size_t>(ms.count()));
-
     // Случайные углы (fi - азимутный угол, theta - полярный угол)
-    float fi = (fiDist(generator) * 360.0f) / 57.2958f; // [0 - 360]
-    float theta = (thetaDist(generator) * thetaMax) / 57.2958f; // [0 - 90]
+    float fi = (rng.nextFloat() * 360.0f) / 57.2958f; // [0 - 360]
+    float theta = (rng.nextFloat() * thetaMax) / 57.2958f; // [0 - 90]
 
     // Перевод из сферичесих координат в декартовы, получение вектора в локальном пространстве
     math::Vec3<float> dirLocal = {
@@ -124,38 +177,60 @@ inline math::Vec3<float> RndHemisphereVec2(const math::Vec3<float>& dir, const f
 }
 
 /**
- * \brief Случайный вектор в пределах полусферы в направлении dir (более равномерное распределения засчет выборки по высоте)
+ * \brief Вектор в пределах полусферы в направлении dir по паре равномерно распределенных значений
+ * \param u Значения в пределах [0, 1) (например, из генератора семплов)
  * \param dir Направление (ориентация) полусферы
  * \param thetaMax Максимальное отклонение направления (90 для полной полусферы)
  * \return Вектор
+ *
+ * \details Равномерное распределение по площади сферического сегмента засчет выборки по высоте. Отображение
+ * непрерывно, поэтому стратификация значений u сохраняется и для направлений
  */
-inline math::Vec3<float> RndHemisphereVec3(const math::Vec3<float>& dir, const float& thetaMax = 90.0f)
+inline math::Vec3<float> HemisphereVec(const math::Vec2<float>& u, const math::Vec3<float>& dir, const float& thetaMax = 90.0f)
 {
-    // Генератор случайных чисел
-    static std::chrono::milliseconds ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch());
-    static std::default_random_engine generator(static_cast<size_t>(ms.count()));
-
-    // Коэффициенты распределения для двух угло
-    // Второй угол вычисляется через случайную высоту, это дает наиболее равномерное распределение по полусфере
-    std::uniform_real_distribution<float> fiDist(0.0f,1.0f);
-    std::uniform_real_distribution<float> heightDist(std::cos(thetaMax/57.2958f), 1.0f);
-
     // Вектор перпендикулярный вектору направления
     auto b = math::Normalize(math::Cross(dir, dir + math::Vec3<float>(0.01f, 0.01f, 0.01f)));
 
     // Второй перпендикулярный вектор
     auto c = math::Normalize(math::Cross(dir, b));
 
-    // Случайные углы (fi - для вектора вращяющегося вокруг направления dir, theta - угол между итоговым вектором и направлением dir)
-    float fi = (fiDist(generator) * 360.0f) / 57.2958f; // [0 - 360]
-    float theta = std::acos(heightDist(generator)); //[0 - 90]
+    // Углы (fi - для вектора вращяющегося вокруг направления dir, theta - угол между итоговым вектором и направлением dir)
+    // Второй угол вычисляется через высоту, это дает наиболее равномерное распределение по полусфере
+    float cosThetaMin = std::cos(thetaMax/57.2958f);
+    float fi = (u.x * 360.0f) / 57.2958f; // [0 - 360]
+    float theta = std::acos(cosThetaMin + (1.0f - cosThetaMin) * u.y); //[0 - 90]
 
     // Вектор описывающий круг вокруг направления dir
     math::Vec3<float> d = (b * std::cos(fi)) + (c * std::sin(fi));
-    // Вектор отклоненный от dir на случайный угол theta
+    // Вектор отклоненный от dir на угол theta
     return (dir * std::cos(theta)) + (d * std::sin(theta));
 }
 
+/**
+ * \brief Плотность вероятности направлений HemisphereVec (по телесному углу)
+ * \param thetaMax Максимальное отклонение направления (90 для полной полусферы)
+ * \return Плотность (постоянна в пределах сферического сегмента)
+ */
+inline float HemispherePdf(const float& thetaMax = 90.0f)
+{
+    float cosThetaMin = std::cos(thetaMax/57.2958f);
+    return 1.0f / (2.0f * static_cast<float>(M_PI) * std::max(1.0f - cosThetaMin, 1e-6f));
+}
+
+/**
+ * \brief Случайный вектор в пределах полусферы в направлении dir (более равномерное распределения засчет выборки по высоте)
+ * \param rng Генератор случайных чисел
+ * \param dir Направление (ориентация) полусферы
+ * \param thetaMax Максимальное отклонение направления (90 для полной полусферы)
+ * \return Вектор
+ */
+inline math::Vec3<float> RndHemisphereVec3(Pcg32& rng, const math::Vec3<float>& dir, const float& thetaMax = 90.0f)
+{
+    float u1 = rng.nextFloat();
+    float u2 = rng.nextFloat();
+    return HemisphereVec({u1, u2}, dir, thetaMax);
+}
+
 /**
  * \brief Предварительная декларация материала
  */
@@ -164,6 +239,22 @@ namespace materials
     class Material;
 }
 
+/**
+ * \brief Предварительная декларация генератора семплов
+ */
+namespace samplers
+{
+    class Sampler;
+}
+
+/**
+ * \brief Предварительная декларация элемента сцены
+ */
+namespace scene
+{
+    class Hittable;
+}
+
 
 /**
  * \brief Информация о точке пересечения луча и объекта
@@ -178,8 +269,10 @@ struct HitInfo
     float t = 0.0f;
     /// Является ли сторона "лицевой"
     bool frontFaceSurface = true;
-    /// Указатель на материал в точке пересечения
-    std::shared_ptr<materials::Material> materialPtr = nullptr;
+    /// Указатель на материал в точке пересечения (материалом владеет объект сцены)
+    const materials::Material* materialPtr = nullptr;
+    /// Пересеченный объект (для экземпляров - сам экземпляр), позволяет узнать, был ли он выбран как источник света
+    const scene::Hittable* objectPtr = nullptr;
 };
 
 /**
@@ -227,9 +320,54 @@ namespace materials
          * \param rayIn Входной луч
          * \param hitInfo Информация о пересечении с поверхностью
          * \param attenuationOut Затухание для переотраженного луча
+         * \param sampler Генератор семплов (свой у каждого потока)
          * \return Переотраженный луч
          */
-        virtual math::Ray scatteredRay(const math::Ray& rayIn, const HitInfo& hitInfo, math::Vec3<float>* attenuationOut) const = 0;
+        virtual math::Ray scatteredRay(const math::Ray& rayIn, const HitInfo& hitInfo, math::Vec3<float>* attenuationOut, samplers::Sampler& sampler) const = 0;
+
+        /**
+         * \brief Является ли отражение зеркальным (направление определяется входным лучом почти однозначно)
+         * \return Да или нет
+         *
+         * \details Для зеркальных материалов явная выборка источников света не выполняется - вероятность того,
+         * что направление на случайную точку источника совпадет с отраженным, близка к нулю
+         */
+        virtual bool isSpecular() const
+        {
+            return true;
+        }
+
+        /**
+         * \brief Доля света, приходящего с заданного направления и отражаемого в сторону входного луча
+         * \param rayIn Входной луч
+         * \param hitInfo Информация о пересечении с поверхностью
+         * \param direction Направление на источник света (единичный вектор)
+         * \return Значение BRDF, умноженное на косинус угла между направлением и нормалью
+         *
+         * \details Должно быть согласовано с scatteredRay: затухание разбросанного луча равно eval / pdf
+         */
+        virtual math::Vec3<float> eval(const math::Ray& rayIn, const HitInfo& hitInfo, const math::Vec3<float>& direction) const
+        {
+            (void) rayIn;
+            (void) hitInfo;
+            (void) direction;
+            return {0.0f,0.0f,0.0f};
+        }
+
+        /**
+         * \brief Плотность вероятности того, что scatteredRay выберет заданное направление
+         * \param rayIn Входной луч
+         * \param hitInfo Информация о пересечении с поверхностью
+         * \param direction Направление (единичный вектор)
+         * \return Плотность по телесному углу (0 для зеркальных материалов)
+         */
+        virtual float pdf(const math::Ray& rayIn, const HitInfo& hitInfo, const math::Vec3<float>& direction) const
+        {
+            (void) rayIn;
+            (void) hitInfo;
+            (void) direction;
+            return 0.0f;
+        }
 
         /**
          * \brief Излученный цвет
@@ -295,6 +433,51 @@ namespace scene
          * \return Было ли пересечение с объектом
          */
         virtual bool intersectsRay(const math::Ray& ray, float tMin, float tMax, HitInfo* hitInfo) const = 0;
+
+        /**
+         * \brief Перекрывает ли объект луч на заданном отрезке (теневые лучи)
+         * \param ray Луч
+         * \param tMin Минимальное расстояние
+         * \param tMax Максимальное расстояние
+         * \return Было ли пересечение с объектом
+         *
+         * \details В отличии от intersectsRay достаточно любого пересечения - ближайшее не ищется, информация
+         * о пересечении (точка, нормаль, материал) не вычисляется. Составные объекты переопределяют метод,
+         * чтобы завершать поиск на первом найденном пересечении
+         */
+        virtual bool occluded(const math::Ray& ray, float tMin, float tMax) const
+        {
+            return this->intersectsRay(ray, tMin, tMax, nullptr);
+        }
+
+        /**
+         * \brief Описывающий параллелипипед объекта (полностью виртуальный метод)
+         * \param bboxOut Описывающий параллелипипед в мировых координатах
+         * \return Ограничен ли объект (false для бесконечных объектов, например плоскостей)
+         */
+        virtual bool boundingBox(math::BBox<>* bboxOut) const = 0;
+
+        /**
+         * \brief Площадь поверхности объекта (для выборки точек на источниках света)
+         * \return Площадь (0 - объект не поддерживает выборку точек)
+         */
+        virtual float area() const
+        {
+            return 0.0f;
+        }
+
+        /**
+         * \brief Точка на поверхности объекта (равномерно распределенная по площади)
+         * \param u Пара значений в пределах [0, 1)
+         * \param pointOut Точка в мировых координатах
+         * \param normalOut Нормаль лицевой стороны в точке
+         */
+        virtual void samplePoint(const math::Vec2<float>& u, math::Vec3<float>* pointOut, math::Vec3<float>* normalOut) const
+        {
+            (void) u;
+            *pointOut = {0.0f,0.0f,0.0f};
+            *normalOut = {0.0f,0.0f,0.0f};
+        }
     };
 
     /**
@@ -388,5 +571,42 @@ namespace scene
 
             return hitAnything;
         }
+
+        /**
+         * \brief Перекрывает ли какой-либо элемент списка луч на заданном отрезке
+         * \param ray Луч
+         * \param tMin Минимальное расстояние
+         * \param tMax Максимальное расстояние
+         * \return Было ли пересечение с каким-либо элементом
+         */
+        bool occluded(const math::Ray& ray, float tMin, float tMax) const override
+        {
+            for(const auto& element : elements_){
+                if(element->occluded(ray,tMin,tMax)) return true;
+            }
+            return false;
+        }
+
+        /**
+         * \brief Описывающий параллелипипед всех элементов списка
+         * \param bboxOut Описывающий параллелипипед в мировых координатах
+         * \return Ограничены ли все элементы (если хотя бы один элемент бесконечен - список тоже бесконечен)
+         */
+        bool boundingBox(math::BBox<>* bboxOut) const override
+        {
+            // Итоговый параллелипипед
+            math::BBox<> result = math::EmptyBBox();
+
+            // Объединить параллелипипеды всех элементов
+            for(const auto& element : elements_)
+            {
+                math::BBox<> elementBox{};
+                if(!element->boundingBox(&elementBox)) return false;
+                result = math::Union(result,elementBox);
+            }
+
+            if(bboxOut != nullptr) *bboxOut = result;
+            return !elements_.empty();
+        }
     };
 }
\ No newline at end of file
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <stdexcept>
+
+/**
+ * \brief Аргументы командной строки
+ *
+ * \details Поддерживаются параметры вида "--name value", "--name=value" и флаги "--name" (без значения).
+ * Значением считается следующий аргумент, если он не начинается с "--"
+ */
+class CommandLine
+{
+private:
+    /// Значения параметров (для флагов - пустая строка)
+    std::map<std::string, std::string> values_;
+
+public:
+    /**
+     * \brief Основной конструктор (разбор аргументов)
+     * \param argc Кол-во аргументов
+     * \param argv Аргументы
+     */
+    CommandLine(int argc, char* argv[])
+    {
+        for(int i = 1; i < argc; i++)
+        {
+            std::string argument = argv[i];
+            if(argument.size() < 3 || argument.compare(0, 2, "--") != 0){
+                throw std::runtime_error("ERROR: Unexpected command line argument \"" + argument + "\".");
+            }
+
+            auto separator = argument.find('=');
+            if(separator != std::string::npos){
+                values_[argument.substr(2, separator - 2)] = argument.substr(separator + 1);
+            }
+            else if(i + 1 < argc && std::string(argv[i + 1]).compare(0, 2, "--") != 0){
+                values_[argument.substr(2)] = argv[++i];
+            }
+            else{
+                values_[argument.substr(2)] = "";
+            }
+        }
+    }
+
+    /**
+     * \brief Задан ли параметр (или флаг)
+     * \param name Название (без "--")
+     * \return Да или нет
+     */
+    bool has(const std::string& name) const
+    {
+        return values_.find(name) != values_.end();
+    }
+
+    /**
+     * \brief Получить строковое значение
+     * \param name Название (без "--")
+     * \param defaultValue Значение, если параметр не задан
+     * \return Значение
+     */
+    std::string getString(const std::string& name, const std::string& defaultValue = "") const
+    {
+        auto it = values_.find(name);
+        return it != values_.end() ? it->second : defaultValue;
+    }
+
+    /**
+     * \brief Получить целое неотрицательное значение
+     * \param name Название (без "--")
+     * \param defaultValue Значение, если параметр не задан
+     * \return Значение
+     */
+    unsigned getUnsigned(const std::string& name, unsigned defaultValue) const
+    {
+        auto it = values_.find(name);
+        if(it == values_.end()) return defaultValue;
+
+        size_t end = 0;
+        unsigned long value = 0;
+        try { value = std::stoul(it->second, &end); } catch(std::exception&) { end = 0; }
+        if(end == 0 || end != it->second.size() || it->second[0] == '-'){
+            throw std::runtime_error("ERROR: Invalid value \"" + it->second + "\" of --" + name + " (unsigned integer expected).");
+        }
+        return static_cast<unsigned>(value);
+    }
+
+    /**
+     * \brief Получить вещественное значение
+     * \param name Название (без "--")
+     * \param defaultValue Значение, если параметр не задан
+     * \return Значение
+     */
+    float getFloat(const std::string& name, float defaultValue) const
+    {
+        auto it = values_.find(name);
+        if(it == values_.end()) return defaultValue;
+
+        size_t end = 0;
+        float value = 0.0f;
+        try { value = std::stof(it->second, &end); } catch(std::exception&) { end = 0; }
+        if(end == 0 || end != it->second.size()){
+            throw std::runtime_error("ERROR: Invalid value \"" + it->second + "\" of --" + name + " (number expected).");
+        }
+        return value;
+    }
+};
@@ -5,6 +5,7 @@
 
 #pragma once
 #include <algorithm>
+#include <cstring>
 
 /**
  * Буфер данных двумерного изображения
@@ -169,6 +170,14 @@ public:
         return this->data_;
     }
 
+    /**
+     * Получить данные (только чтение)
+     * \return
+     */
+    const T* getData() const {
+        return this->data_;
+    }
+
     /**
      * Получить ширину
      * \return
@@ -198,8 +207,8 @@ public:
         if(this->getSize() == 0) return false;
 
         return
-                static_cast<unsigned>(x) <= (this->getWidth()-1) && static_cast<unsigned>(x) >= 0 &&
-                static_cast<unsigned>(y) <= (this->getHeight()-1) && static_cast<unsigned>(y) >= 0;
+                static_cast<unsigned>(x) <= (this->getWidth()-1) &&
+                static_cast<unsigned>(y) <= (this->getHeight()-1);
     }
 
     /**
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+
+#include "ImageBuffer.hpp"
+#include "Pixel.hpp"
+
+/**
+ * \brief Запись изображений в файл (без внешних зависимостей)
+ */
+namespace imagefile
+{
+    /**
+     * \brief Записать 32-битное число в порядке big-endian
+     * \param out Массив байт
+     * \param value Значение
+     */
+    inline void PutBigEndian(std::vector<uint8_t>* out, uint32_t value)
+    {
+        out->push_back(static_cast<uint8_t>(value >> 24u));
+        out->push_back(static_cast<uint8_t>(value >> 16u));
+        out->push_back(static_cast<uint8_t>(value >> 8u));
+        out->push_back(static_cast<uint8_t>(value));
+    }
+
+    /**
+     * \brief Контрольная сумма CRC-32 (используется в блоках PNG)
+     * \param data Данные
+     * \param size Размер данных
+     * \return Контрольная сумма
+     */
+    inline uint32_t Crc32(const uint8_t* data, size_t size)
+    {
+        static const struct Table
+        {
+            uint32_t values[256];
+            Table():values()
+            {
+                for(uint32_t i = 0; i < 256; i++){
+                    uint32_t c = i;
+                    for(unsigned k = 0; k < 8; k++) c = (c & 1u) ? 0xedb88320u ^ (c >> 1u) : c >> 1u;
+                    values[i] = c;
+                }
+            }
+        } table;
+
+        uint32_t crc = 0xffffffffu;
+        for(size_t i = 0; i < size; i++) crc = table.values[(crc ^ data[i]) & 0xffu] ^ (crc >> 8u);
+        return crc ^ 0xffffffffu;
+    }
+
+    /**
+     * \brief Контрольная сумма Adler-32 (используется в потоке zlib)
+     * \param data Данные
+     * \param size Размер данных
+     * \return Контрольная сумма
+     */
+    inline uint32_t Adler32(const uint8_t* data, size_t size)
+    {
+        uint32_t a = 1, b = 0;
+        for(size_t i = 0; i < size; i++){
+            a = (a + data[i]) % 65521u;
+            b = (b + a) % 65521u;
+        }
+        return (b << 16u) | a;
+    }
+
+    /**
+     * \brief Открыть файл для записи
+     * \param path Путь к файлу
+     * \return Файловый поток
+     */
+    inline std::ofstream OpenForWriting(const std::string& path)
+    {
+        std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+        if(!file.is_open()) throw std::runtime_error("ERROR: Can't open file \"" + path + "\" for writing.");
+        return file;
+    }
+
+    /**
+     * \brief Сохранить изображение в формате PPM (двоичный P6)
+     * \param path Путь к файлу
+     * \param image Изображение
+     */
+    inline void SavePPM(const std::string& path, const ImageBuffer<Pixel>& image)
+    {
+        std::ofstream file = OpenForWriting(path);
+        file << "P6\n" << image.getWidth() << " " << image.getHeight() << "\n255\n";
+
+        std::vector<uint8_t> row(image.getWidth() * 3);
+        for(unsigned y = 0; y < image.getHeight(); y++){
+            const Pixel* pixels = image.getData() + y * image.getWidth();
+            for(unsigned x = 0; x < image.getWidth(); x++){
+                row[x * 3 + 0] = pixels[x].r;
+                row[x * 3 + 1] = pixels[x].g;
+                row[x * 3 + 2] = pixels[x].b;
+            }
+            file.write(reinterpret_cast<const char*>(row.data()), static_cast<std::streamsize>(row.size()));
+        }
+
+        if(!file.good()) throw std::runtime_error("ERROR: Can't write file \"" + path + "\".");
+    }
+
+    /**
+     * \brief Сохранить изображение в формате PNG (RGB, 8 бит на канал)
+     * \param path Путь к файлу
+     * \param image Изображение
+     *
+     * \details Данные записываются несжатыми блоками deflate - файл крупнее, чем у полноценного кодировщика,
+     * зато запись занимает долю миллисекунды и не требует zlib
+     */
+    inline void SavePNG(const std::string& path, const ImageBuffer<Pixel>& image)
+    {
+        const uint32_t width = image.getWidth();
+        const uint32_t height = image.getHeight();
+
+        // Строки изображения (каждая начинается с типа фильтра - 0, без фильтрации)
+        std::vector<uint8_t> raw;
+        raw.reserve(static_cast<size_t>(width * 3 + 1) * height);
+        for(uint32_t y = 0; y < height; y++){
+            raw.push_back(0);
+            const Pixel* pixels = image.getData() + y * width;
+            for(uint32_t x = 0; x < width; x++){
+                raw.push_back(pixels[x].r);
+                raw.push_back(pixels[x].g);
+                raw.push_back(pixels[x].b);
+            }
+        }
+
+        // Поток zlib из несжатых блоков deflate (не более 65535 байт в блоке)
+        std::vector<uint8_t> zlib = {0x78, 0x01};
+        zlib.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+        size_t offset = 0;
+        do {
+            auto length = static_cast<uint16_t>(std::min<size_t>(raw.size() - offset, 65535));
+            bool last = offset + length == raw.size();
+            zlib.push_back(last ? 1 : 0);
+            zlib.push_back(static_cast<uint8_t>(length & 0xffu));
+            zlib.push_back(static_cast<uint8_t>(length >> 8u));
+            zlib.push_back(static_cast<uint8_t>(~length & 0xffu));
+            zlib.push_back(static_cast<uint8_t>((~length >> 8u) & 0xffu));
+            zlib.insert(zlib.end(), raw.begin() + static_cast<std::ptrdiff_t>(offset), raw.begin() + static_cast<std::ptrdiff_t>(offset + length));
+            offset += length;
+        } while(offset < raw.size());
+        PutBigEndian(&zlib, Adler32(raw.data(), raw.size()));
+
+        // Заголовок (ширина, высота, 8 бит, RGB, deflate, без фильтров, без чередования)
+        std::vector<uint8_t> header;
+        PutBigEndian(&header, width);
+        PutBigEndian(&header, height);
+        header.insert(header.end(), {8, 2, 0, 0, 0});
+
+        std::ofstream file = OpenForWriting(path);
+        const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+        file.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+        // Запись блока (длина, тип, данные, CRC типа и данных)
+        auto writeChunk = [&file](const char* type, const std::vector<uint8_t>& data){
+            std::vector<uint8_t> chunk;
+            PutBigEndian(&chunk, static_cast<uint32_t>(data.size()));
+            chunk.insert(chunk.end(), type, type + 4);
+            chunk.insert(chunk.end(), data.begin(), data.end());
+            PutBigEndian(&chunk, Crc32(chunk.data() + 4, chunk.size() - 4));
+            file.write(reinterpret_cast<const char*>(chunk.data()), static_cast<std::streamsize>(chunk.size()));
+        };
+
+        writeChunk("IHDR", header);
+        writeChunk("IDAT", zlib);
+        writeChunk("IEND", {});
+
+        if(!file.good()) throw std::runtime_error("ERROR: Can't write file \"" + path + "\".");
+    }
+
+    /**
+     * \brief Сохранить изображение (формат определяется расширением файла - .png или .ppm)
+     * \param path Путь к файлу
+     * \param image Изображение
+     */
+    inline void SaveImage(const std::string& path, const ImageBuffer<Pixel>& image)
+    {
+        std::string extension = path.substr(std::min(path.find_last_of('.'), path.size()));
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](char c){
+            return static_cast<char>(c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c);
+        });
+
+        if(extension == ".png") SavePNG(path, image);
+        else if(extension == ".ppm") SavePPM(path, image);
+        else throw std::runtime_error("ERROR: Unsupported image format \"" + extension + "\" (use .png or .ppm).");
+    }
+}
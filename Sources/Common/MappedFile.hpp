@@ -0,0 +1,224 @@
+#pragma once
+
+#include <string>
+#include <stdexcept>
+#include <cstddef>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/**
+ * \brief Ожидаемый порядок обращения к отображенному файлу (подсказка операционной системе)
+ */
+enum class MappedFileAccess
+{
+    /// Последовательное чтение (страницы подгружаются с опережением)
+    eSequential,
+    /// Произвольный доступ (опережающее чтение отключается)
+    eRandom
+};
+
+/**
+ * \brief Файл, отображенный в память (только чтение)
+ *
+ * \details Содержимое файла доступно как непрерывный массив байт без копирования - страницы подгружаются
+ * операционной системой по мере обращения к ним. Объект можно только перемещать
+ */
+class MappedFile
+{
+private:
+    /// Указатель на начало отображенных данных
+    const char* data_;
+    /// Размер файла в байтах
+    size_t size_;
+#ifdef _WIN32
+    /// Дескриптор файла
+    HANDLE file_;
+    /// Дескриптор отображения
+    HANDLE mapping_;
+#else
+    /// Дескриптор файла
+    int file_;
+#endif
+
+    /**
+     * \brief Закрыть отображение и файл
+     */
+    void close() noexcept
+    {
+#ifdef _WIN32
+        if(data_ != nullptr) UnmapViewOfFile(data_);
+        if(mapping_ != nullptr) CloseHandle(mapping_);
+        if(file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+        mapping_ = nullptr;
+        file_ = INVALID_HANDLE_VALUE;
+#else
+        if(data_ != nullptr) munmap(const_cast<char*>(data_), size_);
+        if(file_ >= 0) ::close(file_);
+        file_ = -1;
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    /**
+     * \brief Перенять ресурсы другого объекта
+     * \param other Другой объект (после операции пуст)
+     */
+    void take(MappedFile& other) noexcept
+    {
+        data_ = other.data_;
+        size_ = other.size_;
+        file_ = other.file_;
+        other.data_ = nullptr;
+        other.size_ = 0;
+#ifdef _WIN32
+        mapping_ = other.mapping_;
+        other.mapping_ = nullptr;
+        other.file_ = INVALID_HANDLE_VALUE;
+#else
+        other.file_ = -1;
+#endif
+    }
+
+public:
+    /**
+     * \brief Конструктор по умолчанию (пустой объект)
+     */
+#ifdef _WIN32
+    MappedFile():data_(nullptr),size_(0),file_(INVALID_HANDLE_VALUE),mapping_(nullptr){}
+#else
+    MappedFile():data_(nullptr),size_(0),file_(-1){}
+#endif
+
+    /**
+     * \brief Основной конструктор (открывает и отображает файл)
+     * \param path Путь к файлу
+     * \param access Ожидаемый порядок обращения к данным
+     */
+    explicit MappedFile(const std::string& path, MappedFileAccess access = MappedFileAccess::eSequential):MappedFile()
+    {
+#ifdef _WIN32
+        DWORD flags = access == MappedFileAccess::eRandom ? FILE_FLAG_RANDOM_ACCESS : FILE_FLAG_SEQUENTIAL_SCAN;
+        file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags, nullptr);
+        if(file_ == INVALID_HANDLE_VALUE){
+            throw std::runtime_error("ERROR: Can't open file " + path);
+        }
+
+        LARGE_INTEGER size;
+        if(!GetFileSizeEx(file_, &size)){
+            this->close();
+            throw std::runtime_error("ERROR: Can't get size of file " + path);
+        }
+        size_ = static_cast<size_t>(size.QuadPart);
+
+        // Пустой файл отобразить нельзя (но это не ошибка)
+        if(size_ == 0) return;
+
+        mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if(mapping_ == nullptr || (data_ = static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0))) == nullptr){
+            this->close();
+            throw std::runtime_error("ERROR: Can't map file " + path);
+        }
+#else
+        file_ = open(path.c_str(), O_RDONLY);
+        if(file_ < 0){
+            throw std::runtime_error("ERROR: Can't open file " + path);
+        }
+
+        struct stat info{};
+        if(fstat(file_, &info) != 0){
+            this->close();
+            throw std::runtime_error("ERROR: Can't get size of file " + path);
+        }
+        size_ = static_cast<size_t>(info.st_size);
+
+        // Пустой файл отобразить нельзя (но это не ошибка)
+        if(size_ == 0) return;
+
+        void* mapped = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, file_, 0);
+        if(mapped == MAP_FAILED){
+            size_ = 0;
+            this->close();
+            throw std::runtime_error("ERROR: Can't map file " + path);
+        }
+        data_ = static_cast<const char*>(mapped);
+        this->advise(access);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /**
+     * \brief Конструктор перемещения
+     * \param other Другой объект
+     */
+    MappedFile(MappedFile&& other) noexcept:MappedFile()
+    {
+        this->take(other);
+    }
+
+    /**
+     * \brief Перемещение
+     * \param other Другой объект
+     * \return Ссылка на текущий объект
+     */
+    MappedFile& operator=(MappedFile&& other) noexcept
+    {
+        if(this != &other){
+            this->close();
+            this->take(other);
+        }
+        return *this;
+    }
+
+    /**
+     * \brief Деструктор
+     */
+    ~MappedFile()
+    {
+        this->close();
+    }
+
+    /**
+     * \brief Сменить ожидаемый порядок обращения к данным (например, после последовательной проверки файла)
+     * \param access Порядок обращения
+     *
+     * \details В Windows порядок задается только при открытии файла, поэтому вызов ничего не делает
+     */
+    void advise(MappedFileAccess access) const
+    {
+#ifndef _WIN32
+        if(data_ != nullptr){
+            madvise(const_cast<char*>(data_), size_, access == MappedFileAccess::eRandom ? MADV_RANDOM : MADV_SEQUENTIAL);
+        }
+#else
+        (void)access;
+#endif
+    }
+
+    /**
+     * \brief Получить указатель на данные
+     * \return Указатель на начало файла в памяти (nullptr для пустого файла)
+     */
+    const char* getData() const
+    {
+        return data_;
+    }
+
+    /**
+     * \brief Получить размер файла
+     * \return Размер в байтах
+     */
+    size_t getSize() const
+    {
+        return size_;
+    }
+};
@@ -7,6 +7,7 @@
 #include <cmath>
 #include <vector>
 #include <algorithm>
+#include <limits>
 
 #define M_PI 3.14159265358979323846  /* pi */
 
@@ -325,6 +326,73 @@ namespace math
         return a + ((b - a) * ratio);
     }
 
+    /**
+     * Пустой описывающий параллелипипед (min больше max, объединение с ним дает второй операнд)
+     * \tparam T Тип компонентов
+     * \return Пустой параллелипипед
+     */
+    template <typename T = float>
+    BBox<Vec3<T>> EmptyBBox()
+    {
+        const T inf = std::numeric_limits<T>::max();
+        return {{inf,inf,inf},{-inf,-inf,-inf}};
+    }
+
+    /**
+     * Объединение двух описывающих параллелипипедов
+     * \tparam T Тип компонентов
+     * \param a Первый параллелипипед
+     * \param b Второй параллелипипед
+     * \return Параллелипипед описывающий оба исходных
+     */
+    template <typename T = float>
+    BBox<Vec3<T>> Union(const BBox<Vec3<T>>& a, const BBox<Vec3<T>>& b)
+    {
+        return {
+                {std::min(a.min.x,b.min.x),std::min(a.min.y,b.min.y),std::min(a.min.z,b.min.z)},
+                {std::max(a.max.x,b.max.x),std::max(a.max.y,b.max.y),std::max(a.max.z,b.max.z)}
+        };
+    }
+
+    /**
+     * Расширение описывающего параллелипипеда точкой
+     * \tparam T Тип компонентов
+     * \param a Исходный параллелипипед
+     * \param p Точка
+     * \return Параллелипипед описывающий исходный и точку
+     */
+    template <typename T = float>
+    BBox<Vec3<T>> Union(const BBox<Vec3<T>>& a, const Vec3<T>& p)
+    {
+        return Union<T>(a,{p,p});
+    }
+
+    /**
+     * Центр описывающего параллелипипеда
+     * \tparam T Тип компонентов
+     * \param box Параллелипипед
+     * \return Точка центра
+     */
+    template <typename T = float>
+    Vec3<T> Center(const BBox<Vec3<T>>& box)
+    {
+        return (box.min + box.max) * static_cast<T>(0.5);
+    }
+
+    /**
+     * Площадь поверхности описывающего параллелипипеда (используется эвристикой SAH)
+     * \tparam T Тип компонентов
+     * \param box Параллелипипед
+     * \return Площадь (0 для пустого параллелипипеда)
+     */
+    template <typename T = float>
+    T SurfaceArea(const BBox<Vec3<T>>& box)
+    {
+        Vec3<T> d = box.max - box.min;
+        if(d.x < 0 || d.y < 0 || d.z < 0) return static_cast<T>(0);
+        return static_cast<T>(2) * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
     /**
      * Матрица 2x2
      * \tparam T Тип ячеек матрицы
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * \brief Пиксель кадрового буфера (8 бит на канал)
+ *
+ * \details Порядок каналов (BGRA) совпадает с RGBQUAD и 32-битными bit-map'ами Windows, поэтому буфер
+ * можно передавать в GDI без преобразования, при этом ядру рендеринга не нужен windows.h
+ */
+struct Pixel
+{
+    /// Синий
+    uint8_t b;
+    /// Зеленый
+    uint8_t g;
+    /// Красный
+    uint8_t r;
+    /// Альфа (не используется)
+    uint8_t a;
+};
+
+static_assert(sizeof(Pixel) == 4, "Pixel must be 4 bytes (layout of RGBQUAD)");
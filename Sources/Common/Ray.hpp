@@ -11,10 +11,22 @@ namespace math
     class Ray
     {
     private:
+        /**
+         * \brief Обратный вектор (компоненты 1/x, 1/y, 1/z)
+         * \param v Исходный вектор
+         * \return Обратный вектор
+         */
+        static math::Vec3<float> Reciprocal(const math::Vec3<float>& v)
+        {
+            return {1.0f / v.x, 1.0f / v.y, 1.0f / v.z};
+        }
+
         /// Начало луча
         math::Vec3<float> origin_;
         /// Направление луча
         math::Vec3<float> direction_;
+        /// Обратное направление луча (1/direction, используется при пересечении с параллелипипедами)
+        math::Vec3<float> directionInverse_;
         /// Вес луча
         float weight_;
 
@@ -22,7 +34,7 @@ namespace math
         /**
          * \brief Конструктор по умолчанию
          */
-        Ray() : origin_({}),direction_({0.0f,0.0f,-1.0f}),weight_(1.0f) {}
+        Ray() : origin_({}),direction_({0.0f,0.0f,-1.0f}),directionInverse_(Reciprocal(direction_)),weight_(1.0f) {}
 
         /**
          * \brief Основной конструктор
@@ -31,7 +43,7 @@ namespace math
          * \param weight Вес луча
          */
         Ray(const math::Vec3<float> &origin,const math::Vec3<float> &direction, const float &weight = 1.0f) :
-                origin_(origin), direction_(math::Normalize(direction)), weight_(weight) {};
+                origin_(origin), direction_(math::Normalize(direction)), directionInverse_(Reciprocal(direction_)), weight_(weight) {};
 
         /**
          * \brief Установить координаты начала луча
@@ -56,6 +68,7 @@ namespace math
          */
         void setDirection(const math::Vec3<float>& direction, bool normalize = true){
             this->direction_ = normalize ? math::Normalize(direction) : direction;
+            this->directionInverse_ = Reciprocal(this->direction_);
         }
 
         /**
@@ -82,6 +95,45 @@ namespace math
             return weight_;
         }
 
+        /**
+         * \brief Получить обратный вектор направления луча
+         * \return Вектор (1/x, 1/y, 1/z)
+         */
+        const math::Vec3<float>& getDirectionInverse() const {
+            return this->directionInverse_;
+        }
+
+        /**
+         * \brief Пересечение с описывающим параллелипипедом (slab-тест)
+         * \param box Параллелипипед выровненный по осям
+         * \param tMin Минимальное расстояние до точки пересечения
+         * \param tMax Максимальное расстояние до точки пересечения
+         * \param tOut Расстояние от начала до точки входа в параллелипипед (может быть меньше tMin если начало внутри)
+         * \return Было ли пересечение с параллелипипедом
+         */
+        bool intersectsBBox(const math::BBox<>& box, float tMin, float tMax, float* tOut) const
+        {
+            // Параметры t для пересечения с парами плоскостей ("слоями") по каждой из осей
+            float tx1 = (box.min.x - this->origin_.x) * this->directionInverse_.x;
+            float tx2 = (box.max.x - this->origin_.x) * this->directionInverse_.x;
+            float ty1 = (box.min.y - this->origin_.y) * this->directionInverse_.y;
+            float ty2 = (box.max.y - this->origin_.y) * this->directionInverse_.y;
+            float tz1 = (box.min.z - this->origin_.z) * this->directionInverse_.z;
+            float tz2 = (box.max.z - this->origin_.z) * this->directionInverse_.z;
+
+            // Луч внутри параллелипипеда на отрезке между самым дальним входом и самым ближним выходом
+            float tEnter = std::max(std::max(std::min(tx1,tx2),std::min(ty1,ty2)),std::min(tz1,tz2));
+            float tExit = std::min(std::min(std::max(tx1,tx2),std::max(ty1,ty2)),std::max(tz1,tz2));
+
+            // Отрезок не пуст и пересекается с допустимым диапазоном
+            if(tEnter <= tExit && tExit >= tMin && tEnter <= tMax){
+                if(tOut != nullptr) *tOut = tEnter;
+                return true;
+            }
+
+            return false;
+        }
+
         /**
          * \brief Пересечение со сферой
          * \param position Позиция центра сферы
@@ -211,6 +263,57 @@ namespace math
             return false;
         }
 
+        /**
+         * \brief Пересечение с треугольником (алгоритм Моллера-Трумбора)
+         * \param v0 Координаты вершины 0
+         * \param v1 Координаты вершины 1
+         * \param v2 Координаты вершины 2
+         * \param tMin Минимальное расстояние до точки пересечения
+         * \param tMax Максимальное расстояние до точки пересечения
+         * \param tOut Расстояние от начала, до точки пересечения
+         * \param barycentricCoords Барицентрические координаты точки - веса вершин 1 и 2 (вес вершины 0 равен 1-u-v)
+         * \return Было ли пересечение с объектом
+         *
+         * \details В отличии от intersectsTriangle не требует нормализации и обращения матрицы - точка пересечения
+         * ищется сразу в барицентрических координатах по правилу Крамера. Треугольник двусторонний
+         */
+        bool intersectsTriangleMT(
+                const math::Vec3<float> &v0, const math::Vec3<float> &v1, const math::Vec3<float> &v2,
+                float tMin, float tMax, float* tOut, math::Vec2<float>* barycentricCoords) const
+        {
+            // Два ребра треугольника
+            auto e1 = v1 - v0;
+            auto e2 = v2 - v0;
+
+            // Определитель системы (близок к нулю, если луч параллелен плоскости треугольника)
+            auto p = math::Cross(this->direction_, e2);
+            float det = math::Dot(e1, p);
+            if(det > -1e-12f && det < 1e-12f) return false;
+            float detInverse = 1.0f / det;
+
+            // Первая барицентрическая координата
+            auto s = this->origin_ - v0;
+            float u = math::Dot(s, p) * detInverse;
+            if(u < 0.0f || u > 1.0f) return false;
+
+            // Вторая барицентрическая координата
+            auto q = math::Cross(s, e1);
+            float v = math::Dot(this->direction_, q) * detInverse;
+            if(v < 0.0f || u + v > 1.0f) return false;
+
+            // Расстояние до пересечения
+            float t = math::Dot(e2, q) * detInverse;
+            if(t < tMin || t > tMax) return false;
+
+            if(tOut != nullptr) *tOut = t;
+            if(barycentricCoords != nullptr){
+                (*barycentricCoords).x = u;
+                (*barycentricCoords).y = v;
+            }
+
+            return true;
+        }
+
         /**
          * \brief Пересечение с плоскостью
          * \param normal Нормаль плоскости
@@ -0,0 +1,217 @@
+/**
+ * Дополнение к математической библиотеке (Math.hpp). Пакет лучей, для трассировки нескольких когерентных лучей разом
+ */
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+#include "Math.hpp"
+#include "Ray.hpp"
+
+// Векторные инструкции SSE (на x86-64 доступны всегда), на других платформах - обычный цикл по лучам
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RAY_PACKET_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace math
+{
+    /**
+     * \brief Пакет лучей
+     * \tparam N Кол-во лучей в пакете (4, 8 или 16)
+     *
+     * \details Лучи хранятся по компонентам (отдельные массивы для каждой координаты начала и направления),
+     * поэтому пересечение с объектом вычисляется сразу для четырех лучей одними векторными инструкциями, без
+     * ветвлений по отдельным лучам. Результат пересечения - битовая маска (бит на луч), незанятые дорожки пакета неактивны и в маску
+     * не попадают. Вычисления повторяют пересечения одиночного луча (Ray) операция в операцию, поэтому расстояния
+     * совпадают с ними до бита
+     */
+    template <unsigned N>
+    class RayPacket
+    {
+        static_assert(N == 4 || N == 8 || N == 16, "Ray packet size must be 4, 8 or 16");
+
+    private:
+        /// Координаты начал лучей
+        alignas(16) float originX_[N];
+        alignas(16) float originY_[N];
+        alignas(16) float originZ_[N];
+        /// Направления лучей
+        alignas(16) float directionX_[N];
+        alignas(16) float directionY_[N];
+        alignas(16) float directionZ_[N];
+        /// Минимальные и максимальные расстояния до точек пересечения
+        alignas(16) float tMin_[N];
+        alignas(16) float tMax_[N];
+        /// Маска активных дорожек
+        uint32_t activeMask_;
+
+    public:
+        /// Кол-во лучей в пакете
+        static constexpr unsigned kSize = N;
+
+        /**
+         * \brief Конструктор по умолчанию (все дорожки неактивны)
+         */
+        RayPacket():originX_(),originY_(),originZ_(),directionX_(),directionY_(),directionZ_(),tMin_(),tMax_(),activeMask_(0){}
+
+        /**
+         * \brief Поместить луч в дорожку пакета (дорожка становится активной)
+         * \param lane Номер дорожки
+         * \param ray Луч
+         * \param tMin Минимальное расстояние до точки пересечения
+         * \param tMax Максимальное расстояние до точки пересечения
+         */
+        void setRay(unsigned lane, const Ray& ray, float tMin, float tMax)
+        {
+            originX_[lane] = ray.getOrigin().x;
+            originY_[lane] = ray.getOrigin().y;
+            originZ_[lane] = ray.getOrigin().z;
+            directionX_[lane] = ray.getDirection().x;
+            directionY_[lane] = ray.getDirection().y;
+            directionZ_[lane] = ray.getDirection().z;
+            tMin_[lane] = tMin;
+            tMax_[lane] = tMax;
+            activeMask_ |= 1u << lane;
+        }
+
+        /**
+         * \brief Получить маску активных дорожек
+         * \return Маска (бит на дорожку)
+         */
+        uint32_t getActiveMask() const
+        {
+            return activeMask_;
+        }
+
+        /**
+         * \brief Пересечение лучей пакета со сферой (см. Ray::intersectsSphere)
+         * \param position Положение центра сферы
+         * \param radius Радиус сферы
+         * \param tOut Расстояния до точек пересечения (значимы только для лучей с пересечением)
+         * \return Маска лучей, пересекших сферу
+         */
+        uint32_t intersectsSphere(const Vec3<float>& position, float radius, float tOut[N]) const
+        {
+            uint32_t mask = 0;
+#ifdef RAY_PACKET_SSE
+            const __m128 px = _mm_set1_ps(position.x), py = _mm_set1_ps(position.y), pz = _mm_set1_ps(position.z);
+            const __m128 radiusSquared = _mm_set1_ps(radius * radius);
+            const __m128 zero = _mm_setzero_ps(), two = _mm_set1_ps(2.0f), four = _mm_set1_ps(4.0f), sign = _mm_set1_ps(-0.0f);
+
+            for(unsigned i = 0; i < N; i += 4)
+            {
+                const __m128 dx = _mm_load_ps(directionX_ + i), dy = _mm_load_ps(directionY_ + i), dz = _mm_load_ps(directionZ_ + i);
+                const __m128 tMin = _mm_load_ps(tMin_ + i), tMax = _mm_load_ps(tMax_ + i);
+
+                // Коэффициенты квадратного уравнения и дискриминант
+                __m128 ocX = _mm_sub_ps(_mm_load_ps(originX_ + i), px);
+                __m128 ocY = _mm_sub_ps(_mm_load_ps(originY_ + i), py);
+                __m128 ocZ = _mm_sub_ps(_mm_load_ps(originZ_ + i), pz);
+                __m128 a = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx,dx), _mm_mul_ps(dy,dy)), _mm_mul_ps(dz,dz));
+                __m128 b = _mm_mul_ps(two, _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx,ocX), _mm_mul_ps(dy,ocY)), _mm_mul_ps(dz,ocZ)));
+                __m128 c = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ocX,ocX), _mm_mul_ps(ocY,ocY)), _mm_mul_ps(ocZ,ocZ)), radiusSquared);
+                __m128 discriminant = _mm_sub_ps(_mm_mul_ps(b,b), _mm_mul_ps(_mm_mul_ps(four,a),c));
+
+                // Ни один из четырех лучей не пересекает сферу (у когерентных лучей - частый случай)
+                __m128 intersects = _mm_cmpge_ps(discriminant, zero);
+                if(_mm_movemask_ps(intersects) == 0) continue;
+
+                // Оба решения (корень из отрицательного дискриминанта не нужен - такие дорожки отбрасываются маской)
+                __m128 root = _mm_sqrt_ps(_mm_max_ps(discriminant, zero));
+                __m128 negativeB = _mm_xor_ps(b, sign);
+                __m128 twoA = _mm_mul_ps(two, a);
+                __m128 t1 = _mm_div_ps(_mm_sub_ps(negativeB, root), twoA);
+                __m128 t2 = _mm_div_ps(_mm_add_ps(negativeB, root), twoA);
+
+                // Ближайшее решение не ближе минимального расстояния
+                __m128 t1Behind = _mm_cmplt_ps(t1, tMin);
+                __m128 t2Behind = _mm_cmplt_ps(t2, tMin);
+                t1 = _mm_or_ps(_mm_and_ps(t1Behind, tMax), _mm_andnot_ps(t1Behind, t1));
+                t2 = _mm_or_ps(_mm_and_ps(t2Behind, tMax), _mm_andnot_ps(t2Behind, t2));
+                __m128 t = _mm_min_ps(t2, t1);
+
+                __m128 hit = _mm_andnot_ps(_mm_and_ps(t1Behind, t2Behind), intersects);
+                hit = _mm_and_ps(hit, _mm_cmple_ps(t, tMax));
+
+                _mm_storeu_ps(tOut + i, t);
+                mask |= static_cast<uint32_t>(_mm_movemask_ps(hit)) << i;
+            }
+#else
+            for(unsigned i = 0; i < N; i++)
+            {
+                float ocX = originX_[i] - position.x, ocY = originY_[i] - position.y, ocZ = originZ_[i] - position.z;
+                float a = (directionX_[i] * directionX_[i]) + (directionY_[i] * directionY_[i]) + (directionZ_[i] * directionZ_[i]);
+                float b = 2.0f * ((directionX_[i] * ocX) + (directionY_[i] * ocY) + (directionZ_[i] * ocZ));
+                float c = ((ocX * ocX) + (ocY * ocY) + (ocZ * ocZ)) - (radius * radius);
+                float discriminant = b*b - 4.0f * a * c;
+                if(discriminant < 0) continue;
+
+                float t1 = (-b - sqrtf(discriminant))/(2.0f * a);
+                float t2 = (-b + sqrtf(discriminant))/(2.0f * a);
+                if(t1 < tMin_[i] && t2 < tMin_[i]) continue;
+
+                if(t1 < tMin_[i]) t1 = tMax_[i];
+                if(t2 < tMin_[i]) t2 = tMax_[i];
+                tOut[i] = std::min(t1,t2);
+                if(tOut[i] <= tMax_[i]) mask |= 1u << i;
+            }
+#endif
+            return mask & activeMask_;
+        }
+
+        /**
+         * \brief Пересечение лучей пакета с плоскостью (см. Ray::intersectsPlane)
+         * \param normal Нормаль плоскости
+         * \param p0 Точка на плоскости
+         * \param tOut Расстояния до точек пересечения (значимы только для лучей с пересечением)
+         * \return Маска лучей, пересекших плоскость
+         */
+        uint32_t intersectsPlane(const Vec3<float>& normal, const Vec3<float>& p0, float tOut[N]) const
+        {
+            uint32_t mask = 0;
+#ifdef RAY_PACKET_SSE
+            const __m128 nx = _mm_set1_ps(normal.x), ny = _mm_set1_ps(normal.y), nz = _mm_set1_ps(normal.z);
+            const __m128 npx = _mm_set1_ps(normal.x * p0.x), npy = _mm_set1_ps(normal.y * p0.y), npz = _mm_set1_ps(normal.z * p0.z);
+            const __m128 zero = _mm_setzero_ps();
+
+            for(unsigned i = 0; i < N; i += 4)
+            {
+                // Знаменатель (для параллельных плоскости лучей - ноль, такие дорожки отбрасываются маской)
+                __m128 dot = _mm_add_ps(_mm_add_ps(
+                        _mm_mul_ps(_mm_load_ps(directionX_ + i), nx),
+                        _mm_mul_ps(_mm_load_ps(directionY_ + i), ny)),
+                        _mm_mul_ps(_mm_load_ps(directionZ_ + i), nz));
+
+                __m128 t = _mm_div_ps(_mm_add_ps(_mm_add_ps(
+                        _mm_sub_ps(npx, _mm_mul_ps(nx, _mm_load_ps(originX_ + i))),
+                        _mm_sub_ps(npy, _mm_mul_ps(ny, _mm_load_ps(originY_ + i)))),
+                        _mm_sub_ps(npz, _mm_mul_ps(nz, _mm_load_ps(originZ_ + i)))), dot);
+
+                __m128 hit = _mm_and_ps(_mm_cmpneq_ps(dot, zero), _mm_cmpgt_ps(t, zero));
+                hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(t, _mm_load_ps(tMin_ + i)), _mm_cmple_ps(t, _mm_load_ps(tMax_ + i))));
+
+                _mm_storeu_ps(tOut + i, t);
+                mask |= static_cast<uint32_t>(_mm_movemask_ps(hit)) << i;
+            }
+#else
+            for(unsigned i = 0; i < N; i++)
+            {
+                float dot = (directionX_[i] * normal.x) + (directionY_[i] * normal.y) + (directionZ_[i] * normal.z);
+                if(dot == 0) continue;
+
+                float t = (
+                        (normal.x * p0.x - normal.x * originX_[i]) +
+                        (normal.y * p0.y - normal.y * originY_[i]) +
+                        (normal.z * p0.z - normal.z * originZ_[i])) / dot;
+
+                tOut[i] = t;
+                if(t > 0 && t >= tMin_[i] && t <= tMax_[i]) mask |= 1u << i;
+            }
+#endif
+            return mask & activeMask_;
+        }
+    };
+}